@@ -238,55 +238,70 @@ public:
 
   };
 
+  /**
+   * Returns the rectangle [topLeft, bottomRight) of known cells. The search starts at the borders and stops at the first
+   * known cells, so maps whose known cells reach close to the borders (e.g. when hector_mapping crops to the explored
+   * area) are cheap, while the unknown margin of uncropped maps is scanned once.
+   */
   static bool getMapExtends(const nav_msgs::OccupancyGrid& map, Eigen::Vector2i& topLeft, Eigen::Vector2i& bottomRight)
   {
-    int lowerStart = -1;
-    int upperStart = 10000000;
-
-    int xMaxTemp = lowerStart;
-    int yMaxTemp = lowerStart;
-    int xMinTemp = upperStart;
-    int yMinTemp = upperStart;
-
     int width = map.info.width;
     int height = map.info.height;
 
-    for (int y = 0; y < height; ++y){
-      for (int x = 0; x < width; ++x){
+    const int8_t* data = map.data.empty() ? 0 : &map.data[0];
 
-        if ( map.data[x+y*width] != -1){
+    int yMin = 0;
+    while ((yMin < height) && !rowHasKnownCell(data, width, yMin, 0, width)){
+      ++yMin;
+    }
 
-          if (x > xMaxTemp) {
-            xMaxTemp = x;
-          }
+    if (yMin == height){
+      return false;
+    }
 
-          if (x < xMinTemp) {
-            xMinTemp = x;
-          }
+    int yMax = height - 1;
+    while (!rowHasKnownCell(data, width, yMax, 0, width)){
+      --yMax;
+    }
 
-          if (y > yMaxTemp) {
-            yMaxTemp = y;
-          }
+    int xMin = 0;
+    while (!columnHasKnownCell(data, width, xMin, yMin, yMax + 1)){
+      ++xMin;
+    }
 
-          if (y < yMinTemp) {
-            yMinTemp = y;
-          }
-        }
-      }
+    int xMax = width - 1;
+    while (!columnHasKnownCell(data, width, xMax, yMin, yMax + 1)){
+      --xMax;
     }
 
-    if ((xMaxTemp != lowerStart) &&
-        (yMaxTemp != lowerStart) &&
-        (xMinTemp != upperStart) &&
-        (yMinTemp != upperStart)) {
+    topLeft = Eigen::Vector2i(xMin, yMin);
+    bottomRight = Eigen::Vector2i(xMax + 1, yMax + 1);
 
-      topLeft = Eigen::Vector2i(xMinTemp,yMinTemp);
-      bottomRight = Eigen::Vector2i(xMaxTemp+1, yMaxTemp+1);
+    return true;
+  };
 
-      return true;
-    } else {
-      return false;
+  static bool rowHasKnownCell(const int8_t* data, int width, int y, int xBegin, int xEnd)
+  {
+    const int8_t* row = data + y * width;
+
+    for (int x = xBegin; x < xEnd; ++x){
+      if (row[x] != -1){
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  static bool columnHasKnownCell(const int8_t* data, int width, int x, int yBegin, int yEnd)
+  {
+    for (int y = yBegin; y < yEnd; ++y){
+      if (data[x + y * width] != -1){
+        return true;
+      }
     }
+
+    return false;
   };
 };
 
@@ -31,12 +31,18 @@
 
 #include "OccGridMapBase.h"
 #include "GridMapLogOdds.h"
+#include "GridMapQuantizedLogOdds.h"
 #include "GridMapReflectanceCount.h"
 #include "GridMapSimpleCount.h"
 
 namespace hectorslam {
 
 typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions> GridMap;
+//typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutTiled<3> > GridMap;
+//typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutRowMajorPow2> GridMap;
+//typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutSparse<6> > GridMap;
+//typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutToroidal> GridMap;
+//typedef OccGridMapBase<QuantizedLogOddsCell, GridMapQuantizedLogOddsFunctions> GridMap;
 //typedef OccGridMapBase<SimpleCountCell, GridMapSimpleCountFunctions> GridMap;
 //typedef OccGridMapBase<ReflectanceCell, GridMapReflectanceFunctions> GridMap;
 
@@ -33,14 +33,20 @@
 #include <Eigen/LU>
 
 #include "MapDimensionProperties.h"
+#include "GridMapLayout.h"
+
+#include <algorithm>
+#include <climits>
 
 namespace hectorslam {
 
 /**
  * GridMapBase provides basic grid map functionality (creates grid , provides transformation from/to world coordinates).
  * It serves as the base class for different map representations that may extend it's functionality.
+ * The ConcreteLayout policy determines how cells are arranged in memory (see GridMapLayout.h), all cell indices
+ * used by the map are storage indices as returned by getCellIndex().
  */
-template<typename ConcreteCellType>
+template<typename ConcreteCellType, typename ConcreteLayout = GridMapLayoutRowMajor>
 class GridMapBase
 {
 
@@ -48,6 +54,9 @@ public:
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
+  typedef ConcreteCellType CellType;
+  typedef ConcreteLayout LayoutType;
+
   /**
    * Indicates if given x and y are within map bounds
    * @return True if coordinates are within map bounds
@@ -61,6 +70,66 @@ public:
   int getSizeX() const { return mapDimensionProperties.getSizeX(); };
   int getSizeY() const { return mapDimensionProperties.getSizeY(); };
 
+  /**
+   * Returns the dimensions of the cell storage, which may be padded with respect to the map dimensions depending on
+   * the layout. Arrays indexed like the cells (e.g. caches) have to be allocated with this size.
+   */
+  const Eigen::Vector2i& getStorageDimensions() const { return layout.getStorageDimensions(); };
+  int getStorageSize() const { return layout.getStorageSize(); };
+
+  /**
+   * Returns the storage index of the cell at (x,y).
+   */
+  int getCellIndex(int x, int y) const { return layout.getIndex(x, y); };
+
+  /**
+   * Writes the storage indices of the cells (x,y), (x+1,y), (x,y+1) and (x+1,y+1) to indices.
+   */
+  void getInterpolationIndices(int x, int y, int* indices) const { layout.getInterpolationIndices(x, y, indices); };
+
+  const ConcreteLayout& getLayout() const { return layout; };
+
+  /**
+   * Indicates if storage exists for the cell at (x,y). Always true for dense layouts, with sparse layouts unallocated
+   * cells share the storage of a default cell and must not be written to.
+   */
+  bool isCellAllocated(int x, int y) const { return layout.isAllocated(x, y); };
+
+  /**
+   * Returns the rectangle of cells storage has been allocated for, clipped to the map. This is the whole map for dense
+   * layouts and the bounding box of allocated tiles for sparse layouts.
+   * @return False if no cell is allocated
+   */
+  bool getAllocatedArea(Eigen::Vector2i& areaMin, Eigen::Vector2i& areaMax) const
+  {
+    if (!layout.getAllocatedArea(areaMin, areaMax)) {
+      areaMin = Eigen::Vector2i::Zero();
+      areaMax = Eigen::Vector2i(this->getSizeX() - 1, this->getSizeY() - 1);
+    } else {
+      areaMin = areaMin.cwiseMax(Eigen::Vector2i::Zero());
+      areaMax = areaMax.cwiseMin(Eigen::Vector2i(this->getSizeX() - 1, this->getSizeY() - 1));
+    }
+
+    return (areaMin[0] <= areaMax[0]) && (areaMin[1] <= areaMax[1]);
+  }
+
+  /**
+   * Makes sure storage exists for the cell at (x,y) before it is updated. Only sparse layouts allocate anything here,
+   * if their storage grows, the cell arrays are reallocated keeping the values of all allocated cells.
+   * @return True if the storage size has changed, so arrays indexed like the cells have to be resized by the caller
+   */
+  bool allocateCell(int x, int y)
+  {
+    int oldSize = layout.getStorageSize();
+
+    if (layout.allocate(x, y)) {
+      resizeStorage(oldSize);
+      return true;
+    }
+
+    return false;
+  }
+
   bool pointOutOfMapBounds(const Eigen::Vector2f& pointMapCoords) const
   {
     return mapDimensionProperties.pointOutOfMapBounds(pointMapCoords);
@@ -76,10 +145,13 @@ public:
    */
   void clear()
   {
-    int size = this->getSizeX() * this->getSizeY();
+    layout.releaseAll();
+
+    int size = this->getStorageSize();
 
     for (int i = 0; i < size; ++i) {
       this->mapArray[i].resetGridCell();
+      this->updateStampArray[i] = -1;
     }
 
     //this->mapArray[0].set(1.0f);
@@ -94,12 +166,12 @@ public:
    */
   GridMapBase(float mapResolution, const Eigen::Vector2i& size, const Eigen::Vector2f& offset)
     : mapArray(0)
+    , updateStampArray(0)
     , lastUpdateIndex(-1)
   {
     Eigen::Vector2i newMapDimensions (size);
 
     this->setMapGridSize(newMapDimensions);
-    sizeX = size[0];
 
     setMapTransformation(offset, mapResolution);
 
@@ -115,39 +187,74 @@ public:
   }
 
   /**
-   * Allocates memory for the two dimensional pointer array for map representation.
+   * Allocates memory for the two dimensional pointer array for map representation and the update stamp array.
    */
   void allocateArray(const Eigen::Vector2i& newMapDims)
   {
-    int sizeX = newMapDims.x();
-    int sizeY = newMapDims.y();
+    layout.setMapDimensions(newMapDims);
 
-    mapArray = new ConcreteCellType [sizeX*sizeY];
+    int size = layout.getStorageSize();
+
+    mapArray = new ConcreteCellType [size];
+    updateStampArray = new int [size];
 
     mapDimensionProperties.setMapCellDims(newMapDims);
   }
 
+  /**
+   * Reallocates the cell and stamp arrays to the current storage size of the layout, copying the first oldSize cells
+   * and resetting the others.
+   */
+  void resizeStorage(int oldSize)
+  {
+    int size = layout.getStorageSize();
+
+    ConcreteCellType* newMapArray = new ConcreteCellType [size];
+    int* newUpdateStampArray = new int [size];
+
+    int copySize = std::min(oldSize, size);
+
+    std::copy(mapArray, mapArray + copySize, newMapArray);
+    std::copy(updateStampArray, updateStampArray + copySize, newUpdateStampArray);
+
+    for (int i = copySize; i < size; ++i) {
+      newMapArray[i].resetGridCell();
+      newUpdateStampArray[i] = -1;
+    }
+
+    delete[] mapArray;
+    delete[] updateStampArray;
+
+    mapArray = newMapArray;
+    updateStampArray = newUpdateStampArray;
+  }
+
   void deleteArray()
   {
     if (mapArray != 0){
 
       delete[] mapArray;
+      delete[] updateStampArray;
 
       mapArray = 0;
+      updateStampArray = 0;
       mapDimensionProperties.setMapCellDims(Eigen::Vector2i(-1,-1));
     }
   }
 
   ConcreteCellType& getCell(int x, int y)
   {
-    return mapArray[y * sizeX + x];
+    return mapArray[layout.getIndex(x, y)];
   }
 
   const ConcreteCellType& getCell(int x, int y) const
   {
-    return mapArray[y * sizeX + x];
+    return mapArray[layout.getIndex(x, y)];
   }
 
+  /**
+   * Returns the cell at the given storage index (see getCellIndex()).
+   */
   ConcreteCellType& getCell(int index)
   {
     return mapArray[index];
@@ -158,6 +265,20 @@ public:
     return mapArray[index];
   }
 
+  /**
+   * Returns the update stamp of the cell at index. Stamps are only used while updating the map to make sure every cell
+   * is updated at most once per scan, they are kept apart from the cell values so matching does not have to load them.
+   */
+  int& getUpdateStamp(int index)
+  {
+    return updateStampArray[index];
+  }
+
+  int getUpdateStamp(int index) const
+  {
+    return updateStampArray[index];
+  }
+
   void setMapGridSize(const Eigen::Vector2i& newMapDims)
   {
     if (newMapDims != mapDimensionProperties.getMapDimensions() ){
@@ -171,6 +292,9 @@ public:
    * Copy Constructor, only needed if pointer members are present.
    */
   GridMapBase(const GridMapBase& other)
+    : mapArray(0)
+    , updateStampArray(0)
+    , lastUpdateIndex(other.lastUpdateIndex)
   {
     allocateArray(other.getMapDimensions());
     *this = other;
@@ -193,17 +317,91 @@ public:
 
     this->scaleToMap = other.scaleToMap;
 
-    //@todo potential resize
-    int sizeX = this->getSizeX();
-    int sizeY = this->getSizeY();
+    //sparse layouts may have allocated a different number of tiles
+    int oldSize = this->getStorageSize();
+
+    this->layout = other.layout;
+
+    if (this->getStorageSize() != oldSize) {
+      this->resizeStorage(oldSize);
+    }
+
+    int size = this->getStorageSize();
 
     size_t concreteCellSize = sizeof(ConcreteCellType);
 
-    memcpy(this->mapArray, other.mapArray, sizeX*sizeY*concreteCellSize);
+    memcpy(this->mapArray, other.mapArray, size*concreteCellSize);
+    memcpy(this->updateStampArray, other.updateStampArray, size*sizeof(int));
 
     return *this;
   }
 
+  /**
+   * Copies all cells and the map geometry from other, like the assignment operator but without the members of
+   * derived classes.
+   */
+  void copyCells(const GridMapBase& other)
+  {
+    GridMapBase::operator=(other);
+  }
+
+  /**
+   * Copies the cells in the rectangle [areaMin, areaMax] from other, which has to have the same geometry and layout
+   * state (e.g. because it has been copied from it before and only these cells have changed since).
+   */
+  void copyCells(const GridMapBase& other, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+  {
+    for (int y = areaMin.y(); y <= areaMax.y(); ++y) {
+      for (int x = areaMin.x(); x <= areaMax.x(); ++x) {
+        int index = layout.getIndex(x, y);
+        mapArray[index] = other.mapArray[index];
+      }
+    }
+  }
+
+  /**
+   * Copies the cells of map row y to row (getSizeX() cells, x ascending), unallocated cells as reset cells.
+   */
+  void getRowCells(int y, ConcreteCellType* row) const
+  {
+    int sizeX = this->getSizeX();
+
+    for (int x = 0; x < sizeX; ++x) {
+      if (layout.isAllocated(x, y)) {
+        row[x] = mapArray[layout.getIndex(x, y)];
+      } else {
+        row[x].resetGridCell();
+      }
+    }
+  }
+
+  /**
+   * Sets the cells of map row y from row (getSizeX() cells, x ascending). Sparse layouts only allocate the cells
+   * that differ from a reset cell. Derived per cell data is not updated, see OccGridMapBase::refreshProbabilityPlane().
+   */
+  void setRowCells(int y, const ConcreteCellType* row)
+  {
+    ConcreteCellType resetCell;
+    resetCell.resetGridCell();
+    float resetValue = resetCell.getValue();
+
+    int sizeX = this->getSizeX();
+
+    for (int x = 0; x < sizeX; ++x) {
+      if (ConcreteLayout::allocatesOnUpdate && !layout.isAllocated(x, y)) {
+        if (row[x].getValue() == resetValue) {
+          continue;
+        }
+
+        this->allocateCell(x, y);
+      }
+
+      int index = layout.getIndex(x, y);
+      mapArray[index] = row[x];
+      updateStampArray[index] = -1;
+    }
+  }
+
   /**
    * Returns the world coordinates for the given map coords.
    */
@@ -280,6 +478,43 @@ public:
   }
 
 
+  /**
+   * Moves the map window by (dx,dy) cells, so map cell (x,y) afterwards is the cell that was at (x+dx,y+dy). The world
+   * position of the cells staying in the window does not change. Cells leaving the window are passed to
+   * leavingCellVisitor(x, y, index) with their old coordinates and reset, cells entering it are unknown.
+   * @return True if the cells staying in the window keep their storage indices (layouts with circular indexing),
+   * otherwise they have been moved in storage
+   */
+  template<typename LeavingCellVisitor>
+  bool moveWindow(int dx, int dy, const LeavingCellVisitor& leavingCellVisitor)
+  {
+    int sizeX = this->getSizeX();
+    int sizeY = this->getSizeY();
+
+    for (int y = 0; y < sizeY; ++y) {
+      if ((y < dy) || (y >= sizeY + dy)) {
+        releaseCells(0, sizeX, y, leavingCellVisitor);
+      } else if (dx > 0) {
+        releaseCells(0, std::min(dx, sizeX), y, leavingCellVisitor);
+      } else if (dx < 0) {
+        releaseCells(std::max(0, sizeX + dx), sizeX, y, leavingCellVisitor);
+      }
+    }
+
+    bool circularIndexing = layout.moveWindow(dx, dy);
+
+    if (!circularIndexing) {
+      this->moveCells(dx, dy);
+    }
+
+    const Eigen::Vector2f& topLeftOffset (mapDimensionProperties.getTopLeftOffset());
+    float cellLength = this->getCellLength();
+
+    setMapTransformation(Eigen::Vector2f(topLeftOffset.x() - dx * cellLength, topLeftOffset.y() - dy * cellLength), cellLength);
+
+    return circularIndexing;
+  }
+
   /**
    * Returns the scale factor for one unit in world coords to one unit in map coords.
    * @return The scale factor
@@ -329,62 +564,94 @@ public:
   int getUpdateIndex() const { return lastUpdateIndex; };
 
   /**
-    * Returns the rectangle ([xMin,yMin],[xMax,xMax]) containing non-default cell values
-    */
-  bool getMapExtends(int& xMax, int& yMax, int& xMin, int& yMin) const
+   * Returns the rectangle [areaMin, areaMax] containing all cells whose value differs from that of a reset cell. This
+   * scans the allocated cells, occupancy grid maps track their explored area during updates instead.
+   * @return False if all cells have their reset value
+   */
+  bool getMapExtends(Eigen::Vector2i& areaMin, Eigen::Vector2i& areaMax) const
   {
-    int lowerStart = -1;
-    int upperStart = 10000;
+    ConcreteCellType resetCell;
+    resetCell.resetGridCell();
+    float resetValue = resetCell.getValue();
 
-    int xMaxTemp = lowerStart;
-    int yMaxTemp = lowerStart;
-    int xMinTemp = upperStart;
-    int yMinTemp = upperStart;
+    Eigen::Vector2i allocatedMin, allocatedMax;
 
-    int sizeX = this->getSizeX();
-    int sizeY = this->getSizeY();
+    areaMin = Eigen::Vector2i(INT_MAX, INT_MAX);
+    areaMax = Eigen::Vector2i(INT_MIN, INT_MIN);
 
-    for (int x = 0; x < sizeX; ++x) {
-      for (int y = 0; y < sizeY; ++y) {
-        if (this->mapArray[x][y].getValue() != 0.0f) {
+    if (!this->getAllocatedArea(allocatedMin, allocatedMax)) {
+      return false;
+    }
 
-          if (x > xMaxTemp) {
-            xMaxTemp = x;
-          }
+    for (int y = allocatedMin.y(); y <= allocatedMax.y(); ++y) {
+      for (int x = allocatedMin.x(); x <= allocatedMax.x(); ++x) {
+        if (layout.isAllocated(x, y) && (this->mapArray[layout.getIndex(x, y)].getValue() != resetValue)) {
+          areaMin = areaMin.cwiseMin(Eigen::Vector2i(x, y));
+          areaMax = areaMax.cwiseMax(Eigen::Vector2i(x, y));
+        }
+      }
+    }
 
-          if (x < xMinTemp) {
-            xMinTemp = x;
-          }
+    return (areaMin.x() <= areaMax.x());
+  }
 
-          if (y > yMaxTemp) {
-            yMaxTemp = y;
-          }
+protected:
 
-          if (y < yMinTemp) {
-            yMinTemp = y;
-          }
-        }
+  template<typename LeavingCellVisitor>
+  void releaseCells(int beginX, int endX, int y, const LeavingCellVisitor& leavingCellVisitor)
+  {
+    for (int x = beginX; x < endX; ++x) {
+      if (layout.isAllocated(x, y)) {
+        int index = layout.getIndex(x, y);
+        leavingCellVisitor(x, y, index);
+        mapArray[index].resetGridCell();
+        updateStampArray[index] = -1;
       }
     }
+  }
 
-    if ((xMaxTemp != lowerStart) &&
-        (yMaxTemp != lowerStart) &&
-        (xMinTemp != upperStart) &&
-        (yMinTemp != upperStart)) {
+  /**
+   * Moves the cells in storage for moveWindow(), for layouts without circular indexing. Leaving cells have been reset
+   * already.
+   */
+  void moveCells(int dx, int dy)
+  {
+    int sizeX = this->getSizeX();
+    int sizeY = this->getSizeY();
 
-      xMax = xMaxTemp;
-      yMax = yMaxTemp;
-      xMin = xMinTemp;
-      yMin = yMinTemp;
-      return true;
-    } else {
-      return false;
+    //cell (x,y) is overwritten by (x+dx,y+dy), so the traversal direction makes sure sources are read before that
+    int beginY = (dy >= 0) ? 0 : sizeY - 1;
+    int stepY = (dy >= 0) ? 1 : -1;
+    int beginX = (dx >= 0) ? 0 : sizeX - 1;
+    int stepX = (dx >= 0) ? 1 : -1;
+
+    for (int y = beginY; (y >= 0) && (y < sizeY); y += stepY) {
+      for (int x = beginX; (x >= 0) && (x < sizeX); x += stepX) {
+        int sourceX = x + dx;
+        int sourceY = y + dy;
+
+        bool hasSource = (sourceX >= 0) && (sourceX < sizeX) && (sourceY >= 0) && (sourceY < sizeY) && layout.isAllocated(sourceX, sourceY);
+
+        if (hasSource) {
+          this->allocateCell(x, y);
+
+          int index = layout.getIndex(x, y);
+          int sourceIndex = layout.getIndex(sourceX, sourceY);
+
+          mapArray[index] = mapArray[sourceIndex];
+          updateStampArray[index] = updateStampArray[sourceIndex];
+        } else if (layout.isAllocated(x, y)) {
+          int index = layout.getIndex(x, y);
+
+          mapArray[index].resetGridCell();
+          updateStampArray[index] = -1;
+        }
+      }
     }
   }
 
-protected:
-
   ConcreteCellType *mapArray;    ///< Map representation used with plain pointer array.
+  int *updateStampArray;         ///< Per cell update stamps, same layout as mapArray.
 
   float scaleToMap;              ///< Scaling factor from world to map.
 
@@ -393,7 +660,7 @@ protected:
   Eigen::Affine2f mapTworld;     ///< Homogenous 2D transform from world to map coordinates.
 
   MapDimensionProperties mapDimensionProperties;
-  int sizeX;
+  ConcreteLayout layout;         ///< Maps cell coordinates to storage indices.
 
 private:
   int lastUpdateIndex;
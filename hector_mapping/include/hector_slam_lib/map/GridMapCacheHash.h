@@ -0,0 +1,217 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#ifndef __GridMapCacheHash_h_
+#define __GridMapCacheHash_h_
+
+#include <Eigen/Core>
+
+class CachedMapHashElement
+{
+public:
+  float val;
+  int index;
+  int cacheIndex;
+};
+
+/**
+ * Caches filtered grid map accesses in an open addressing hash table (linear probing). In contrast to
+ * GridMapCacheArray the memory needed only depends on the number of cells touched between two cache resets, not
+ * on the map size, so it is the better choice for very large maps. Entries are invalidated by the cache index like in
+ * GridMapCacheArray, so resetting the cache is O(1). The table grows if it becomes more than half full.
+ */
+class GridMapCacheHash
+{
+public:
+
+  /**
+   * Constructor
+   */
+  GridMapCacheHash()
+    : cacheArray(0)
+    , currCacheIndex(0)
+    , numCachedElements(0)
+  {
+    createCacheArray(initialSizeLog2);
+  }
+
+  /**
+   * Destructor
+   */
+  ~GridMapCacheHash()
+  {
+    deleteCacheArray();
+  }
+
+  /**
+   * Resets/deletes the cached data
+   */
+  void resetCache()
+  {
+    currCacheIndex++;
+    numCachedElements = 0;
+  }
+
+  /**
+   * Checks wether cached data for index is available. If this is the case, writes data into val.
+   * @param index The cell index
+   * @param val Reference to a float the data is written to if available
+   * @return Indicates if cached data is available
+   */
+  bool containsCachedData(int index, float& val) const
+  {
+    unsigned int slot = getSlot(index);
+
+    while (cacheArray[slot].cacheIndex == currCacheIndex) {
+
+      if (cacheArray[slot].index == index) {
+        val = cacheArray[slot].val;
+        return true;
+      }
+
+      slot = (slot + 1) & slotMask;
+    }
+
+    return false;
+  }
+
+  /**
+   * Caches float value val for cell index.
+   * @param index The cell index
+   * @param val The value to be cached for index.
+   */
+  void cacheData(int index, float val)
+  {
+    if ((numCachedElements + 1) * 2 > (slotMask + 1)) {
+      grow();
+    }
+
+    insert(index, val);
+  }
+
+  /**
+   * The hash table does not depend on the map size, only provided for compatibility with GridMapCacheArray.
+   */
+  void setMapSize(const Eigen::Vector2i&)
+  {}
+
+protected:
+
+  enum { initialSizeLog2 = 14 };
+
+  unsigned int getSlot(int index) const
+  {
+    //multiplicative hashing, neighbouring cells are spread over the table
+    return (static_cast<unsigned int>(index) * 2654435761u) >> hashShift;
+  }
+
+  void insert(int index, float val)
+  {
+    unsigned int slot = getSlot(index);
+
+    while (cacheArray[slot].cacheIndex == currCacheIndex) {
+
+      if (cacheArray[slot].index == index) {
+        cacheArray[slot].val = val;
+        return;
+      }
+
+      slot = (slot + 1) & slotMask;
+    }
+
+    CachedMapHashElement& elem (cacheArray[slot]);
+    elem.index = index;
+    elem.val = val;
+    elem.cacheIndex = currCacheIndex;
+    ++numCachedElements;
+  }
+
+  /**
+   * Doubles the table size and reinserts the elements cached since the last reset.
+   */
+  void grow()
+  {
+    CachedMapHashElement* oldArray = cacheArray;
+    unsigned int oldSize = slotMask + 1;
+
+    createCacheArray(sizeLog2 + 1);
+
+    numCachedElements = 0;
+
+    for (unsigned int i = 0; i < oldSize; ++i) {
+      if (oldArray[i].cacheIndex == currCacheIndex) {
+        insert(oldArray[i].index, oldArray[i].val);
+      }
+    }
+
+    delete[] oldArray;
+  }
+
+  /**
+   * Creates a cache array with 2^newSizeLog2 elements.
+   */
+  void createCacheArray(int newSizeLog2)
+  {
+    sizeLog2 = newSizeLog2;
+    slotMask = (1u << sizeLog2) - 1;
+    hashShift = 32 - sizeLog2;
+
+    cacheArray = new CachedMapHashElement [slotMask + 1];
+
+    for (unsigned int i = 0; i <= slotMask; ++i) {
+      cacheArray[i].cacheIndex = currCacheIndex - 1;
+    }
+  }
+
+  /**
+   * Deletes the existing cache array.
+   */
+  void deleteCacheArray()
+  {
+    delete[] cacheArray;
+  }
+
+private:
+
+  //not copyable, the table is a plain pointer array
+  GridMapCacheHash(const GridMapCacheHash&);
+  GridMapCacheHash& operator=(const GridMapCacheHash&);
+
+protected:
+
+  CachedMapHashElement* cacheArray; ///< Hash table used for caching data.
+  int currCacheIndex;               ///< The cache iteration index value, elements with other values are empty
+  unsigned int numCachedElements;   ///< Number of elements cached since the last reset
+
+  int sizeLog2;                     ///< The table has 2^sizeLog2 elements
+  unsigned int slotMask;
+  unsigned int hashShift;
+};
+
+
+#endif
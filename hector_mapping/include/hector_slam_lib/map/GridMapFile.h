@@ -0,0 +1,318 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef __GridMapFile_h_
+#define __GridMapFile_h_
+
+#include <Eigen/Core>
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace hectorslam {
+
+/**
+ * Saves and loads all levels of a map to/from a binary file holding the raw cells, so a map is restored exactly
+ * (log-odds values included) within milliseconds. The file is written in native byte order:
+ *
+ *   FileHeader, one LevelHeader per level, then the cells of each level starting at a page aligned offset, row after
+ *   row with x ascending (sizeX * sizeY cells of sizeof(ConcreteGridMap::CellType) bytes).
+ *
+ * Loading maps the file into memory and copies the rows straight into the cell storage of the maps. The maps have to
+ * have the same number of levels, sizes and resolutions as the saved ones, their position is taken from the file.
+ */
+template<typename ConcreteGridMap>
+class GridMapFile
+{
+public:
+
+  enum { formatVersion = 1 };
+
+  typedef typename ConcreteGridMap::CellType CellType;
+
+  /**
+   * Writes the maps to fileName. A temporary file is written first and renamed, so an existing file is replaced
+   * only by a complete one.
+   */
+  bool save(const std::string& fileName, const std::vector<const ConcreteGridMap*>& levels)
+  {
+    std::string tmpFileName (fileName + ".tmp");
+
+    FILE* file = std::fopen(tmpFileName.c_str(), "wb");
+
+    if (!file) {
+      return setError("cannot open " + tmpFileName + " for writing");
+    }
+
+    int numLevels = static_cast<int>(levels.size());
+
+    FileHeader fileHeader;
+    initFileHeader(fileHeader, numLevels);
+
+    std::vector<LevelHeader> levelHeaders (numLevels);
+
+    uint64_t dataOffset = getPageAligned(sizeof(FileHeader) + numLevels * sizeof(LevelHeader));
+
+    for (int i = 0; i < numLevels; ++i) {
+      const ConcreteGridMap& map (*levels[i]);
+      LevelHeader& levelHeader (levelHeaders[i]);
+
+      std::memset(&levelHeader, 0, sizeof(LevelHeader));
+
+      levelHeader.sizeX = map.getSizeX();
+      levelHeader.sizeY = map.getSizeY();
+      levelHeader.cellLength = map.getCellLength();
+      levelHeader.topLeftOffsetX = map.getMapDimProperties().getTopLeftOffset().x();
+      levelHeader.topLeftOffsetY = map.getMapDimProperties().getTopLeftOffset().y();
+
+      Eigen::Vector2i exploredMin, exploredMax;
+      map.getExploredArea(exploredMin, exploredMax);
+
+      levelHeader.exploredMinX = exploredMin.x();
+      levelHeader.exploredMinY = exploredMin.y();
+      levelHeader.exploredMaxX = exploredMax.x();
+      levelHeader.exploredMaxY = exploredMax.y();
+
+      levelHeader.dataOffset = dataOffset;
+      dataOffset = getPageAligned(dataOffset + getLevelDataSize(levelHeader));
+    }
+
+    bool written = (std::fwrite(&fileHeader, sizeof(FileHeader), 1, file) == 1) &&
+                   (numLevels == 0 || std::fwrite(&levelHeaders[0], sizeof(LevelHeader), numLevels, file) == static_cast<size_t>(numLevels));
+
+    std::vector<CellType> row;
+
+    for (int i = 0; written && (i < numLevels); ++i) {
+      const ConcreteGridMap& map (*levels[i]);
+
+      written = (std::fseek(file, static_cast<long>(levelHeaders[i].dataOffset), SEEK_SET) == 0);
+
+      row.resize(map.getSizeX());
+
+      for (int y = 0; written && (y < map.getSizeY()); ++y) {
+        map.getRowCells(y, &row[0]);
+        written = (std::fwrite(&row[0], sizeof(CellType), row.size(), file) == row.size());
+      }
+    }
+
+    if ((std::fclose(file) != 0) || !written) {
+      std::remove(tmpFileName.c_str());
+      return setError("cannot write " + tmpFileName);
+    }
+
+    if (std::rename(tmpFileName.c_str(), fileName.c_str()) != 0) {
+      std::remove(tmpFileName.c_str());
+      return setError("cannot rename " + tmpFileName + " to " + fileName);
+    }
+
+    return true;
+  }
+
+  /**
+   * Loads the maps from fileName. All maps are reset, their cells, positions and explored areas are set from the file.
+   * The maps are not changed if the file does not match them.
+   */
+  bool load(const std::string& fileName, const std::vector<ConcreteGridMap*>& levels)
+  {
+    int fd = open(fileName.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      return setError("cannot open " + fileName);
+    }
+
+    struct stat fileStat;
+
+    if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size < static_cast<off_t>(sizeof(FileHeader)))) {
+      close(fd);
+      return setError(fileName + " is not a map file");
+    }
+
+    size_t fileSize = static_cast<size_t>(fileStat.st_size);
+
+    void* mapping = mmap(0, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+      return setError("cannot map " + fileName + " into memory");
+    }
+
+    const char* data = static_cast<const char*>(mapping);
+
+    bool loaded = checkFile(fileName, data, fileSize, levels);
+
+    if (loaded) {
+      madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+      const LevelHeader* levelHeaders = reinterpret_cast<const LevelHeader*>(data + sizeof(FileHeader));
+
+      for (size_t i = 0; i < levels.size(); ++i) {
+        loadLevel(*levels[i], levelHeaders[i], data);
+      }
+    }
+
+    munmap(mapping, fileSize);
+    return loaded;
+  }
+
+  const std::string& getErrorMessage() const { return errorMessage; };
+
+protected:
+
+  struct FileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t cellSize;
+    uint32_t numLevels;
+  };
+
+  struct LevelHeader
+  {
+    int32_t sizeX;
+    int32_t sizeY;
+    float cellLength;
+    float topLeftOffsetX;
+    float topLeftOffsetY;
+    int32_t exploredMinX;
+    int32_t exploredMinY;
+    int32_t exploredMaxX;
+    int32_t exploredMaxY;
+    uint32_t reserved;
+    uint64_t dataOffset;
+  };
+
+  enum { pageSize = 4096 };
+  static const uint32_t byteOrderMark = 0x01020304u;
+
+  static void initFileHeader(FileHeader& fileHeader, int numLevels)
+  {
+    std::memset(&fileHeader, 0, sizeof(FileHeader));
+    std::memcpy(fileHeader.magic, "HSLAMMAP", sizeof(fileHeader.magic));
+    fileHeader.version = formatVersion;
+    fileHeader.byteOrderMark = byteOrderMark;
+    fileHeader.cellSize = sizeof(CellType);
+    fileHeader.numLevels = numLevels;
+  }
+
+  static uint64_t getPageAligned(uint64_t offset)
+  {
+    return (offset + pageSize - 1) & ~static_cast<uint64_t>(pageSize - 1);
+  }
+
+  static uint64_t getLevelDataSize(const LevelHeader& levelHeader)
+  {
+    return static_cast<uint64_t>(levelHeader.sizeX) * static_cast<uint64_t>(levelHeader.sizeY) * sizeof(CellType);
+  }
+
+  bool checkFile(const std::string& fileName, const char* data, size_t fileSize, const std::vector<ConcreteGridMap*>& levels)
+  {
+    FileHeader expectedHeader;
+    initFileHeader(expectedHeader, static_cast<int>(levels.size()));
+
+    const FileHeader& fileHeader (*reinterpret_cast<const FileHeader*>(data));
+
+    if (std::memcmp(fileHeader.magic, expectedHeader.magic, sizeof(fileHeader.magic)) != 0) {
+      return setError(fileName + " is not a map file");
+    }
+
+    if ((fileHeader.version != expectedHeader.version) || (fileHeader.byteOrderMark != expectedHeader.byteOrderMark) ||
+        (fileHeader.cellSize != expectedHeader.cellSize)) {
+      return setError(fileName + " has an incompatible format version, byte order or cell type");
+    }
+
+    if ((fileHeader.numLevels != expectedHeader.numLevels) ||
+        (fileSize < sizeof(FileHeader) + fileHeader.numLevels * sizeof(LevelHeader))) {
+      return setError(fileName + " has a different number of map levels");
+    }
+
+    const LevelHeader* levelHeaders = reinterpret_cast<const LevelHeader*>(data + sizeof(FileHeader));
+
+    for (size_t i = 0; i < levels.size(); ++i) {
+      const ConcreteGridMap& map (*levels[i]);
+      const LevelHeader& levelHeader (levelHeaders[i]);
+
+      if ((levelHeader.sizeX != map.getSizeX()) || (levelHeader.sizeY != map.getSizeY()) ||
+          (std::fabs(levelHeader.cellLength - map.getCellLength()) > map.getCellLength() * 1e-4f)) {
+        return setError(fileName + " has a different map size or resolution");
+      }
+
+      if ((levelHeader.dataOffset > fileSize) || (getLevelDataSize(levelHeader) > fileSize - levelHeader.dataOffset)) {
+        return setError(fileName + " is truncated");
+      }
+    }
+
+    return true;
+  }
+
+  static void loadLevel(ConcreteGridMap& map, const LevelHeader& levelHeader, const char* data)
+  {
+    //the probability plane is computed once for the loaded cells instead of for the reset ones as well
+    bool probabilityPlaneEnabled = map.getProbabilityPlaneEnabled();
+    map.setProbabilityPlaneEnabled(false);
+
+    map.reset();
+    map.setMapTransformation(Eigen::Vector2f(levelHeader.topLeftOffsetX, levelHeader.topLeftOffsetY), levelHeader.cellLength);
+
+    //offsets are page aligned and rows a whole number of cells, so the cells can be read in place
+    const CellType* cells = reinterpret_cast<const CellType*>(data + levelHeader.dataOffset);
+
+    for (int y = 0; y < levelHeader.sizeY; ++y) {
+      map.setRowCells(y, cells + static_cast<size_t>(y) * levelHeader.sizeX);
+    }
+
+    map.setProbabilityPlaneEnabled(probabilityPlaneEnabled);
+    map.extendExploredArea(Eigen::Vector2i(levelHeader.exploredMinX, levelHeader.exploredMinY),
+                           Eigen::Vector2i(levelHeader.exploredMaxX, levelHeader.exploredMaxY));
+
+    //cells were changed directly, this makes matchers drop cached values derived from the map
+    map.setUpdated();
+  }
+
+  bool setError(const std::string& message)
+  {
+    errorMessage = message;
+    return false;
+  }
+
+  std::string errorMessage;
+};
+
+}
+
+#endif
@@ -0,0 +1,474 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#ifndef __GridMapLayout_h_
+#define __GridMapLayout_h_
+
+#include <Eigen/Core>
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+namespace hectorslam {
+
+/**
+ * Storage allocation interface of layouts that allocate storage for all cells up front. Layouts with
+ * allocatesOnUpdate set (GridMapLayoutSparse) only allocate storage for cells when map updates reach them.
+ */
+class GridMapLayoutDenseAllocation
+{
+public:
+
+  enum { allocatesOnUpdate = 0 };
+
+  bool isAllocated(int, int) const { return true; }
+
+  /**
+   * Makes sure storage for the cell at (x,y) exists.
+   * @return True if the storage size has changed
+   */
+  bool allocate(int, int) { return false; }
+
+  /**
+   * Releases all allocated storage regions, so they can be reused after clearing the storage.
+   */
+  void releaseAll() {};
+
+  /**
+   * Returns the rectangle of map cells storage has been allocated for.
+   * @return False if storage is allocated for all cells
+   */
+  bool getAllocatedArea(Eigen::Vector2i&, Eigen::Vector2i&) const { return false; }
+
+  /**
+   * Moves the map window by (dx,dy) cells over the storage, for layouts with circular indexing.
+   * @return False if the layout does not support this, the cells have to be moved in storage then
+   */
+  bool moveWindow(int, int) { return false; }
+};
+
+/**
+ * Default cell layout, cells are stored row by row (index = y * sizeX + x).
+ *
+ * A layout maps integer map coordinates to indices into the cell storage of GridMapBase. All code accessing cells
+ * by index (map updates, scan matching, caches) uses these storage indices, so they only equal the row major
+ * index y * sizeX + x for this layout.
+ */
+class GridMapLayoutRowMajor : public GridMapLayoutDenseAllocation
+{
+public:
+
+  GridMapLayoutRowMajor()
+    : sizeX(0)
+    , storageDimensions(0,0)
+  {}
+
+  void setMapDimensions(const Eigen::Vector2i& mapDimensions)
+  {
+    sizeX = mapDimensions.x();
+    storageDimensions = mapDimensions;
+  }
+
+  int getIndex(int x, int y) const
+  {
+    return y * sizeX + x;
+  }
+
+  /**
+   * Writes the indices of (x,y), (x+1,y), (x,y+1) and (x+1,y+1) to indices, as needed for bilinear interpolation.
+   */
+  void getInterpolationIndices(int x, int y, int* indices) const
+  {
+    indices[0] = y * sizeX + x;
+    indices[1] = indices[0] + 1;
+    indices[2] = indices[0] + sizeX;
+    indices[3] = indices[2] + 1;
+  }
+
+  /**
+   * Returns the dimensions of the allocated storage, the number of allocated cells is their product.
+   */
+  const Eigen::Vector2i& getStorageDimensions() const { return storageDimensions; };
+  int getStorageSize() const { return storageDimensions.x() * storageDimensions.y(); };
+
+protected:
+
+  int sizeX;
+  Eigen::Vector2i storageDimensions;
+};
+
+/**
+ * Row by row layout with the row length padded to a power of two, so indices are computed with a shift instead of a
+ * multiplication (index = (y << log2(rowLength)) + x). Wastes up to half of the storage for unfavorable map sizes.
+ */
+class GridMapLayoutRowMajorPow2 : public GridMapLayoutDenseAllocation
+{
+public:
+
+  GridMapLayoutRowMajorPow2()
+    : shiftX(0)
+    , storageDimensions(0,0)
+  {}
+
+  void setMapDimensions(const Eigen::Vector2i& mapDimensions)
+  {
+    shiftX = 0;
+
+    while ((1 << shiftX) < mapDimensions.x()) {
+      ++shiftX;
+    }
+
+    storageDimensions = Eigen::Vector2i(1 << shiftX, mapDimensions.y());
+  }
+
+  int getIndex(int x, int y) const
+  {
+    return (y << shiftX) + x;
+  }
+
+  /**
+   * Writes the indices of (x,y), (x+1,y), (x,y+1) and (x+1,y+1) to indices, as needed for bilinear interpolation.
+   */
+  void getInterpolationIndices(int x, int y, int* indices) const
+  {
+    indices[0] = (y << shiftX) + x;
+    indices[1] = indices[0] + 1;
+    indices[2] = indices[0] + (1 << shiftX);
+    indices[3] = indices[2] + 1;
+  }
+
+  /**
+   * Returns the dimensions of the allocated storage, the number of allocated cells is their product.
+   */
+  const Eigen::Vector2i& getStorageDimensions() const { return storageDimensions; };
+  int getStorageSize() const { return storageDimensions.x() * storageDimensions.y(); };
+
+protected:
+
+  int shiftX;
+  Eigen::Vector2i storageDimensions;
+};
+
+/**
+ * Row by row layout with circular (toroidal) indexing for rolling window maps. Map coordinates are relative to the
+ * window, which is moved over the storage by changing the index offset, so cells staying in the window keep their
+ * storage index and only cells leaving it have to be touched. Storage dimensions are padded to powers of two, so
+ * wrapping around is a mask operation.
+ */
+class GridMapLayoutToroidal : public GridMapLayoutDenseAllocation
+{
+public:
+
+  GridMapLayoutToroidal()
+    : shiftX(0)
+    , maskX(0)
+    , maskY(0)
+    , offsetX(0)
+    , offsetY(0)
+    , storageDimensions(0,0)
+  {}
+
+  void setMapDimensions(const Eigen::Vector2i& mapDimensions)
+  {
+    shiftX = 0;
+
+    while ((1 << shiftX) < mapDimensions.x()) {
+      ++shiftX;
+    }
+
+    int shiftY = 0;
+
+    while ((1 << shiftY) < mapDimensions.y()) {
+      ++shiftY;
+    }
+
+    maskX = (1 << shiftX) - 1;
+    maskY = (1 << shiftY) - 1;
+
+    offsetX = 0;
+    offsetY = 0;
+
+    storageDimensions = Eigen::Vector2i(1 << shiftX, 1 << shiftY);
+  }
+
+  int getIndex(int x, int y) const
+  {
+    return (((y + offsetY) & maskY) << shiftX) | ((x + offsetX) & maskX);
+  }
+
+  /**
+   * Writes the indices of (x,y), (x+1,y), (x,y+1) and (x+1,y+1) to indices, as needed for bilinear interpolation.
+   */
+  void getInterpolationIndices(int x, int y, int* indices) const
+  {
+    int storageX = (x + offsetX) & maskX;
+    int storageY = (y + offsetY) & maskY;
+
+    indices[0] = (storageY << shiftX) | storageX;
+
+    //fast path if the 2x2 block does not wrap around
+    if ((storageX != maskX) && (storageY != maskY)) {
+      indices[1] = indices[0] + 1;
+      indices[2] = indices[0] + (1 << shiftX);
+      indices[3] = indices[2] + 1;
+    } else {
+      indices[1] = getIndex(x + 1, y);
+      indices[2] = getIndex(x, y + 1);
+      indices[3] = getIndex(x + 1, y + 1);
+    }
+  }
+
+  bool moveWindow(int dx, int dy)
+  {
+    offsetX = (offsetX + dx) & maskX;
+    offsetY = (offsetY + dy) & maskY;
+    return true;
+  }
+
+  /**
+   * Returns the dimensions of the allocated storage, the number of allocated cells is their product.
+   */
+  const Eigen::Vector2i& getStorageDimensions() const { return storageDimensions; };
+  int getStorageSize() const { return storageDimensions.x() * storageDimensions.y(); };
+
+protected:
+
+  int shiftX;
+  int maskX;
+  int maskY;
+  int offsetX;                   ///< Storage column of window column 0
+  int offsetY;                   ///< Storage row of window row 0
+  Eigen::Vector2i storageDimensions;
+};
+
+/**
+ * Cache blocked cell layout. Cells are stored in square tiles of 2^TileSizeLog2 cells edge length, which are
+ * stored row by row. The 2x2 neighbourhood read for bilinear interpolation and consecutive cells of diagonal rays
+ * mostly share a cache line this way. The map dimensions are padded to multiples of the tile size.
+ */
+template<int TileSizeLog2>
+class GridMapLayoutTiled : public GridMapLayoutDenseAllocation
+{
+public:
+
+  enum { tileSize = 1 << TileSizeLog2 };
+  enum { tileMask = tileSize - 1 };
+
+  GridMapLayoutTiled()
+    : tilesX(0)
+    , storageDimensions(0,0)
+  {}
+
+  void setMapDimensions(const Eigen::Vector2i& mapDimensions)
+  {
+    tilesX = (mapDimensions.x() + tileMask) >> TileSizeLog2;
+    int tilesY = (mapDimensions.y() + tileMask) >> TileSizeLog2;
+
+    storageDimensions = Eigen::Vector2i(tilesX << TileSizeLog2, tilesY << TileSizeLog2);
+  }
+
+  int getIndex(int x, int y) const
+  {
+    int tileIndex = (y >> TileSizeLog2) * tilesX + (x >> TileSizeLog2);
+    return (tileIndex << (2 * TileSizeLog2)) | ((y & tileMask) << TileSizeLog2) | (x & tileMask);
+  }
+
+  /**
+   * Writes the indices of (x,y), (x+1,y), (x,y+1) and (x+1,y+1) to indices, as needed for bilinear interpolation.
+   */
+  void getInterpolationIndices(int x, int y, int* indices) const
+  {
+    indices[0] = getIndex(x, y);
+
+    //fast path if the 2x2 block does not cross a tile border
+    if (((x & tileMask) != tileMask) && ((y & tileMask) != tileMask)) {
+      indices[1] = indices[0] + 1;
+      indices[2] = indices[0] + tileSize;
+      indices[3] = indices[2] + 1;
+    } else {
+      indices[1] = getIndex(x + 1, y);
+      indices[2] = getIndex(x, y + 1);
+      indices[3] = getIndex(x + 1, y + 1);
+    }
+  }
+
+  /**
+   * Returns the dimensions of the allocated storage, the number of allocated cells is their product.
+   */
+  const Eigen::Vector2i& getStorageDimensions() const { return storageDimensions; };
+  int getStorageSize() const { return storageDimensions.x() * storageDimensions.y(); };
+
+protected:
+
+  int tilesX;
+  Eigen::Vector2i storageDimensions;
+};
+
+/**
+ * Sparse tiled cell layout for maps of large or unknown extent. Like GridMapLayoutTiled, cells are stored in square
+ * tiles of 2^TileSizeLog2 cells edge length, but storage is only allocated for tiles reached by map updates, so memory
+ * scales with the explored area instead of the map size. Only a directory with one entry per tile is kept for the
+ * whole map. Tiles are taken from a pool that doubles in size when exhausted, so storage indices of allocated cells
+ * stay valid while it grows. All unallocated tiles share the storage of tile slot 0, which is never updated and holds
+ * default (unknown) cells.
+ */
+template<int TileSizeLog2>
+class GridMapLayoutSparse
+{
+public:
+
+  enum { tileSize = 1 << TileSizeLog2 };
+  enum { tileMask = tileSize - 1 };
+  enum { allocatesOnUpdate = 1 };
+  enum { initialTileCapacity = 64 };
+
+  GridMapLayoutSparse()
+    : tilesX(0)
+    , numSlots(1)
+    , storageDimensions(0,0)
+  {}
+
+  void setMapDimensions(const Eigen::Vector2i& mapDimensions)
+  {
+    tilesX = (mapDimensions.x() + tileMask) >> TileSizeLog2;
+    int tilesY = (mapDimensions.y() + tileMask) >> TileSizeLog2;
+
+    tileSlots.assign(tilesX * tilesY, 0);
+    releaseAll();
+
+    storageDimensions = Eigen::Vector2i(tileSize * tileSize, initialTileCapacity);
+  }
+
+  int getIndex(int x, int y) const
+  {
+    int slot = tileSlots[(y >> TileSizeLog2) * tilesX + (x >> TileSizeLog2)];
+    return (slot << (2 * TileSizeLog2)) | ((y & tileMask) << TileSizeLog2) | (x & tileMask);
+  }
+
+  /**
+   * Writes the indices of (x,y), (x+1,y), (x,y+1) and (x+1,y+1) to indices, as needed for bilinear interpolation.
+   */
+  void getInterpolationIndices(int x, int y, int* indices) const
+  {
+    indices[0] = getIndex(x, y);
+
+    //fast path if the 2x2 block does not cross a tile border
+    if (((x & tileMask) != tileMask) && ((y & tileMask) != tileMask)) {
+      indices[1] = indices[0] + 1;
+      indices[2] = indices[0] + tileSize;
+      indices[3] = indices[2] + 1;
+    } else {
+      indices[1] = getIndex(x + 1, y);
+      indices[2] = getIndex(x, y + 1);
+      indices[3] = getIndex(x + 1, y + 1);
+    }
+  }
+
+  bool isAllocated(int x, int y) const
+  {
+    return tileSlots[(y >> TileSizeLog2) * tilesX + (x >> TileSizeLog2)] != 0;
+  }
+
+  /**
+   * Allocates the tile containing (x,y) if it has no storage yet.
+   * @return True if the pool had to grow, storage dimensions have changed then
+   */
+  bool allocate(int x, int y)
+  {
+    int tileX = x >> TileSizeLog2;
+    int tileY = y >> TileSizeLog2;
+
+    int& slot (tileSlots[tileY * tilesX + tileX]);
+
+    if (slot != 0) {
+      return false;
+    }
+
+    slot = numSlots++;
+
+    allocatedTilesMin = allocatedTilesMin.cwiseMin(Eigen::Vector2i(tileX, tileY));
+    allocatedTilesMax = allocatedTilesMax.cwiseMax(Eigen::Vector2i(tileX, tileY));
+
+    if (numSlots > storageDimensions.y()) {
+      storageDimensions.y() *= 2;
+      return true;
+    }
+
+    return false;
+  }
+
+  /**
+   * Releases all tiles. The pool keeps its size, released slots are reused in the order they were allocated.
+   */
+  void releaseAll()
+  {
+    std::fill(tileSlots.begin(), tileSlots.end(), 0);
+    numSlots = 1;
+
+    allocatedTilesMin = Eigen::Vector2i::Constant(std::numeric_limits<int>::max() >> TileSizeLog2);
+    allocatedTilesMax = Eigen::Vector2i(-1, -1);
+  }
+
+  /**
+   * Returns the rectangle of map cells covered by the bounding box of allocated tiles (may exceed the map dimensions
+   * by less than a tile). The box is empty (areaMin > areaMax) if no tile is allocated.
+   */
+  bool getAllocatedArea(Eigen::Vector2i& areaMin, Eigen::Vector2i& areaMax) const
+  {
+    areaMin = Eigen::Vector2i(allocatedTilesMin.x() << TileSizeLog2, allocatedTilesMin.y() << TileSizeLog2);
+    areaMax = Eigen::Vector2i((allocatedTilesMax.x() << TileSizeLog2) | tileMask, (allocatedTilesMax.y() << TileSizeLog2) | tileMask);
+    return true;
+  }
+
+  int getNumAllocatedTiles() const { return numSlots - 1; };
+
+  bool moveWindow(int, int) { return false; }
+
+  /**
+   * Returns the dimensions of the allocated storage (cells per tile, tile slots), the number of allocated cells is
+   * their product.
+   */
+  const Eigen::Vector2i& getStorageDimensions() const { return storageDimensions; };
+  int getStorageSize() const { return storageDimensions.x() * storageDimensions.y(); };
+
+protected:
+
+  int tilesX;
+  std::vector<int> tileSlots;    ///< Pool slot per tile in row major tile order, 0 if not allocated
+  int numSlots;                  ///< Number of used pool slots including the default slot 0
+
+  Eigen::Vector2i allocatedTilesMin;
+  Eigen::Vector2i allocatedTilesMax;
+
+  Eigen::Vector2i storageDimensions;
+};
+
+}
+
+#endif
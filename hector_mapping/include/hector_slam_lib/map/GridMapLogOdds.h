@@ -89,7 +89,6 @@ public:
   void resetGridCell()
   {
     logOddsVal = 0.0f;
-    updateIndex = -1;
   }
 
   //protected:
@@ -97,7 +96,6 @@ public:
 public:
 
   float logOddsVal; ///< The log odds representation of occupancy probability.
-  int updateIndex;
 
 
 };
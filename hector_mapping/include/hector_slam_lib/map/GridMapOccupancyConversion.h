@@ -0,0 +1,82 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef __GridMapOccupancyConversion_h_
+#define __GridMapOccupancyConversion_h_
+
+#include <stdint.h>
+
+#include <Eigen/Core>
+
+namespace hectorslam {
+
+/**
+ * Converts the cells of an occupancy grid map to the values of a row major occupancy grid message (0 free, 100
+ * occupied, -1 unknown), e.g. nav_msgs/OccupancyGrid. The message may cover only part of the map and can be updated
+ * incrementally by converting just the cells that changed.
+ */
+template<typename ConcreteGridMap>
+class GridMapOccupancyConversion
+{
+public:
+
+  enum { cellFree = 0, cellOccupied = 100, cellUnknown = -1 };
+
+  /**
+   * Converts the cells in [areaMin, areaMax] into data, the row major values of the map cells starting at dataAreaMin
+   * with width cells per row. The area has to lie within the area data covers.
+   */
+  static void convertArea(const ConcreteGridMap& gridMap, int8_t* data, int width, const Eigen::Vector2i& dataAreaMin, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+  {
+    //the message is row major, the grid map layout may not be, so cells are looked up by coordinates
+    for (int y = areaMin.y(); y <= areaMax.y(); ++y) {
+
+      int8_t* row = data + (y - dataAreaMin.y()) * width;
+
+      for (int x = areaMin.x(); x <= areaMax.x(); ++x) {
+        row[x - dataAreaMin.x()] = getOccupancy(gridMap, gridMap.getCellIndex(x, y));
+      }
+    }
+  }
+
+  static int8_t getOccupancy(const ConcreteGridMap& gridMap, int index)
+  {
+    if (gridMap.isFree(index)) {
+      return cellFree;
+    } else if (gridMap.isOccupied(index)) {
+      return cellOccupied;
+    }
+
+    return cellUnknown;
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,271 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef __GridMapPyramidBuilder_h_
+#define __GridMapPyramidBuilder_h_
+
+#include <Eigen/Core>
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#include "../util/WorkerPool.h"
+
+namespace hectorslam {
+
+/**
+ * How a coarse cell is derived from the finest cells it covers.
+ */
+enum GridMapPyramidPooling
+{
+  PyramidPoolingMax,  ///< The highest value, obstacles of the finest level stay visible on all levels
+  PyramidPoolingMean  ///< The mean value, unknown cells count with their reset value
+};
+
+/**
+ * Derives the coarse levels of a map pyramid from its finest level (level 0), by pooling the values of the finest
+ * cells each coarse cell covers. This is what the coarse to fine matcher needs after cells of the finest level have
+ * been set without painting scans into all levels (e.g. a loaded map), and it can keep the coarse levels in sync
+ * with the changed areas of the finest level instead of painting scans into them.
+ * The work is split into tiles of coarse cells over all levels, which are pooled in parallel on the worker pool
+ * (serially for layouts allocating on update, as the storage may grow).
+ * The cell lengths of the coarse levels have to be integer multiples of the finest cell length and the levels
+ * aligned to the finest cells, as the levels of MapRepMultiMapT are (also after moving rolling windows).
+ */
+template<typename ConcreteGridMap>
+class GridMapPyramidBuilder
+{
+public:
+
+  typedef typename ConcreteGridMap::CellType CellType;
+
+  GridMapPyramidBuilder(WorkerPool* workerPoolIn = 0)
+    : workerPool(workerPoolIn)
+    , pooling(PyramidPoolingMax)
+    , levels(0)
+  {}
+
+  void setWorkerPool(WorkerPool* workerPoolIn) { workerPool = workerPoolIn; };
+
+  void setPooling(GridMapPyramidPooling poolingIn) { pooling = poolingIn; };
+  GridMapPyramidPooling getPooling() const { return pooling; };
+
+  /**
+   * Resets the coarse levels (levels[1..]) and derives them from the explored area of levels[0].
+   */
+  void build(const std::vector<ConcreteGridMap*>& levelsIn)
+  {
+    for (size_t i = 1; i < levelsIn.size(); ++i) {
+      levelsIn[i]->reset();
+    }
+
+    Eigen::Vector2i areaMin, areaMax;
+
+    if (!levelsIn.empty() && levelsIn[0]->getExploredArea(areaMin, areaMax)) {
+      this->sync(levelsIn, areaMin, areaMax);
+    }
+  }
+
+  /**
+   * Derives the cells of the coarse levels (levels[1..]) covering the rectangle [areaMin, areaMax] of levels[0] cells
+   * anew and reports them as updated areas of the coarse levels.
+   */
+  void sync(const std::vector<ConcreteGridMap*>& levelsIn, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+  {
+    if ((areaMin.x() > areaMax.x()) || (areaMin.y() > areaMax.y())) {
+      return;
+    }
+
+    levels = &levelsIn;
+    tiles.clear();
+
+    int numLevels = static_cast<int>(levelsIn.size());
+
+    std::vector<Eigen::Vector2i> coarseAreaMin (numLevels);
+    std::vector<Eigen::Vector2i> coarseAreaMax (numLevels);
+
+    for (int level = 1; level < numLevels; ++level) {
+      LevelGeometry geometry (this->getLevelGeometry(level));
+
+      Eigen::Vector2i coarseMax ((*levels)[level]->getSizeX() - 1, (*levels)[level]->getSizeY() - 1);
+
+      coarseAreaMin[level] = Eigen::Vector2i(floorDiv(areaMin.x() - geometry.fineOrigin.x(), geometry.ratio),
+                                             floorDiv(areaMin.y() - geometry.fineOrigin.y(), geometry.ratio)).cwiseMax(Eigen::Vector2i::Zero());
+      coarseAreaMax[level] = Eigen::Vector2i(floorDiv(areaMax.x() - geometry.fineOrigin.x(), geometry.ratio),
+                                             floorDiv(areaMax.y() - geometry.fineOrigin.y(), geometry.ratio)).cwiseMin(coarseMax);
+
+      for (int y = coarseAreaMin[level].y(); y <= coarseAreaMax[level].y(); y += tileSize) {
+        for (int x = coarseAreaMin[level].x(); x <= coarseAreaMax[level].x(); x += tileSize) {
+          Tile tile;
+          tile.level = level;
+          tile.geometry = geometry;
+          tile.areaMin = Eigen::Vector2i(x, y);
+          tile.areaMax = Eigen::Vector2i(x + tileSize - 1, y + tileSize - 1).cwiseMin(coarseAreaMax[level]);
+          tiles.push_back(tile);
+        }
+      }
+    }
+
+    int numTiles = static_cast<int>(tiles.size());
+
+    if (workerPool && !ConcreteGridMap::LayoutType::allocatesOnUpdate) {
+      workerPool->parallelFor(numTiles, PoolTilesTask(this));
+    } else {
+      this->poolTiles(0, numTiles);
+    }
+
+    for (int level = 1; level < numLevels; ++level) {
+      if ((coarseAreaMin[level].x() <= coarseAreaMax[level].x()) && (coarseAreaMin[level].y() <= coarseAreaMax[level].y())) {
+        (*levels)[level]->setAreaUpdated(coarseAreaMin[level], coarseAreaMax[level]);
+      }
+    }
+
+    levels = 0;
+  }
+
+protected:
+
+  /**
+   * Coarse cell (x,y) covers the ratio x ratio finest cells starting at fineOrigin + ratio * (x,y).
+   */
+  struct LevelGeometry
+  {
+    int ratio;
+    Eigen::Vector2i fineOrigin;
+  };
+
+  struct Tile
+  {
+    int level;
+    LevelGeometry geometry;
+    Eigen::Vector2i areaMin;
+    Eigen::Vector2i areaMax;
+  };
+
+  /**
+   * parallelFor body pooling consecutive tiles.
+   */
+  class PoolTilesTask
+  {
+  public:
+    PoolTilesTask(GridMapPyramidBuilder* builderIn) : builder(builderIn) {};
+
+    void operator()(int begin, int end) const { builder->poolTiles(begin, end); };
+
+  protected:
+    GridMapPyramidBuilder* builder;
+  };
+
+  LevelGeometry getLevelGeometry(int level) const
+  {
+    const ConcreteGridMap& fineMap (*(*levels)[0]);
+    const ConcreteGridMap& coarseMap (*(*levels)[level]);
+
+    LevelGeometry geometry;
+    geometry.ratio = std::max(1, static_cast<int>(std::floor(coarseMap.getCellLength() / fineMap.getCellLength() + 0.5f)));
+
+    //the finest cell containing the lower corner of coarse cell (0,0)
+    Eigen::Vector2f cornerFine (fineMap.getMapCoords(coarseMap.getWorldCoords(Eigen::Vector2f(-0.5f, -0.5f))));
+    geometry.fineOrigin = Eigen::Vector2i(static_cast<int>(std::floor(cornerFine.x() + 0.5f)), static_cast<int>(std::floor(cornerFine.y() + 0.5f)));
+
+    return geometry;
+  }
+
+  void poolTiles(int begin, int end)
+  {
+    const ConcreteGridMap& fineMap (*(*levels)[0]);
+
+    CellType resetCell;
+    resetCell.resetGridCell();
+    float resetValue = resetCell.getValue();
+
+    int fineSizeX = fineMap.getSizeX();
+    int fineSizeY = fineMap.getSizeY();
+
+    for (int i = begin; i < end; ++i) {
+      const Tile& tile (tiles[i]);
+      ConcreteGridMap& coarseMap (*(*levels)[tile.level]);
+
+      int ratio = tile.geometry.ratio;
+
+      for (int y = tile.areaMin.y(); y <= tile.areaMax.y(); ++y) {
+        int fineBeginY = std::max(0, tile.geometry.fineOrigin.y() + y * ratio);
+        int fineEndY = std::min(fineSizeY, tile.geometry.fineOrigin.y() + (y + 1) * ratio);
+
+        for (int x = tile.areaMin.x(); x <= tile.areaMax.x(); ++x) {
+          int fineBeginX = std::max(0, tile.geometry.fineOrigin.x() + x * ratio);
+          int fineEndX = std::min(fineSizeX, tile.geometry.fineOrigin.x() + (x + 1) * ratio);
+
+          float maxValue = -std::numeric_limits<float>::max();
+          float sum = 0.0f;
+          int count = 0;
+
+          for (int fineY = fineBeginY; fineY < fineEndY; ++fineY) {
+            for (int fineX = fineBeginX; fineX < fineEndX; ++fineX) {
+              float value = fineMap.isCellAllocated(fineX, fineY) ? fineMap.getCell(fineMap.getCellIndex(fineX, fineY)).getValue() : resetValue;
+              maxValue = std::max(maxValue, value);
+              sum += value;
+              ++count;
+            }
+          }
+
+          float value = (count == 0) ? resetValue : ((pooling == PyramidPoolingMax) ? maxValue : sum / static_cast<float>(count));
+
+          //unallocated cells of sparse layouts already have the reset value
+          if (!coarseMap.isCellAllocated(x, y) && (value == resetValue)) {
+            continue;
+          }
+
+          coarseMap.getCell(coarseMap.getCellIndexForUpdate(x, y)).set(value);
+        }
+      }
+
+      coarseMap.refreshProbabilityPlane(tile.areaMin, tile.areaMax);
+    }
+  }
+
+  static int floorDiv(int value, int divisor)
+  {
+    return (value >= 0) ? (value / divisor) : -((divisor - 1 - value) / divisor);
+  }
+
+  enum { tileSize = 64 };  ///< Tile edge length in coarse cells
+
+  WorkerPool* workerPool;
+  GridMapPyramidPooling pooling;
+
+  const std::vector<ConcreteGridMap*>* levels;  ///< Only set during sync()
+  std::vector<Tile> tiles;
+};
+
+}
+
+#endif
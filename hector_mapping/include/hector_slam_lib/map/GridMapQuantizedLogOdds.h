@@ -0,0 +1,204 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#ifndef __GridMapQuantizedLogOdds_h_
+#define __GridMapQuantizedLogOdds_h_
+
+#include <cmath>
+
+/**
+ * Provides a quantized log odds of occupancy probability representation for cells in a occupancy grid map.
+ * Log odds values are stored as 16 bit integers in units of 1/stepsPerLogOdd and clamped to [-maxQuantizedVal, maxQuantizedVal],
+ * so the conversion to probabilities can be done with a lookup table (see GridMapQuantizedLogOddsFunctions).
+ * Free updates are not clamped, so they can be reverted exactly, and may leave the stored value up to one update step
+ * beyond the limits. Such values are read as the limit.
+ */
+class QuantizedLogOddsCell
+{
+public:
+
+  enum { stepsPerLogOdd = 64 };                   ///< Quantization steps per unit log odds.
+  enum { maxQuantizedVal = 16 * stepsPerLogOdd }; ///< Clamping limit, corresponds to log odds of +-16.
+
+  /**
+   * Sets the cell value to val.
+   * @param val The log odds value.
+   */
+  void set(float val)
+  {
+    logOddsVal = quantize(val);
+  }
+
+  /**
+   * Returns the value of the cell.
+   * @return The log odds value.
+   */
+  float getValue() const
+  {
+    return static_cast<float>(clamp(logOddsVal)) * (1.0f / static_cast<float>(stepsPerLogOdd));
+  }
+
+  /**
+   * Returns wether the cell is occupied.
+   * @return Cell is occupied
+   */
+  bool isOccupied() const
+  {
+    return logOddsVal > 0;
+  }
+
+  bool isFree() const
+  {
+    return logOddsVal < 0;
+  }
+
+  /**
+   * Reset Cell to prior probability.
+   */
+  void resetGridCell()
+  {
+    logOddsVal = 0;
+  }
+
+  /**
+   * Converts a log odds value to the quantized and clamped representation.
+   */
+  static short quantize(float val)
+  {
+    int quantized = static_cast<int>(floor(val * static_cast<float>(stepsPerLogOdd) + 0.5f));
+    return clamp(quantized);
+  }
+
+  static short clamp(int quantized)
+  {
+    if (quantized > maxQuantizedVal) {
+      return maxQuantizedVal;
+    } else if (quantized < -maxQuantizedVal) {
+      return -maxQuantizedVal;
+    }
+    return static_cast<short>(quantized);
+  }
+
+  //protected:
+
+public:
+
+  short logOddsVal; ///< The quantized log odds representation of occupancy probability.
+
+
+};
+
+/**
+ * Provides functions related to a quantized log odds of occupancy probability respresentation for cells in a occupancy grid map.
+ * The probability for every representable log odds value is precomputed, so getGridProbability() is a table lookup instead of exp().
+ */
+class GridMapQuantizedLogOddsFunctions
+{
+public:
+
+  /**
+   * Constructor, sets parameters like free and occupied log odds ratios and fills the probability lookup table.
+   */
+  GridMapQuantizedLogOddsFunctions()
+  {
+    this->setUpdateFreeFactor(0.4f);
+    this->setUpdateOccupiedFactor(0.6f);
+
+    //update steps are clamped to the limit as well, so values left beyond it by free updates are within twice the limit
+    for (int i = -lookupOffset; i <= lookupOffset; ++i){
+      float odds = exp(static_cast<float>(QuantizedLogOddsCell::clamp(i)) / static_cast<float>(QuantizedLogOddsCell::stepsPerLogOdd));
+      probabilityLookup[i + lookupOffset] = odds / (odds + 1.0f);
+    }
+  }
+
+  /**
+   * Update cell as occupied
+   * @param cell The cell.
+   */
+  void updateSetOccupied(QuantizedLogOddsCell& cell) const
+  {
+    cell.logOddsVal = QuantizedLogOddsCell::clamp(cell.logOddsVal + logOddsOccupied);
+  }
+
+  /**
+   * Update cell as free. Only the previous value is clamped, so updateUnsetFree() restores it exactly (clamped) and
+   * the result stays within one update step of the limits.
+   * @param cell The cell.
+   */
+  void updateSetFree(QuantizedLogOddsCell& cell) const
+  {
+    cell.logOddsVal = static_cast<short>(QuantizedLogOddsCell::clamp(cell.logOddsVal) + logOddsFree);
+  }
+
+  /**
+   * Reverts updateSetFree() for a cell also updated as occupied by the same scan.
+   * @param cell The cell.
+   */
+  void updateUnsetFree(QuantizedLogOddsCell& cell) const
+  {
+    cell.logOddsVal = static_cast<short>(cell.logOddsVal - logOddsFree);
+  }
+
+  /**
+   * Get the probability value represented by the grid cell.
+   * @param cell The cell.
+   * @return The probability
+   */
+  float getGridProbability(const QuantizedLogOddsCell& cell) const
+  {
+    return probabilityLookup[cell.logOddsVal + lookupOffset];
+  }
+
+  void setUpdateFreeFactor(float factor)
+  {
+    logOddsFree = QuantizedLogOddsCell::quantize(probToLogOdds(factor));
+  }
+
+  void setUpdateOccupiedFactor(float factor)
+  {
+    logOddsOccupied = QuantizedLogOddsCell::quantize(probToLogOdds(factor));
+  }
+
+protected:
+
+  enum { lookupOffset = 2 * QuantizedLogOddsCell::maxQuantizedVal };
+
+  float probToLogOdds(float prob)
+  {
+    float odds = prob / (1.0f - prob);
+    return log(odds);
+  }
+
+  int logOddsOccupied; /// < The quantized log odds representation of probability used for updating cells as occupied
+  int logOddsFree;     /// < The quantized log odds representation of probability used for updating cells as free
+
+  float probabilityLookup[2 * lookupOffset + 1]; ///< Probabilities for all storable quantized log odds values
+};
+
+
+#endif
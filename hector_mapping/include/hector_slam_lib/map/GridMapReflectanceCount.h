@@ -60,7 +60,6 @@ public:
     probOccupied = 0.5f;
     visitedCount = 0.0f;
     reflectedCount = 0.0f;
-    updateIndex = -1;
   }
 
 //protected:
@@ -68,7 +67,6 @@ public:
   float visitedCount;
   float reflectedCount;
   float probOccupied;
-  int updateIndex;
 };
 
 
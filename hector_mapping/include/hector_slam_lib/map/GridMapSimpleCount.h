@@ -75,7 +75,6 @@ public:
   void resetGridCell()
   {
     simpleOccVal = 0.5f;
-    updateIndex = -1;
   }
 
 //protected:
@@ -83,7 +82,6 @@ public:
 public:
 
   float simpleOccVal; ///< The log odds representation of occupancy probability.
-  int updateIndex;
 
 
 };
@@ -0,0 +1,127 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef __GridMapSnapshot_h_
+#define __GridMapSnapshot_h_
+
+#include <Eigen/Core>
+
+namespace hectorslam {
+
+/**
+ * Read only copy of an occupancy grid map, for consumers (e.g. map publishing) that need a consistent view of the
+ * map without holding its mutex while processing it. update() brings the copy up to date and is the only call that
+ * needs the map mutex: it copies only the cells changed since the last update (the update areas recorded by
+ * updateByScan()), so the map is blocked for about as long as the scan updates themselves took. The whole map is
+ * copied if the changes are not known, e.g. after a reset or moving the map window, and always for sparse layouts.
+ */
+template<typename ConcreteGridMap>
+class GridMapSnapshot
+{
+public:
+
+  GridMapSnapshot()
+    : gridMap(0)
+    , sourceUpdateIndex(-1)
+    , changedAreaKnown(false)
+  {}
+
+  ~GridMapSnapshot()
+  {
+    delete gridMap;
+  }
+
+  /**
+   * Updates the snapshot to the current state of source. Hold the map mutex while calling this.
+   * @return True if the snapshot has changed
+   */
+  bool update(const ConcreteGridMap& source)
+  {
+    if (gridMap && (sourceUpdateIndex == source.getUpdateIndex())) {
+      return false;
+    }
+
+    //the update areas are needed by incremental consumers even if the whole map is copied
+    changedAreaKnown = gridMap && source.getUpdateAreaSince(sourceUpdateIndex, changedAreaMin, changedAreaMax);
+
+    if (!gridMap) {
+      gridMap = new ConcreteGridMap(source);
+      gridMap->setProbabilityPlaneEnabled(false);
+    } else if (ConcreteGridMap::LayoutType::allocatesOnUpdate || !changedAreaKnown) {
+      gridMap->copyCells(source);
+    } else {
+      gridMap->copyCells(source, changedAreaMin, changedAreaMax);
+    }
+
+    gridMap->copyExploredArea(source);
+
+    sourceUpdateIndex = source.getUpdateIndex();
+    return true;
+  }
+
+  bool isValid() const { return gridMap != 0; };
+
+  /**
+   * Returns the copy of the map, only valid after the first update().
+   */
+  const ConcreteGridMap& getGridMap() const { return *gridMap; };
+
+  /**
+   * Returns the update index of the source map the snapshot corresponds to.
+   */
+  int getUpdateIndex() const { return sourceUpdateIndex; };
+
+  /**
+   * Returns the rectangle of cells that may have changed with the last update() that returned true, so consumers
+   * converting the snapshot can process just that area.
+   * @return False if not known (all cells may have changed, or the map geometry changed)
+   */
+  bool getLastChangedArea(Eigen::Vector2i& areaMin, Eigen::Vector2i& areaMax) const
+  {
+    areaMin = changedAreaMin;
+    areaMax = changedAreaMax;
+    return changedAreaKnown;
+  }
+
+private:
+
+  GridMapSnapshot(const GridMapSnapshot&);
+  GridMapSnapshot& operator=(const GridMapSnapshot&);
+
+  ConcreteGridMap* gridMap;
+  int sourceUpdateIndex;
+
+  bool changedAreaKnown;
+  Eigen::Vector2i changedAreaMin;
+  Eigen::Vector2i changedAreaMax;
+};
+
+}
+
+#endif
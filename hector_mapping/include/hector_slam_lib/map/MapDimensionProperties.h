@@ -87,6 +87,7 @@ public:
   int getSizeX() const { return mapDimensions[0]; };
   int getSizeY() const { return mapDimensions[1]; };
   float getCellLength() const { return cellLength; };
+  const Eigen::Vector2f& getMapLimits() const { return mapLimitsf; };
 
 protected:
   Eigen::Vector2f topLeftOffset;
@@ -33,14 +33,21 @@
 
 #include "../scan/DataPointContainer.h"
 #include "../util/UtilFunctions.h"
+#include "../util/WorkerPool.h"
+#include "../util/MapSpillInterface.h"
 
 #include <Eigen/Geometry>
 
+#include <vector>
+#include <deque>
+#include <climits>
+#include <cmath>
+
 namespace hectorslam {
 
-template<typename ConcreteCellType, typename ConcreteGridFunctions>
+template<typename ConcreteCellType, typename ConcreteGridFunctions, typename ConcreteLayout = GridMapLayoutRowMajor>
 class OccGridMapBase
-  : public GridMapBase<ConcreteCellType>
+  : public GridMapBase<ConcreteCellType, ConcreteLayout>
 {
 
 public:
@@ -48,27 +55,111 @@ public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
   OccGridMapBase(float mapResolution, const Eigen::Vector2i& size, const Eigen::Vector2f& offset)
-    : GridMapBase<ConcreteCellType>(mapResolution, size, offset)
+    : GridMapBase<ConcreteCellType, ConcreteLayout>(mapResolution, size, offset)
     , currUpdateIndex(0)
     , currMarkOccIndex(-1)
     , currMarkFreeIndex(-1)
+    , probabilityPlaneEnabled(false)
+    , workerPool(0)
+    , exploredAreaMin(INT_MAX, INT_MAX)
+    , exploredAreaMax(INT_MIN, INT_MIN)
   {}
 
   virtual ~OccGridMapBase() {}
 
+  virtual void reset()
+  {
+    GridMapBase<ConcreteCellType, ConcreteLayout>::reset();
+    this->refreshProbabilityPlane();
+
+    //all cells changed, there is no update area for this
+    updateAreas.clear();
+    this->setUpdated();
+
+    exploredAreaMin = Eigen::Vector2i(INT_MAX, INT_MAX);
+    exploredAreaMax = Eigen::Vector2i(INT_MIN, INT_MIN);
+  }
+
+  /**
+   * Direct cell updates by storage index, use getCellIndexForUpdate() to get the index of cells that may be unallocated.
+   */
   void updateSetOccupied(int index)
   {
     concreteGridFunctions.updateSetOccupied(this->getCell(index));
+    this->refreshProbability(index);
   }
 
   void updateSetFree(int index)
   {
     concreteGridFunctions.updateSetFree(this->getCell(index));
+    this->refreshProbability(index);
   }
 
   void updateUnsetFree(int index)
   {
     concreteGridFunctions.updateUnsetFree(this->getCell(index));
+    this->refreshProbability(index);
+  }
+
+  /**
+   * Enables or disables the probability plane. If enabled, the occupancy probability of every cell is kept in a
+   * float array that is refreshed for the cells touched by map updates, so scan matching can read probabilities
+   * directly instead of computing and caching them per lookup. Cells modified through getCell() directly are not
+   * tracked, call refreshProbabilityPlane() afterwards.
+   */
+  void setProbabilityPlaneEnabled(bool enabled)
+  {
+    probabilityPlaneEnabled = enabled;
+
+    if (enabled) {
+      this->refreshProbabilityPlane();
+    } else {
+      std::vector<float>().swap(probabilityPlane);
+    }
+  }
+
+  bool getProbabilityPlaneEnabled() const { return probabilityPlaneEnabled; };
+
+  /**
+   * Returns the probability plane indexed by storage index, or 0 if it is disabled (or there is no storage yet, as
+   * for sparse layouts before the first update).
+   */
+  const float* getProbabilityPlane() const
+  {
+    return probabilityPlane.empty() ? 0 : &probabilityPlane[0];
+  }
+
+  /**
+   * Recomputes the probability plane for all cells if it is enabled.
+   */
+  void refreshProbabilityPlane()
+  {
+    if (probabilityPlaneEnabled) {
+      int size = this->getStorageSize();
+
+      probabilityPlane.resize(size);
+
+      for (int i = 0; i < size; ++i) {
+        probabilityPlane[i] = concreteGridFunctions.getGridProbability(this->getCell(i));
+      }
+    }
+  }
+
+  /**
+   * Refreshes the probability plane for the cells in the rectangle [areaMin, areaMax] only. Different rectangles may
+   * be refreshed concurrently as long as the storage does not grow meanwhile.
+   */
+  void refreshProbabilityPlane(const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+  {
+    if (probabilityPlaneEnabled) {
+      for (int y = areaMin.y(); y <= areaMax.y(); ++y) {
+        for (int x = areaMin.x(); x <= areaMax.x(); ++x) {
+          if (this->isCellAllocated(x, y)) {
+            this->refreshProbability(this->getCellIndex(x, y));
+          }
+        }
+      }
+    }
   }
 
   float getGridProbabilityMap(int index) const
@@ -113,12 +204,178 @@ public:
     concreteGridFunctions.setUpdateOccupiedFactor(factor);
   }
 
+  /**
+   * Sets the pool used for casting the beams of large scans in parallel, 0 casts them on the calling thread. Both
+   * give the same map. Not owned.
+   */
+  void setWorkerPool(WorkerPool* workerPoolIn)
+  {
+    workerPool = workerPoolIn;
+  }
+
+  /**
+   * Moves the map window by (dx,dy) cells, see GridMapBase::moveWindow(). Keeps the probability plane consistent and
+   * counts as a map update that changes all cells, since their map coordinates change.
+   */
+  template<typename LeavingCellVisitor>
+  void moveWindow(int dx, int dy, const LeavingCellVisitor& leavingCellVisitor)
+  {
+    PlaneResettingCellVisitor<LeavingCellVisitor> planeResettingVisitor(this, leavingCellVisitor);
+
+    //with circular indexing only the leaving cells change in storage, the visitor has refreshed their probabilities
+    if (!GridMapBase<ConcreteCellType, ConcreteLayout>::moveWindow(dx, dy, planeResettingVisitor)) {
+      this->refreshProbabilityPlane();
+    }
+
+    updateAreas.clear();
+    this->setUpdated();
+
+    //the explored cells move with the window, the ones that left it are gone
+    if (exploredAreaMin.x() <= exploredAreaMax.x()) {
+      Eigen::Vector2i offset (dx, dy);
+      exploredAreaMin = (exploredAreaMin - offset).cwiseMax(Eigen::Vector2i::Zero());
+      exploredAreaMax = (exploredAreaMax - offset).cwiseMin(Eigen::Vector2i(this->getSizeX() - 1, this->getSizeY() - 1));
+
+      if ((exploredAreaMin.x() > exploredAreaMax.x()) || (exploredAreaMin.y() > exploredAreaMax.y())) {
+        exploredAreaMin = Eigen::Vector2i(INT_MAX, INT_MAX);
+        exploredAreaMax = Eigen::Vector2i(INT_MIN, INT_MIN);
+      }
+    }
+  }
+
+  /**
+   * Rolling window support, moves the window by whole cells so it is centered on worldCoords again if that is more
+   * than maxCenterOffset (world units, per axis) away from the window center. The known cells leaving the window
+   * are passed to spillInterface if set.
+   * @return True if the window has been moved
+   */
+  bool centerWindowOn(const Eigen::Vector2f& worldCoords, float maxCenterOffset, MapSpillInterface* spillInterface = 0, int mapLevel = 0)
+  {
+    Eigen::Vector2f centerOffset (this->getMapCoords(worldCoords) - this->getMapDimensions().template cast<float>() * 0.5f);
+
+    float maxCenterOffsetMap = maxCenterOffset * this->getScaleToMap();
+
+    if ((std::fabs(centerOffset.x()) <= maxCenterOffsetMap) && (std::fabs(centerOffset.y()) <= maxCenterOffsetMap)) {
+      return false;
+    }
+
+    this->moveWindow(static_cast<int>(std::floor(centerOffset.x() + 0.5f)), static_cast<int>(std::floor(centerOffset.y() + 0.5f)),
+                     CellSpiller(this, spillInterface, mapLevel));
+    return true;
+  }
+
+  /**
+   * Returns the cell rectangle [areaMin, areaMax] that contains all cells changed by the updateByScan() calls after
+   * the map had update index sinceUpdateIndex.
+   * @return False if that is not known, because too many updates have been done since or the map has been changed in
+   * another way (reset(), or direct cell changes followed by setUpdated()). areaMin > areaMax if nothing changed.
+   */
+  bool getUpdateAreaSince(int sinceUpdateIndex, Eigen::Vector2i& areaMin, Eigen::Vector2i& areaMax) const
+  {
+    int currentIndex = this->getUpdateIndex();
+
+    areaMin = Eigen::Vector2i(INT_MAX, INT_MAX);
+    areaMax = Eigen::Vector2i(INT_MIN, INT_MIN);
+
+    if (sinceUpdateIndex == currentIndex) {
+      return true;
+    }
+
+    //the recorded areas have consecutive update indices ending with the current one, or none is recorded
+    if (updateAreas.empty() || (updateAreas.back().updateIndex != currentIndex) ||
+        (sinceUpdateIndex < updateAreas.front().updateIndex - 1) || (sinceUpdateIndex > currentIndex)) {
+      return false;
+    }
+
+    for (typename std::deque<UpdateArea>::const_iterator it = updateAreas.begin(); it != updateAreas.end(); ++it) {
+      if (it->updateIndex > sinceUpdateIndex) {
+        areaMin = areaMin.cwiseMin(it->areaMin);
+        areaMax = areaMax.cwiseMax(it->areaMax);
+      }
+    }
+
+    return true;
+  }
+
+  /**
+   * Returns the cell rectangle [areaMin, areaMax] containing all cells changed by updateByScan() since the last
+   * reset(), kept up to date during the updates. Cells changed directly are only included after extendExploredArea()
+   * or recomputeExploredArea().
+   * @return False if nothing has been explored yet
+   */
+  bool getExploredArea(Eigen::Vector2i& areaMin, Eigen::Vector2i& areaMax) const
+  {
+    areaMin = exploredAreaMin;
+    areaMax = exploredAreaMax;
+    return (exploredAreaMin.x() <= exploredAreaMax.x());
+  }
+
+  /**
+   * Adds the cell rectangle [areaMin, areaMax] to the explored area. An empty rectangle (areaMin > areaMax) does
+   * not change it.
+   */
+  void extendExploredArea(const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+  {
+    if ((areaMin.x() <= areaMax.x()) && (areaMin.y() <= areaMax.y())) {
+      exploredAreaMin = exploredAreaMin.cwiseMin(areaMin);
+      exploredAreaMax = exploredAreaMax.cwiseMax(areaMax);
+    }
+  }
+
+  /**
+   * Sets the explored area to the extends of the cells differing from their reset value, scanning the map. Used
+   * after cells have been changed directly, e.g. when loading a map.
+   */
+  void recomputeExploredArea()
+  {
+    if (!this->getMapExtends(exploredAreaMin, exploredAreaMax)) {
+      exploredAreaMin = Eigen::Vector2i(INT_MAX, INT_MAX);
+      exploredAreaMax = Eigen::Vector2i(INT_MIN, INT_MIN);
+    }
+  }
+
+  /**
+   * Takes over the explored area of another map of the same geometry, used together with GridMapBase::copyCells().
+   */
+  void copyExploredArea(const OccGridMapBase& other)
+  {
+    exploredAreaMin = other.exploredAreaMin;
+    exploredAreaMax = other.exploredAreaMax;
+  }
+
+  /**
+   * Tells the map that only the cells in the rectangle [areaMin, areaMax] have changed, like updateByScan() does
+   * for the cells of a scan. Cells changed directly (not through the updateSet... functions) need their probability
+   * refreshed first, see refreshProbabilityPlane(). The area is part of the explored area afterwards.
+   */
+  void setAreaUpdated(const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+  {
+    this->setUpdated();
+
+    //an unbroken sequence is needed to combine areas, so updates that changed the map otherwise are not kept
+    if (!updateAreas.empty() && (updateAreas.back().updateIndex != this->getUpdateIndex() - 1)) {
+      updateAreas.clear();
+    }
+
+    UpdateArea updateArea;
+    updateArea.updateIndex = this->getUpdateIndex();
+    updateArea.areaMin = areaMin;
+    updateArea.areaMax = areaMax;
+    updateAreas.push_back(updateArea);
+
+    if (static_cast<int>(updateAreas.size()) > maxTrackedUpdateAreas) {
+      updateAreas.pop_front();
+    }
+
+    this->extendExploredArea(areaMin, areaMax);
+  }
+
   /**
    * Updates the map using the given scan data and robot pose
    * @param dataContainer Contains the laser scan data
    * @param robotPoseWorld The 2D robot pose in world coordinates
    */
-  void updateByScan(const DataContainer& dataContainer, const Eigen::Vector3f& robotPoseWorld)
+  void updateByScan(const DataContainerView& dataContainer, const Eigen::Vector3f& robotPoseWorld)
   {
     currMarkFreeIndex = currUpdateIndex + 1;
     currMarkOccIndex = currUpdateIndex + 2;
@@ -133,6 +390,9 @@ public:
     //Get start point of all laser beams in map coordinates (same for alle beams, stored in robot coords in dataContainer)
     Eigen::Vector2f scanBeginMapf(poseTransform * dataContainer.getOrigo());
 
+    //Apply the view scale factor as part of the transform, so the unscaled point arrays can be used directly
+    poseTransform = poseTransform * Eigen::Scaling(dataContainer.getScaleFactor());
+
     //Get integer vector of laser beams start point
     Eigen::Vector2i scanBeginMapi(scanBeginMapf[0] + 0.5f, scanBeginMapf[1] + 0.5f);
 
@@ -141,33 +401,51 @@ public:
 
     //std::cout << "\n maxD: " << maxDist << " num: " << numValidElems << "\n";
 
-    //Iterate over all valid laser beams
-    for (int i = 0; i < numValidElems; ++i) {
+    BeamTracer beamTracer(this, poseTransform, scanBeginMapi, dataContainer.getXArray(), dataContainer.getYArray());
 
-      //Get map coordinates of current beam endpoint
-      Eigen::Vector2f scanEndMapf(poseTransform * (dataContainer.getVecEntry(i)));
-      //std::cout << "\ns\n" << scanEndMapf << "\n";
+    UpdateArea updateArea (this->getScanArea(poseTransform, scanBeginMapi, dataContainer));
 
-      //add 0.5 to beam endpoint vector for following integer cast (to round, not truncate)
-      scanEndMapf.array() += (0.5f);
-
-      //Get integer map coordinates of current beam endpoint
-      Eigen::Vector2i scanEndMapi(scanEndMapf.cast<int>());
-
-      //Update map using a bresenham variant for drawing a line from beam start to beam endpoint in map coordinates
-      if (scanBeginMapi != scanEndMapi){
-        updateLineBresenhami(scanBeginMapi, scanEndMapi);
-      }
+    //layouts allocating storage during the update would have to synchronize the beams, so they cast serially
+    if (!ConcreteLayout::allocatesOnUpdate && workerPool && (workerPool->getNumThreads() > 0) && (numValidElems >= minBeamsForParallelUpdate)) {
+      updateByScanParallel(beamTracer, numValidElems);
+    } else {
+      CellUpdater cellUpdater(this);
+      beamTracer.traceBeams(0, numValidElems, cellUpdater);
     }
 
     //Tell the map that it has been updated
-    this->setUpdated();
+    this->setAreaUpdated(updateArea.areaMin, updateArea.areaMax);
 
     //Increase update index (used for updating grid cells only once per incoming scan)
     currUpdateIndex += 3;
   }
 
+  /**
+   * Returns the storage index of the cell at (x,y) for updating it. With sparse layouts, the cell's tile is allocated
+   * first (growing the storage if needed), cells of unallocated tiles must not be written through getCellIndex().
+   */
+  inline int getCellIndexForUpdate(int x, int y)
+  {
+    if (this->allocateCell(x, y) && probabilityPlaneEnabled) {
+      ConcreteCellType defaultCell;
+      defaultCell.resetGridCell();
+      probabilityPlane.resize(this->getStorageSize(), concreteGridFunctions.getGridProbability(defaultCell));
+    }
+
+    return this->getCellIndex(x, y);
+  }
+
   inline void updateLineBresenhami( const Eigen::Vector2i& beginMap, const Eigen::Vector2i& endMap, unsigned int max_length = UINT_MAX){
+    CellUpdater cellUpdater(this);
+    traceLineBresenhami(beginMap, endMap, cellUpdater);
+  }
+
+  /**
+   * Visits the cells of the line from beginMap to endMap, calling cellVisitor.free(index) for every cell but the last
+   * and cellVisitor.occupied(index) for the end cell. Nothing is visited if one of the points is outside the map.
+   */
+  template<typename CellVisitor>
+  inline void traceLineBresenhami( const Eigen::Vector2i& beginMap, const Eigen::Vector2i& endMap, CellVisitor& cellVisitor){
 
     int x0 = beginMap[0];
     int y0 = beginMap[1];
@@ -193,78 +471,354 @@ public:
     unsigned int abs_dx = abs(dx);
     unsigned int abs_dy = abs(dy);
 
-    int offset_dx = util::sign(dx);
-    int offset_dy = util::sign(dy) * this->sizeX;
-
-    unsigned int startOffset = beginMap.y() * this->sizeX + beginMap.x();
+    int step_x = util::sign(dx);
+    int step_y = util::sign(dy);
 
+    //cells are visited by coordinates and mapped to storage indices by the layout, so the line does not depend on
+    //how cells are arranged in memory
     //if x is dominant
     if(abs_dx >= abs_dy){
       int error_y = abs_dx / 2;
-      bresenham2D(abs_dx, abs_dy, error_y, offset_dx, offset_dy, startOffset);
+      bresenham2D(abs_dx, abs_dy, error_y, step_x, 0, 0, step_y, x0, y0, cellVisitor);
     }else{
       //otherwise y is dominant
       int error_x = abs_dy / 2;
-      bresenham2D(abs_dy, abs_dx, error_x, offset_dy, offset_dx, startOffset);
+      bresenham2D(abs_dy, abs_dx, error_x, 0, step_y, step_x, 0, x0, y0, cellVisitor);
     }
 
-    unsigned int endOffset = endMap.y() * this->sizeX + endMap.x();
-    this->bresenhamCellOcc(endOffset);
+    cellVisitor.occupied(this->getCellIndexForUpdate(x1, y1));
 
   }
 
   inline void bresenhamCellFree(unsigned int offset)
   {
-    ConcreteCellType& cell (this->getCell(offset));
+    int& updateStamp (this->getUpdateStamp(offset));
 
-    if (cell.updateIndex < currMarkFreeIndex) {
-      concreteGridFunctions.updateSetFree(cell);
-      cell.updateIndex = currMarkFreeIndex;
+    if (updateStamp < currMarkFreeIndex) {
+      concreteGridFunctions.updateSetFree(this->getCell(offset));
+      this->refreshProbability(offset);
+      updateStamp = currMarkFreeIndex;
     }
   }
 
   inline void bresenhamCellOcc(unsigned int offset)
   {
-    ConcreteCellType& cell (this->getCell(offset));
+    int& updateStamp (this->getUpdateStamp(offset));
 
-    if (cell.updateIndex < currMarkOccIndex) {
+    if (updateStamp < currMarkOccIndex) {
+
+      ConcreteCellType& cell (this->getCell(offset));
 
       //if this cell has been updated as free in the current iteration, revert this
-      if (cell.updateIndex == currMarkFreeIndex) {
+      if (updateStamp == currMarkFreeIndex) {
         concreteGridFunctions.updateUnsetFree(cell);
       }
 
       concreteGridFunctions.updateSetOccupied(cell);
+      this->refreshProbability(offset);
       //std::cout << " setOcc " << "\n";
-      cell.updateIndex = currMarkOccIndex;
+      updateStamp = currMarkOccIndex;
     }
   }
 
-  inline void bresenham2D( unsigned int abs_da, unsigned int abs_db, int error_b, int offset_a, int offset_b, unsigned int offset){
+  template<typename CellVisitor>
+  inline void bresenham2D( unsigned int abs_da, unsigned int abs_db, int error_b, int step_ax, int step_ay, int step_bx, int step_by, int x, int y, CellVisitor& cellVisitor){
 
-    this->bresenhamCellFree(offset);
+    cellVisitor.free(this->getCellIndexForUpdate(x, y));
 
     unsigned int end = abs_da-1;
 
     for(unsigned int i = 0; i < end; ++i){
-      offset += offset_a;
+      x += step_ax;
+      y += step_ay;
       error_b += abs_db;
 
       if((unsigned int)error_b >= abs_da){
-        offset += offset_b;
+        x += step_bx;
+        y += step_by;
         error_b -= abs_da;
       }
 
-      this->bresenhamCellFree(offset);
+      cellVisitor.free(this->getCellIndexForUpdate(x, y));
     }
   }
 
 protected:
 
+  /**
+   * Cell visitor applying the free/occupied updates to the map directly.
+   */
+  class CellUpdater
+  {
+  public:
+    CellUpdater(OccGridMapBase* gridMapIn) : gridMap(gridMapIn) {};
+    void free(unsigned int index) { gridMap->bresenhamCellFree(index); };
+    void occupied(unsigned int index) { gridMap->bresenhamCellOcc(index); };
+  protected:
+    OccGridMapBase* gridMap;
+  };
+
+  /**
+   * Leaving cell visitor for moveWindow() passing the known cells to a MapSpillInterface.
+   */
+  class CellSpiller
+  {
+  public:
+    CellSpiller(const OccGridMapBase* gridMapIn, MapSpillInterface* spillInterfaceIn, int mapLevelIn)
+      : gridMap(gridMapIn), spillInterface(spillInterfaceIn), mapLevel(mapLevelIn)
+    {}
+
+    void operator()(int x, int y, int index) const
+    {
+      if (spillInterface && (gridMap->isFree(index) || gridMap->isOccupied(index))) {
+        spillInterface->spillCell(mapLevel, gridMap->getWorldCoords(Eigen::Vector2f(x, y)), gridMap->getGridProbabilityMap(index));
+      }
+    }
+
+  protected:
+    const OccGridMapBase* gridMap;
+    MapSpillInterface* spillInterface;
+    int mapLevel;
+  };
+
+  /**
+   * Wraps a leaving cell visitor, setting the probability plane entry of every leaving cell to the value of a reset cell.
+   */
+  template<typename LeavingCellVisitor>
+  class PlaneResettingCellVisitor
+  {
+  public:
+    PlaneResettingCellVisitor(OccGridMapBase* gridMapIn, const LeavingCellVisitor& leavingCellVisitorIn)
+      : gridMap(gridMapIn), leavingCellVisitor(leavingCellVisitorIn), resetProbability(gridMapIn->getObstacleThreshold())
+    {}
+
+    void operator()(int x, int y, int index) const
+    {
+      leavingCellVisitor(x, y, index);
+
+      if (gridMap->probabilityPlaneEnabled) {
+        gridMap->probabilityPlane[index] = resetProbability;
+      }
+    }
+
+  protected:
+    OccGridMapBase* gridMap;
+    const LeavingCellVisitor& leavingCellVisitor;
+    float resetProbability;
+  };
+
+  /**
+   * Cell visitor recording the visited cells in order into one list per replay band, occupied cells are marked with
+   * occupiedFlag. Consecutive blocks of storage indices are dealt to the bands round robin, so every cell belongs to
+   * exactly one band and the bands get similar shares of the scan.
+   */
+  class CellRecorder
+  {
+  public:
+    CellRecorder(std::vector<unsigned int>* bandCellsIn, unsigned int numBandsIn) : bandCells(bandCellsIn), numBands(numBandsIn) {}
+    void free(unsigned int index) { bandCells[getBand(index)].push_back(index); }
+    void occupied(unsigned int index) { bandCells[getBand(index)].push_back(index | occupiedFlag); }
+  protected:
+    unsigned int getBand(unsigned int index) const { return (index >> bandBlockShift) % numBands; }
+    std::vector<unsigned int>* bandCells;
+    unsigned int numBands;
+  };
+
+  /**
+   * Casts the beams of one scan, either directly into the map or into per chunk cell lists for the parallel update.
+   */
+  class BeamTracer
+  {
+  public:
+    BeamTracer(OccGridMapBase* gridMapIn, const Eigen::Affine2f& poseTransformIn, const Eigen::Vector2i& scanBeginMapiIn, const float* pointsXIn, const float* pointsYIn)
+      : gridMap(gridMapIn)
+      , poseTransform(poseTransformIn)
+      , scanBeginMapi(scanBeginMapiIn)
+      , pointsX(pointsXIn)
+      , pointsY(pointsYIn)
+    {}
+
+    template<typename CellVisitor>
+    void traceBeams(int beginBeam, int endBeam, CellVisitor& cellVisitor) const
+    {
+      //Iterate over all valid laser beams
+      for (int i = beginBeam; i < endBeam; ++i) {
+
+        //Get map coordinates of current beam endpoint
+        Eigen::Vector2f scanEndMapf(poseTransform * Eigen::Vector2f(pointsX[i], pointsY[i]));
+        //std::cout << "\ns\n" << scanEndMapf << "\n";
+
+        //add 0.5 to beam endpoint vector for following integer cast (to round, not truncate)
+        scanEndMapf.array() += (0.5f);
+
+        //Get integer map coordinates of current beam endpoint
+        Eigen::Vector2i scanEndMapi(scanEndMapf.cast<int>());
+
+        //Update map using a bresenham variant for drawing a line from beam start to beam endpoint in map coordinates
+        if (scanBeginMapi != scanEndMapi){
+          gridMap->traceLineBresenhami(scanBeginMapi, scanEndMapi, cellVisitor);
+        }
+      }
+    }
+
+    OccGridMapBase* gridMap;
+    Eigen::Affine2f poseTransform;
+    Eigen::Vector2i scanBeginMapi;
+    const float* pointsX;
+    const float* pointsY;
+  };
+
+  /**
+   * parallelFor body recording the cells of consecutive beam chunks, the cell list of chunk c and band b is
+   * chunkCells[c * numParts + b].
+   */
+  class ChunkTraceTask
+  {
+  public:
+    ChunkTraceTask(const BeamTracer& beamTracerIn, std::vector<std::vector<unsigned int> >& chunkCellsIn, int numPartsIn, int numBeamsIn)
+      : beamTracer(beamTracerIn), chunkCells(chunkCellsIn), numParts(numPartsIn), numBeams(numBeamsIn)
+    {}
+
+    void operator()(int beginChunk, int endChunk) const
+    {
+      for (int chunk = beginChunk; chunk < endChunk; ++chunk) {
+        std::vector<unsigned int>* bandCells (&chunkCells[chunk * numParts]);
+
+        for (int band = 0; band < numParts; ++band) {
+          bandCells[band].clear();
+        }
+
+        CellRecorder cellRecorder(bandCells, numParts);
+        beamTracer.traceBeams((numBeams * chunk) / numParts, (numBeams * (chunk + 1)) / numParts, cellRecorder);
+      }
+    }
+
+    const BeamTracer& beamTracer;
+    std::vector<std::vector<unsigned int> >& chunkCells;
+    int numParts;
+    int numBeams;
+  };
+
+  /**
+   * parallelFor body replaying the recorded cells of consecutive bands. Every band walks its lists of all chunks in
+   * beam order, so each cell sees the same update sequence as in the serial update.
+   */
+  class BandReplayTask
+  {
+  public:
+    BandReplayTask(OccGridMapBase* gridMapIn, const std::vector<std::vector<unsigned int> >& chunkCellsIn, int numPartsIn)
+      : gridMap(gridMapIn), chunkCells(chunkCellsIn), numParts(numPartsIn)
+    {}
+
+    void operator()(int beginBand, int endBand) const
+    {
+      CellUpdater cellUpdater(gridMap);
+
+      for (int band = beginBand; band < endBand; ++band) {
+        for (int chunk = 0; chunk < numParts; ++chunk) {
+
+          const std::vector<unsigned int>& cells (chunkCells[chunk * numParts + band]);
+          size_t numCells = cells.size();
+
+          for (size_t i = 0; i < numCells; ++i) {
+            if (cells[i] & occupiedFlag) {
+              cellUpdater.occupied(cells[i] & ~occupiedFlag);
+            } else {
+              cellUpdater.free(cells[i]);
+            }
+          }
+        }
+      }
+    }
+
+    OccGridMapBase* gridMap;
+    const std::vector<std::vector<unsigned int> >& chunkCells;
+    int numParts;
+  };
+
+  /**
+   * Casts the beams in parallel into per chunk and band cell lists, then applies the bands to the map in parallel.
+   * The bands own disjoint cells, so the map ends up bit-identical to the serial update.
+   */
+  void updateByScanParallel(const BeamTracer& beamTracer, int numBeams)
+  {
+    int numParts = workerPool->getNumThreads() + 1;
+
+    chunkCells.resize(numParts * numParts);
+
+    workerPool->parallelFor(numParts, ChunkTraceTask(beamTracer, chunkCells, numParts, numBeams));
+    workerPool->parallelFor(numParts, BandReplayTask(this, chunkCells, numParts));
+  }
+
+  /**
+   * Cells changed by one updateByScan() call.
+   */
+  struct UpdateArea
+  {
+    int updateIndex;
+    Eigen::Vector2i areaMin;
+    Eigen::Vector2i areaMax;
+  };
+
+  /**
+   * Returns the bounding box of the beam start and end cells of a scan, clipped to the map. It contains all cells the
+   * beams pass through.
+   */
+  UpdateArea getScanArea(const Eigen::Affine2f& poseTransform, const Eigen::Vector2i& scanBeginMapi, const DataContainerView& dataContainer) const
+  {
+    Eigen::Vector2f areaMinf(scanBeginMapi.cast<float>());
+    Eigen::Vector2f areaMaxf(areaMinf);
+
+    int size = dataContainer.getSize();
+    const float* pointsX = dataContainer.getXArray();
+    const float* pointsY = dataContainer.getYArray();
+
+    for (int i = 0; i < size; ++i) {
+      Eigen::Vector2f scanEndMapf(poseTransform * Eigen::Vector2f(pointsX[i], pointsY[i]));
+      areaMinf = areaMinf.cwiseMin(scanEndMapf);
+      areaMaxf = areaMaxf.cwiseMax(scanEndMapf);
+    }
+
+    //rounded like the beam end points
+    areaMinf.array() += 0.5f;
+    areaMaxf.array() += 0.5f;
+
+    Eigen::Vector2i mapMax (this->getSizeX() - 1, this->getSizeY() - 1);
+
+    UpdateArea area;
+    area.updateIndex = -1;
+    area.areaMin = Eigen::Vector2i(static_cast<int>(std::floor(areaMinf[0])), static_cast<int>(std::floor(areaMinf[1]))).cwiseMax(Eigen::Vector2i::Zero());
+    area.areaMax = Eigen::Vector2i(static_cast<int>(std::floor(areaMaxf[0])), static_cast<int>(std::floor(areaMaxf[1]))).cwiseMin(mapMax);
+    return area;
+  }
+
+  inline void refreshProbability(int index)
+  {
+    if (probabilityPlaneEnabled) {
+      probabilityPlane[index] = concreteGridFunctions.getGridProbability(this->getCell(index));
+    }
+  }
+
   ConcreteGridFunctions concreteGridFunctions;
   int currUpdateIndex;
   int currMarkOccIndex;
   int currMarkFreeIndex;
+
+  bool probabilityPlaneEnabled;
+  std::vector<float> probabilityPlane; ///< Occupancy probabilities by storage index, only used if enabled.
+
+  enum { minBeamsForParallelUpdate = 4096 };  ///< Smaller scans are cast serially, threading does not pay off
+  static const unsigned int occupiedFlag = 0x80000000u;
+  enum { bandBlockShift = 6 };  ///< Storage indices are dealt to the replay bands in blocks of 64 cells
+
+  WorkerPool* workerPool;
+  std::vector<std::vector<unsigned int> > chunkCells; ///< Cells visited per beam chunk and band, reused between scans
+
+  enum { maxTrackedUpdateAreas = 16 };
+  std::deque<UpdateArea> updateAreas; ///< Areas of the last updateByScan() calls, oldest first
+
+  Eigen::Vector2i exploredAreaMin; ///< Explored cells since the last reset(), exploredAreaMin > exploredAreaMax if none
+  Eigen::Vector2i exploredAreaMax;
 };
 
 
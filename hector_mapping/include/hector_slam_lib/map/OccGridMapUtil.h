@@ -33,6 +33,7 @@
 
 #include "../scan/DataPointContainer.h"
 #include "../util/UtilFunctions.h"
+#include "../util/SimdFunctions.h"
 
 namespace hectorslam {
 
@@ -46,7 +47,7 @@ public:
     , size(0)
   {
     mapObstacleThreshold = gridMap->getObstacleThreshold();
-    cacheMethod.setMapSize(gridMap->getMapDimensions());
+    cacheMethod.setMapSize(gridMap->getStorageDimensions());
   }
 
   ~OccGridMapUtil()
@@ -61,26 +62,97 @@ public:
 
   inline Eigen::Vector2f getWorldCoordsPoint(const Eigen::Vector2f& mapPoint) const { return concreteGridMap->getWorldCoords(mapPoint); };
 
-  void getCompleteHessianDerivs(const Eigen::Vector3f& pose, const DataContainer& dataPoints, Eigen::Matrix3f& H, Eigen::Vector3f& dTr)
+  /**
+   * Reads grid values through the cache, computing probabilities on a cache miss.
+   */
+  class CachedGridValues
+  {
+  public:
+    CachedGridValues(OccGridMapUtil& gridMapUtilIn) : gridMapUtil(gridMapUtilIn) {};
+    float operator()(int index) const { return gridMapUtil.getCachedGridPoint(index); };
+  protected:
+    OccGridMapUtil& gridMapUtil;
+  };
+
+  /**
+   * Returns the cache based grid value source, resizing the cache first if the map storage has grown (sparse layouts).
+   */
+  CachedGridValues getCachedGridValues()
+  {
+    cacheMethod.setMapSize(concreteGridMap->getStorageDimensions());
+    return CachedGridValues(*this);
+  }
+
+  /**
+   * Reads grid values from the probability plane maintained by the map.
+   */
+  class PlaneGridValues
+  {
+  public:
+    PlaneGridValues(const float* probabilityPlaneIn) : probabilityPlane(probabilityPlaneIn) {};
+    float operator()(int index) const { return probabilityPlane[index]; };
+  protected:
+    const float* probabilityPlane;
+  };
+
+  void getCompleteHessianDerivs(const Eigen::Vector3f& pose, const DataContainerView& dataPoints, Eigen::Matrix3f& H, Eigen::Vector3f& dTr)
+  {
+    float residual;
+    getCompleteHessianDerivs(pose, dataPoints, H, dTr, residual);
+  }
+
+  /**
+   * Also returns the residual at pose (sum of squared (1 - map value) over all points), which is accumulated in the same pass.
+   */
+  void getCompleteHessianDerivs(const Eigen::Vector3f& pose, const DataContainerView& dataPoints, Eigen::Matrix3f& H, Eigen::Vector3f& dTr, float& residual)
+  {
+    //select the grid value source once per evaluation, not per point
+    const float* probabilityPlane = concreteGridMap->getProbabilityPlane();
+
+    if (probabilityPlane) {
+      getCompleteHessianDerivs(PlaneGridValues(probabilityPlane), pose, dataPoints, H, dTr, residual);
+    } else {
+      getCompleteHessianDerivs(getCachedGridValues(), pose, dataPoints, H, dTr, residual);
+    }
+  }
+
+  template<typename GridValues>
+  void getCompleteHessianDerivs(const GridValues& gridValues, const Eigen::Vector3f& pose, const DataContainerView& dataPoints, Eigen::Matrix3f& H, Eigen::Vector3f& dTr, float& residual)
   {
     int size = dataPoints.getSize();
 
-    Eigen::Affine2f transform(getTransformForState(pose));
+    //the view scale factor is folded into the transform so the unscaled point arrays can be used directly
+    float scaleFactor = dataPoints.getScaleFactor();
 
-    float sinRot = sin(pose[2]);
-    float cosRot = cos(pose[2]);
+    Eigen::Affine2f transform(getTransformForState(pose) * Eigen::Scaling(scaleFactor));
+
+    float sinRot = sin(pose[2]) * scaleFactor;
+    float cosRot = cos(pose[2]) * scaleFactor;
+
+    const float* pointsX = dataPoints.getXArray();
+    const float* pointsY = dataPoints.getYArray();
 
     H = Eigen::Matrix3f::Zero();
     dTr = Eigen::Vector3f::Zero();
+    residual = 0.0f;
 
-    for (int i = 0; i < size; ++i) {
+    int i = 0;
+
+#ifdef SLAM_USE_SIMD
+    i = getHessianDerivsBatched(gridValues, transform, sinRot, cosRot, pointsX, pointsY, size, H, dTr, residual);
+#endif
 
-      const Eigen::Vector2f& currPoint (dataPoints.getVecEntry(i));
+    //scalar path for remaining points that do not fill a complete batch
+    for (; i < size; ++i) {
 
-      Eigen::Vector3f transformedPointData(interpMapValueWithDerivatives(transform * currPoint));
+      const Eigen::Vector2f currPoint (pointsX[i], pointsY[i]);
+
+      Eigen::Vector3f transformedPointData(interpMapValueWithDerivatives(gridValues, transform * currPoint));
 
       float funVal = 1.0f - transformedPointData[0];
 
+      residual += funVal * funVal;
+
       dTr[0] += transformedPointData[1] * funVal;
       dTr[1] += transformedPointData[2] * funVal;
 
@@ -103,7 +175,148 @@ public:
 
   }
 
-  Eigen::Matrix3f getCovarianceForPose(const Eigen::Vector3f& mapPose, const DataContainer& dataPoints)
+#ifdef SLAM_USE_SIMD
+  /**
+   * Batched version of the getCompleteHessianDerivs() inner loop. Transforms, interpolates and accumulates
+   * simd::width points at once. Only the cache lookups of the 4 grid points surrounding each point are done per lane.
+   * @return The number of points processed, the remaining (size % simd::width) points have to be handled by the caller.
+   */
+  template<typename GridValues>
+  int getHessianDerivsBatched(const GridValues& gridValues, const Eigen::Affine2f& transform, float sinRot, float cosRot, const float* pointsX, const float* pointsY, int size, Eigen::Matrix3f& H, Eigen::Vector3f& dTr, float& residual)
+  {
+    int numBatched = size - (size % simd::width);
+
+    if (numBatched == 0) {
+      return 0;
+    }
+
+    const Eigen::Matrix3f& transMat (transform.matrix());
+
+    const simd::Floats t00 (simd::set1(transMat(0,0)));
+    const simd::Floats t01 (simd::set1(transMat(0,1)));
+    const simd::Floats t10 (simd::set1(transMat(1,0)));
+    const simd::Floats t11 (simd::set1(transMat(1,1)));
+    const simd::Floats t02 (simd::set1(transMat(0,2)));
+    const simd::Floats t12 (simd::set1(transMat(1,2)));
+
+    const simd::Floats sinRotV (simd::set1(sinRot));
+    const simd::Floats cosRotV (simd::set1(cosRot));
+    const simd::Floats one (simd::set1(1.0f));
+    const simd::Floats zero (simd::zero());
+
+    const Eigen::Vector2f& mapLimits (concreteGridMap->getMapDimProperties().getMapLimits());
+    const simd::Floats limitX (simd::set1(mapLimits[0]));
+    const simd::Floats limitY (simd::set1(mapLimits[1]));
+
+    int indices[4];
+
+    simd::Floats dTr0 (zero), dTr1 (zero), dTr2 (zero), res (zero);
+    simd::Floats h00 (zero), h11 (zero), h22 (zero), h01 (zero), h02 (zero), h12 (zero);
+
+    int indX[simd::width];
+    int indY[simd::width];
+    float val[4][simd::width];
+
+    for (int i = 0; i < numBatched; i += simd::width) {
+
+      simd::Floats pointX (simd::load(pointsX + i));
+      simd::Floats pointY (simd::load(pointsY + i));
+
+      simd::Floats coordX (simd::add(simd::add(simd::mul(t00, pointX), simd::mul(t01, pointY)), t02));
+      simd::Floats coordY (simd::add(simd::add(simd::mul(t10, pointX), simd::mul(t11, pointY)), t12));
+
+      //same check as pointOutOfMapBounds, out of bounds lanes get zero grid values and thus do not contribute
+      simd::Floats outOfBounds (simd::orMask(simd::orMask(simd::lessThan(coordX, zero), simd::greaterThan(coordX, limitX)),
+                                             simd::orMask(simd::lessThan(coordY, zero), simd::greaterThan(coordY, limitY))));
+
+      coordX = simd::clearMasked(outOfBounds, coordX);
+      coordY = simd::clearMasked(outOfBounds, coordY);
+
+      //map coords are always positive, floor them by truncating
+      simd::Ints indMinX (simd::truncate(coordX));
+      simd::Ints indMinY (simd::truncate(coordY));
+
+      simd::Floats factorX (simd::sub(coordX, simd::toFloats(indMinX)));
+      simd::Floats factorY (simd::sub(coordY, simd::toFloats(indMinY)));
+
+      simd::store(indX, indMinX);
+      simd::store(indY, indMinY);
+
+      int outOfBoundsBits = simd::moveMask(outOfBounds);
+
+      for (int lane = 0; lane < simd::width; ++lane) {
+        if (outOfBoundsBits & (1 << lane)) {
+          val[0][lane] = 0.0f;
+          val[1][lane] = 0.0f;
+          val[2][lane] = 0.0f;
+          val[3][lane] = 0.0f;
+        } else {
+          concreteGridMap->getInterpolationIndices(indX[lane], indY[lane], indices);
+
+          val[0][lane] = gridValues(indices[0]);
+          val[1][lane] = gridValues(indices[1]);
+          val[2][lane] = gridValues(indices[2]);
+          val[3][lane] = gridValues(indices[3]);
+        }
+      }
+
+      simd::Floats intensity0 (simd::load(val[0]));
+      simd::Floats intensity1 (simd::load(val[1]));
+      simd::Floats intensity2 (simd::load(val[2]));
+      simd::Floats intensity3 (simd::load(val[3]));
+
+      simd::Floats xFacInv (simd::sub(one, factorX));
+      simd::Floats yFacInv (simd::sub(one, factorY));
+
+      //same interpolation and derivative terms as interpMapValueWithDerivatives
+      simd::Floats mapValue (simd::add(simd::mul(simd::add(simd::mul(intensity0, xFacInv), simd::mul(intensity1, factorX)), yFacInv),
+                                       simd::mul(simd::add(simd::mul(intensity2, xFacInv), simd::mul(intensity3, factorX)), factorY)));
+
+      simd::Floats derivX (simd::sub(zero, simd::add(simd::mul(simd::sub(intensity0, intensity1), xFacInv),
+                                                     simd::mul(simd::sub(intensity2, intensity3), factorX))));
+
+      simd::Floats derivY (simd::sub(zero, simd::add(simd::mul(simd::sub(intensity0, intensity2), yFacInv),
+                                                     simd::mul(simd::sub(intensity1, intensity3), factorY))));
+
+      simd::Floats funVal (simd::sub(one, mapValue));
+
+      simd::Floats rotDeriv (simd::add(simd::mul(simd::sub(simd::sub(zero, simd::mul(sinRotV, pointX)), simd::mul(cosRotV, pointY)), derivX),
+                                       simd::mul(simd::sub(simd::mul(cosRotV, pointX), simd::mul(sinRotV, pointY)), derivY)));
+
+      res = simd::add(res, simd::mul(funVal, funVal));
+
+      dTr0 = simd::add(dTr0, simd::mul(derivX, funVal));
+      dTr1 = simd::add(dTr1, simd::mul(derivY, funVal));
+      dTr2 = simd::add(dTr2, simd::mul(rotDeriv, funVal));
+
+      h00 = simd::add(h00, simd::mul(derivX, derivX));
+      h11 = simd::add(h11, simd::mul(derivY, derivY));
+      h22 = simd::add(h22, simd::mul(rotDeriv, rotDeriv));
+
+      h01 = simd::add(h01, simd::mul(derivX, derivY));
+      h02 = simd::add(h02, simd::mul(derivX, rotDeriv));
+      h12 = simd::add(h12, simd::mul(derivY, rotDeriv));
+    }
+
+    residual += simd::horizontalSum(res);
+
+    dTr[0] += simd::horizontalSum(dTr0);
+    dTr[1] += simd::horizontalSum(dTr1);
+    dTr[2] += simd::horizontalSum(dTr2);
+
+    H(0, 0) += simd::horizontalSum(h00);
+    H(1, 1) += simd::horizontalSum(h11);
+    H(2, 2) += simd::horizontalSum(h22);
+
+    H(0, 1) += simd::horizontalSum(h01);
+    H(0, 2) += simd::horizontalSum(h02);
+    H(1, 2) += simd::horizontalSum(h12);
+
+    return numBatched;
+  }
+#endif
+
+  Eigen::Matrix3f getCovarianceForPose(const Eigen::Vector3f& mapPose, const DataContainerView& dataPoints)
   {
 
     float deltaTransX = 1.5f;
@@ -186,7 +399,7 @@ public:
     return covMatWorld;
   }
 
-  float getLikelihoodForState(const Eigen::Vector3f& state, const DataContainer& dataPoints)
+  float getLikelihoodForState(const Eigen::Vector3f& state, const DataContainerView& dataPoints)
   {
     float resid = getResidualForState(state, dataPoints);
 
@@ -201,7 +414,19 @@ public:
     return 1 - (residual / sizef);
   }
 
-  float getResidualForState(const Eigen::Vector3f& state, const DataContainer& dataPoints)
+  float getResidualForState(const Eigen::Vector3f& state, const DataContainerView& dataPoints)
+  {
+    const float* probabilityPlane = concreteGridMap->getProbabilityPlane();
+
+    if (probabilityPlane) {
+      return getResidualForState(PlaneGridValues(probabilityPlane), state, dataPoints);
+    } else {
+      return getResidualForState(getCachedGridValues(), state, dataPoints);
+    }
+  }
+
+  template<typename GridValues>
+  float getResidualForState(const GridValues& gridValues, const Eigen::Vector3f& state, const DataContainerView& dataPoints)
   {
     int size = dataPoints.getSize();
 
@@ -209,11 +434,14 @@ public:
     float residual = 0.0f;
 
 
-    Eigen::Affine2f transform(getTransformForState(state));
+    Eigen::Affine2f transform(getTransformForState(state) * Eigen::Scaling(dataPoints.getScaleFactor()));
+
+    const float* pointsX = dataPoints.getXArray();
+    const float* pointsY = dataPoints.getYArray();
 
     for (int i = 0; i < size; i += stepSize) {
 
-      float funval = 1.0f - interpMapValue(transform * dataPoints.getVecEntry(i));
+      float funval = 1.0f - interpMapValue(gridValues, transform * Eigen::Vector2f(pointsX[i], pointsY[i]));
       residual += funval;
     }
 
@@ -230,7 +458,34 @@ public:
     return (concreteGridMap->getGridProbabilityMap(index));
   }
 
+  /**
+   * Returns the grid value at index, using the cache if possible.
+   */
+  float getCachedGridPoint(int index)
+  {
+    float val;
+
+    if (!cacheMethod.containsCachedData(index, val)) {
+      val = getUnfilteredGridPoint(index);
+      cacheMethod.cacheData(index, val);
+    }
+
+    return val;
+  }
+
   float interpMapValue(const Eigen::Vector2f& coords)
+  {
+    const float* probabilityPlane = concreteGridMap->getProbabilityPlane();
+
+    if (probabilityPlane) {
+      return interpMapValue(PlaneGridValues(probabilityPlane), coords);
+    } else {
+      return interpMapValue(getCachedGridValues(), coords);
+    }
+  }
+
+  template<typename GridValues>
+  float interpMapValue(const GridValues& gridValues, const Eigen::Vector2f& coords)
   {
     //check if coords are within map limits.
     if (concreteGridMap->pointOutOfMapBounds(coords)){
@@ -243,37 +498,16 @@ public:
     //get factors for bilinear interpolation
     Eigen::Vector2f factors(coords - indMin.cast<float>());
 
-    int sizeX = concreteGridMap->getSizeX();
-
-    int index = indMin[1] * sizeX + indMin[0];
+    //storage indices of the 4 grid points surrounding the current coords, these depend on the map's cell layout
+    int indices[4];
+    concreteGridMap->getInterpolationIndices(indMin[0], indMin[1], indices);
 
-    // get grid values for the 4 grid points surrounding the current coords. Check cached data first, if not contained
-    // filter gridPoint with gaussian and store in cache.
-    if (!cacheMethod.containsCachedData(index, intensities[0])) {
-      intensities[0] = getUnfilteredGridPoint(index);
-      cacheMethod.cacheData(index, intensities[0]);
-    }
-
-    ++index;
-
-    if (!cacheMethod.containsCachedData(index, intensities[1])) {
-      intensities[1] = getUnfilteredGridPoint(index);
-      cacheMethod.cacheData(index, intensities[1]);
-    }
-
-    index += sizeX-1;
-
-    if (!cacheMethod.containsCachedData(index, intensities[2])) {
-      intensities[2] = getUnfilteredGridPoint(index);
-      cacheMethod.cacheData(index, intensities[2]);
-    }
-
-    ++index;
-
-    if (!cacheMethod.containsCachedData(index, intensities[3])) {
-      intensities[3] = getUnfilteredGridPoint(index);
-      cacheMethod.cacheData(index, intensities[3]);
-    }
+    // get grid values for the 4 grid points surrounding the current coords, either from the probability plane or
+    // from the cache.
+    intensities[0] = gridValues(indices[0]);
+    intensities[1] = gridValues(indices[1]);
+    intensities[2] = gridValues(indices[2]);
+    intensities[3] = gridValues(indices[3]);
 
     float xFacInv = (1.0f - factors[0]);
     float yFacInv = (1.0f - factors[1]);
@@ -285,6 +519,18 @@ public:
   }
 
   Eigen::Vector3f interpMapValueWithDerivatives(const Eigen::Vector2f& coords)
+  {
+    const float* probabilityPlane = concreteGridMap->getProbabilityPlane();
+
+    if (probabilityPlane) {
+      return interpMapValueWithDerivatives(PlaneGridValues(probabilityPlane), coords);
+    } else {
+      return interpMapValueWithDerivatives(getCachedGridValues(), coords);
+    }
+  }
+
+  template<typename GridValues>
+  Eigen::Vector3f interpMapValueWithDerivatives(const GridValues& gridValues, const Eigen::Vector2f& coords)
   {
     //check if coords are within map limits.
     if (concreteGridMap->pointOutOfMapBounds(coords)){
@@ -297,37 +543,16 @@ public:
     //get factors for bilinear interpolation
     Eigen::Vector2f factors(coords - indMin.cast<float>());
 
-    int sizeX = concreteGridMap->getSizeX();
+    //storage indices of the 4 grid points surrounding the current coords, these depend on the map's cell layout
+    int indices[4];
+    concreteGridMap->getInterpolationIndices(indMin[0], indMin[1], indices);
 
-    int index = indMin[1] * sizeX + indMin[0];
-
-    // get grid values for the 4 grid points surrounding the current coords. Check cached data first, if not contained
-    // filter gridPoint with gaussian and store in cache.
-    if (!cacheMethod.containsCachedData(index, intensities[0])) {
-      intensities[0] = getUnfilteredGridPoint(index);
-      cacheMethod.cacheData(index, intensities[0]);
-    }
-
-    ++index;
-
-    if (!cacheMethod.containsCachedData(index, intensities[1])) {
-      intensities[1] = getUnfilteredGridPoint(index);
-      cacheMethod.cacheData(index, intensities[1]);
-    }
-
-    index += sizeX-1;
-
-    if (!cacheMethod.containsCachedData(index, intensities[2])) {
-      intensities[2] = getUnfilteredGridPoint(index);
-      cacheMethod.cacheData(index, intensities[2]);
-    }
-
-    ++index;
-
-    if (!cacheMethod.containsCachedData(index, intensities[3])) {
-      intensities[3] = getUnfilteredGridPoint(index);
-      cacheMethod.cacheData(index, intensities[3]);
-    }
+    // get grid values for the 4 grid points surrounding the current coords, either from the probability plane or
+    // from the cache.
+    intensities[0] = gridValues(indices[0]);
+    intensities[1] = gridValues(indices[1]);
+    intensities[2] = gridValues(indices[2]);
+    intensities[3] = gridValues(indices[3]);
 
     float dx1 = intensities[0] - intensities[1];
     float dx2 = intensities[2] - intensities[3];
@@ -31,6 +31,11 @@
 
 #include "OccGridMapUtil.h"
 
+//#define SLAM_USE_LIKELIHOOD_FIELD
+#ifdef SLAM_USE_LIKELIHOOD_FIELD
+#include "OccGridMapUtilLikelihoodField.h"
+#endif
+
 //#define SLAM_USE_HASH_CACHING
 #ifdef SLAM_USE_HASH_CACHING
 #include "GridMapCacheHash.h"
@@ -42,6 +47,18 @@ typedef GridMapCacheArray GridMapCacheMethod;
 
 namespace hectorslam {
 
+#ifdef SLAM_USE_LIKELIHOOD_FIELD
+template<typename ConcreteOccGridMap>
+class OccGridMapUtilConfig
+  : public OccGridMapUtilLikelihoodField<ConcreteOccGridMap, GridMapCacheMethod>
+{
+public:
+
+  OccGridMapUtilConfig(ConcreteOccGridMap* gridMap = 0)
+    : OccGridMapUtilLikelihoodField<ConcreteOccGridMap, GridMapCacheMethod>(gridMap)
+  {}
+};
+#else
 template<typename ConcreteOccGridMap>
 class OccGridMapUtilConfig
   : public OccGridMapUtil<ConcreteOccGridMap, GridMapCacheMethod>
@@ -52,6 +69,7 @@ public:
     : OccGridMapUtil<ConcreteOccGridMap, GridMapCacheMethod>(gridMap)
   {}
 };
+#endif
 
 }
 
@@ -0,0 +1,226 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef __OccGridMapUtilLikelihoodField_h_
+#define __OccGridMapUtilLikelihoodField_h_
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "OccGridMapUtil.h"
+
+namespace hectorslam {
+
+/**
+ * OccGridMapUtil variant matching against a likelihood field instead of the occupancy probabilities. The field value
+ * of a cell is exp(-d^2 / (2 sigma^2)), with d the distance (in cells) to the nearest occupied cell, or 0 if that is
+ * farther than maxDistance. Unlike the probabilities, which only change within a cell of an obstacle, the field
+ * has gradients pointing to the obstacles from up to maxDistance cells away, which widens the convergence basin.
+ * The field is kept in sync with the map lazily when it is evaluated, only recomputing the area changed by the
+ * map updates since (see OccGridMapBase::getUpdateAreaSince()).
+ */
+template<typename ConcreteOccGridMap, typename ConcreteCacheMethod>
+class OccGridMapUtilLikelihoodField
+  : public OccGridMapUtil<ConcreteOccGridMap, ConcreteCacheMethod>
+{
+public:
+
+  typedef OccGridMapUtil<ConcreteOccGridMap, ConcreteCacheMethod> OccGridMapUtilBase;
+  typedef typename OccGridMapUtilBase::PlaneGridValues FieldGridValues;
+
+  using OccGridMapUtilBase::getCompleteHessianDerivs;
+  using OccGridMapUtilBase::getResidualForState;
+  using OccGridMapUtilBase::interpMapValue;
+  using OccGridMapUtilBase::interpMapValueWithDerivatives;
+
+  OccGridMapUtilLikelihoodField(const ConcreteOccGridMap* gridMap)
+    : OccGridMapUtilBase(gridMap)
+    , fieldUpdateIndex(-1)
+  {
+    this->setFieldParameters(1.5f, 5);
+  }
+
+  /**
+   * Sets the standard deviation (in cells) of the field values and the distance (in cells) beyond which obstacles
+   * are ignored. The field is recomputed completely with the next evaluation.
+   */
+  void setFieldParameters(float sigma, int maxDistanceIn)
+  {
+    maxDistance = std::max(0, maxDistanceIn);
+
+    int kernelSize = 2 * maxDistance + 1;
+    kernel.resize(kernelSize * kernelSize);
+
+    float factor = -1.0f / (2.0f * sigma * sigma);
+    int maxDistanceSquared = maxDistance * maxDistance;
+
+    for (int y = -maxDistance; y <= maxDistance; ++y) {
+      for (int x = -maxDistance; x <= maxDistance; ++x) {
+        int distanceSquared = x * x + y * y;
+        kernel[(y + maxDistance) * kernelSize + (x + maxDistance)] = (distanceSquared <= maxDistanceSquared) ? std::exp(factor * static_cast<float>(distanceSquared)) : 0.0f;
+      }
+    }
+
+    field.clear();
+  }
+
+  void getCompleteHessianDerivs(const Eigen::Vector3f& pose, const DataContainerView& dataPoints, Eigen::Matrix3f& H, Eigen::Vector3f& dTr)
+  {
+    float residual;
+    getCompleteHessianDerivs(pose, dataPoints, H, dTr, residual);
+  }
+
+  void getCompleteHessianDerivs(const Eigen::Vector3f& pose, const DataContainerView& dataPoints, Eigen::Matrix3f& H, Eigen::Vector3f& dTr, float& residual)
+  {
+    this->updateField();
+    getCompleteHessianDerivs(FieldGridValues(&field[0]), pose, dataPoints, H, dTr, residual);
+  }
+
+  float getResidualForState(const Eigen::Vector3f& state, const DataContainerView& dataPoints)
+  {
+    this->updateField();
+    return getResidualForState(FieldGridValues(&field[0]), state, dataPoints);
+  }
+
+  float interpMapValue(const Eigen::Vector2f& coords)
+  {
+    this->updateField();
+    return interpMapValue(FieldGridValues(&field[0]), coords);
+  }
+
+  Eigen::Vector3f interpMapValueWithDerivatives(const Eigen::Vector2f& coords)
+  {
+    this->updateField();
+    return interpMapValueWithDerivatives(FieldGridValues(&field[0]), coords);
+  }
+
+  /**
+   * Returns the field indexed by storage index, synced with the map.
+   */
+  const float* getField()
+  {
+    this->updateField();
+    return &field[0];
+  }
+
+protected:
+
+  void updateField()
+  {
+    const ConcreteOccGridMap* gridMap = this->concreteGridMap;
+
+    int mapUpdateIndex = gridMap->getUpdateIndex();
+
+    if (!field.empty() && (mapUpdateIndex == fieldUpdateIndex)) {
+      return;
+    }
+
+    Eigen::Vector2i areaMin;
+    Eigen::Vector2i areaMax;
+
+    //sparse maps grow their storage, the field is rebuilt for the allocated area then
+    if (field.empty() || (static_cast<int>(field.size()) != gridMap->getStorageSize()) ||
+        !gridMap->getUpdateAreaSince(fieldUpdateIndex, areaMin, areaMax)) {
+      field.assign(gridMap->getStorageSize(), 0.0f);
+      gridMap->getAllocatedArea(areaMin, areaMax);
+    } else {
+      //changed obstacles influence the field up to maxDistance away
+      areaMin = (areaMin.array() - maxDistance).matrix().cwiseMax(Eigen::Vector2i::Zero());
+      areaMax = (areaMax.array() + maxDistance).matrix().cwiseMin(Eigen::Vector2i(gridMap->getSizeX() - 1, gridMap->getSizeY() - 1));
+    }
+
+    if ((areaMin[0] <= areaMax[0]) && (areaMin[1] <= areaMax[1])) {
+      this->computeFieldArea(areaMin, areaMax);
+    }
+
+    fieldUpdateIndex = mapUpdateIndex;
+  }
+
+  /**
+   * Recomputes the field for the cells in [areaMin, areaMax], from the occupied cells within maxDistance of it.
+   */
+  void computeFieldArea(const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+  {
+    const ConcreteOccGridMap* gridMap = this->concreteGridMap;
+
+    for (int y = areaMin[1]; y <= areaMax[1]; ++y) {
+      for (int x = areaMin[0]; x <= areaMax[0]; ++x) {
+        field[gridMap->getCellIndex(x, y)] = 0.0f;
+      }
+    }
+
+    int sourceMinX = std::max(0, areaMin[0] - maxDistance);
+    int sourceMinY = std::max(0, areaMin[1] - maxDistance);
+    int sourceMaxX = std::min(gridMap->getSizeX() - 1, areaMax[0] + maxDistance);
+    int sourceMaxY = std::min(gridMap->getSizeY() - 1, areaMax[1] + maxDistance);
+
+    int kernelSize = 2 * maxDistance + 1;
+
+    //every occupied cell raises the field around it to the kernel values, clipped to the area
+    for (int y = sourceMinY; y <= sourceMaxY; ++y) {
+      for (int x = sourceMinX; x <= sourceMaxX; ++x) {
+
+        if (!gridMap->isOccupied(gridMap->getCellIndex(x, y))) {
+          continue;
+        }
+
+        int minKernelY = std::max(-maxDistance, areaMin[1] - y);
+        int maxKernelY = std::min(maxDistance, areaMax[1] - y);
+        int minKernelX = std::max(-maxDistance, areaMin[0] - x);
+        int maxKernelX = std::min(maxDistance, areaMax[0] - x);
+
+        for (int ky = minKernelY; ky <= maxKernelY; ++ky) {
+          const float* kernelRow = &kernel[(ky + maxDistance) * kernelSize + maxDistance];
+
+          for (int kx = minKernelX; kx <= maxKernelX; ++kx) {
+
+            //unallocated cells share the storage of the default cell, their field stays 0
+            if (!gridMap->isCellAllocated(x + kx, y + ky)) {
+              continue;
+            }
+
+            float& value (field[gridMap->getCellIndex(x + kx, y + ky)]);
+            value = std::max(value, kernelRow[kx]);
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<float> field; ///< Field values by storage index, empty if not computed yet
+  int fieldUpdateIndex;     ///< Map update index the field corresponds to
+
+  std::vector<float> kernel;
+  int maxDistance;
+};
+
+}
+
+#endif
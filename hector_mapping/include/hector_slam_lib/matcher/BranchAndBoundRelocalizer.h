@@ -0,0 +1,502 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef __BranchAndBoundRelocalizer_h_
+#define __BranchAndBoundRelocalizer_h_
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Core>
+
+#include "../scan/DataPointContainer.h"
+#include "../util/WorkerPool.h"
+
+namespace hectorslam{
+
+/**
+ * Correlative scan matcher for (re)localizing a scan in a known map without a good initial guess. All poses inside
+ * an x/y/yaw window around the guess are scored by the mean occupancy probability at the scan endpoints, using a
+ * translational resolution of one map cell. Branch and bound over a stack of max-pooled copies of the map makes this
+ * exact search cheap: a cell of pooling depth h holds the maximum of the 2^h x 2^h cells starting at it, so it bounds
+ * the score of every translation in such a block and whole blocks can be discarded at once. The yaw candidates are
+ * searched in parallel on the worker pool.
+ * The result is only as precise as the search resolution and is meant as start estimate for the regular matcher.
+ */
+template<typename ConcreteOccGridMap>
+class BranchAndBoundRelocalizer
+{
+public:
+
+  BranchAndBoundRelocalizer(WorkerPool* workerPoolIn = 0)
+    : workerPool(workerPoolIn)
+    , linearWindow(1.0f)
+    , angularWindow(static_cast<float>(M_PI))
+    , angularStep(0.0f)
+    , maxDepth(7)
+    , minScore(0.55f)
+  {}
+
+  /**
+   * Sets the search window, the pose is searched within +-linearWindowIn (in m) and +-angularWindowIn (in rad)
+   * around the guess.
+   */
+  void setSearchWindow(float linearWindowIn, float angularWindowIn)
+  {
+    linearWindow = linearWindowIn;
+    angularWindow = angularWindowIn;
+  }
+
+  /**
+   * Sets the yaw resolution in rad. With 0 (the default) it is chosen so that the farthest scan endpoint moves
+   * by about one cell per step.
+   */
+  void setAngularStep(float angularStepIn) { angularStep = angularStepIn; };
+
+  /**
+   * Sets the number of max-pooled maps, the largest block of translations bounded at once has 2^maxDepthIn cells side length.
+   */
+  void setMaxDepth(int maxDepthIn) { maxDepth = std::max(0, maxDepthIn); };
+
+  /**
+   * Sets the minimum score (mean occupancy probability in [0,1]) a pose needs to be accepted. Poses scoring
+   * lower are never expanded, so higher values also make the search faster.
+   */
+  void setMinScore(float minScoreIn) { minScore = minScoreIn; };
+
+  void setWorkerPool(WorkerPool* workerPoolIn) { workerPool = workerPoolIn; };
+
+  /**
+   * Searches the best pose for dataContainer (scaled to gridMap, as for matching) around guessPoseWorld.
+   * @return False if no pose in the window reaches the minimum score, poseWorld and score are unchanged then
+   */
+  bool relocalize(const ConcreteOccGridMap& gridMap, const DataContainer& dataContainer, const Eigen::Vector3f& guessPoseWorld, Eigen::Vector3f& poseWorld, float& score)
+  {
+    this->copyMap(gridMap, dataContainer, guessPoseWorld);
+    return this->search(poseWorld, score);
+  }
+
+  /**
+   * First step of relocalize(): copies the part of gridMap the search for dataContainer around guessPoseWorld can
+   * reach. This is the only step reading the map, lock it just for this call if it is updated concurrently.
+   * dataContainer has to stay valid until search() returns.
+   */
+  void copyMap(const ConcreteOccGridMap& gridMap, const DataContainer& dataContainer, const Eigen::Vector3f& guessPoseWorldIn)
+  {
+    scan = &dataContainer;
+    guessPoseWorld = guessPoseWorldIn;
+    guessPoseMap = gridMap.getMapCoordsPose(guessPoseWorld);
+    cellLength = gridMap.getCellLength();
+
+    int numPoints = dataContainer.getSize();
+
+    if (numPoints == 0) {
+      pooledMaps.clear();
+      return;
+    }
+
+    float maxRangeSquared = 0.0f;
+
+    for (int i = 0; i < numPoints; ++i) {
+      maxRangeSquared = std::max(maxRangeSquared, dataContainer.getVecEntry(i).squaredNorm());
+    }
+
+    float maxRange = std::sqrt(maxRangeSquared);
+
+    float yawStep = angularStep;
+
+    if (yawStep <= 0.0f) {
+      yawStep = (maxRange > 1.0f) ? std::acos(1.0f - 0.5f / maxRangeSquared) : angularWindow;
+    }
+
+    numYawSteps = (yawStep > 0.0f) ? static_cast<int>(std::ceil(angularWindow / yawStep)) : 0;
+    yawStepSize = yawStep;
+
+    windowCells = static_cast<int>(std::ceil(linearWindow * gridMap.getScaleToMap()));
+
+    topDepth = 0;
+
+    while ((topDepth < maxDepth) && ((1 << topDepth) < (2 * windowCells + 1))) {
+      ++topDepth;
+    }
+
+    this->copyBaseMap(gridMap, static_cast<int>(std::ceil(maxRange)) + windowCells + 1);
+  }
+
+  /**
+   * Second step of relocalize(): searches the map copied by copyMap(), the map itself is not accessed.
+   * @return False if no pose in the window reaches the minimum score, poseWorld and score are unchanged then
+   */
+  bool search(Eigen::Vector3f& poseWorld, float& score)
+  {
+    if (pooledMaps.empty()) {
+      return false;
+    }
+
+    this->buildPooledMaps();
+
+    int numYaws = 2 * numYawSteps + 1;
+
+    yawResults.assign(numYaws, YawResult());
+
+    if (workerPool) {
+      workerPool->parallelFor(numYaws, YawSearchTask(this));
+    } else {
+      this->searchYaws(0, numYaws);
+    }
+
+    //ties go to the pose closest to the guess, independent of how the yaws were distributed over the threads
+    int bestYaw = -1;
+
+    for (int i = 0; i < numYaws; ++i) {
+      const YawResult& result (yawResults[i]);
+
+      if (result.score < 0.0f) {
+        continue;
+      }
+
+      if ((bestYaw < 0) || (result.score > yawResults[bestYaw].score) ||
+          ((result.score == yawResults[bestYaw].score) && (std::abs(i - numYawSteps) < std::abs(bestYaw - numYawSteps)))) {
+        bestYaw = i;
+      }
+    }
+
+    if (bestYaw < 0) {
+      return false;
+    }
+
+    const YawResult& best (yawResults[bestYaw]);
+
+    //map and world axes are aligned, the cell offsets to the guess only need scaling
+    poseWorld = Eigen::Vector3f(guessPoseWorld[0] + static_cast<float>(best.x) * cellLength,
+                                guessPoseWorld[1] + static_cast<float>(best.y) * cellLength,
+                                guessPoseWorld[2] + static_cast<float>(bestYaw - numYawSteps) * yawStepSize);
+    score = best.score;
+    return true;
+  }
+
+protected:
+
+  /**
+   * Map copy covering [originX, originX + sizeX) x [originY, originY + sizeY) in map cells, zero outside.
+   */
+  struct PooledMap
+  {
+    float get(int x, int y) const
+    {
+      x -= originX;
+      y -= originY;
+
+      if ((x < 0) || (y < 0) || (x >= sizeX) || (y >= sizeY)) {
+        return 0.0f;
+      }
+
+      return values[y * sizeX + x];
+    }
+
+    int originX;
+    int originY;
+    int sizeX;
+    int sizeY;
+    std::vector<float> values;
+  };
+
+  struct YawResult
+  {
+    YawResult() : x(0), y(0), score(-1.0f) {};
+
+    int x;
+    int y;
+    float score;
+  };
+
+  struct Candidate
+  {
+    Candidate(int xIn, int yIn, int depthIn) : x(xIn), y(yIn), depth(depthIn), bound(0.0f) {};
+
+    bool operator<(const Candidate& other) const { return bound < other.bound; };
+
+    int x;
+    int y;
+    int depth;
+    float bound;
+  };
+
+  struct YawSearchTask
+  {
+    YawSearchTask(BranchAndBoundRelocalizer* relocalizerIn) : relocalizer(relocalizerIn) {};
+
+    void operator()(int begin, int end) const { relocalizer->searchYaws(begin, end); };
+
+    BranchAndBoundRelocalizer* relocalizer;
+  };
+
+  struct PoolRowsTask
+  {
+    PoolRowsTask(BranchAndBoundRelocalizer* relocalizerIn, int depthIn) : relocalizer(relocalizerIn), depth(depthIn) {};
+
+    void operator()(int begin, int end) const { relocalizer->poolRows(depth, begin, end); };
+
+    BranchAndBoundRelocalizer* relocalizer;
+    int depth;
+  };
+
+  /**
+   * Copies the probabilities of the cells within radius of the guess into the unpooled map.
+   */
+  void copyBaseMap(const ConcreteOccGridMap& gridMap, int radius)
+  {
+    int centerX = static_cast<int>(std::floor(guessPoseMap[0] + 0.5f));
+    int centerY = static_cast<int>(std::floor(guessPoseMap[1] + 0.5f));
+
+    int minX = std::max(0, centerX - radius);
+    int minY = std::max(0, centerY - radius);
+    int maxX = std::min(gridMap.getSizeX(), centerX + radius + 1);
+    int maxY = std::min(gridMap.getSizeY(), centerY + radius + 1);
+
+    pooledMaps.resize(topDepth + 1);
+
+    PooledMap& base (pooledMaps[0]);
+    base.originX = minX;
+    base.originY = minY;
+    base.sizeX = std::max(0, maxX - minX);
+    base.sizeY = std::max(0, maxY - minY);
+    base.values.resize(base.sizeX * base.sizeY);
+
+    for (int y = 0; y < base.sizeY; ++y) {
+      float* row = &base.values[y * base.sizeX];
+
+      for (int x = 0; x < base.sizeX; ++x) {
+        row[x] = gridMap.getGridProbabilityMap(gridMap.getCellIndex(minX + x, minY + y));
+      }
+    }
+  }
+
+  /**
+   * Builds the pooled maps from the copied one.
+   */
+  void buildPooledMaps()
+  {
+    const PooledMap& base (pooledMaps[0]);
+
+    //depth h extends 2^h - 1 cells further to the lower side, as blocks starting there still overlap the copied area
+    for (int depth = 1; depth <= topDepth; ++depth) {
+      int extension = (1 << depth) - 1;
+
+      PooledMap& pooled (pooledMaps[depth]);
+      pooled.originX = base.originX - extension;
+      pooled.originY = base.originY - extension;
+      pooled.sizeX = base.sizeX + extension;
+      pooled.sizeY = base.sizeY + extension;
+      pooled.values.resize(pooled.sizeX * pooled.sizeY);
+
+      if (workerPool) {
+        workerPool->parallelFor(pooled.sizeY, PoolRowsTask(this, depth));
+      } else {
+        this->poolRows(depth, 0, pooled.sizeY);
+      }
+    }
+  }
+
+  void poolRows(int depth, int beginRow, int endRow)
+  {
+    const PooledMap& finer (pooledMaps[depth - 1]);
+    PooledMap& pooled (pooledMaps[depth]);
+
+    int offset = 1 << (depth - 1);
+
+    for (int row = beginRow; row < endRow; ++row) {
+      int y = pooled.originY + row;
+      float* values = &pooled.values[row * pooled.sizeX];
+
+      for (int i = 0; i < pooled.sizeX; ++i) {
+        int x = pooled.originX + i;
+
+        values[i] = std::max(std::max(finer.get(x, y), finer.get(x + offset, y)),
+                             std::max(finer.get(x, y + offset), finer.get(x + offset, y + offset)));
+      }
+    }
+  }
+
+  /**
+   * Searches the yaw candidates [begin, end). The best score found in this range so far serves as pruning threshold
+   * for the following yaws, as only the overall best pose is of interest.
+   */
+  void searchYaws(int begin, int end)
+  {
+    std::vector<int> cellsX;
+    std::vector<int> cellsY;
+    std::vector<Candidate> stack;
+
+    float threshold = minScore;
+
+    for (int yawIndex = begin; yawIndex < end; ++yawIndex) {
+      this->discretizeScan(guessPoseMap[2] + static_cast<float>(yawIndex - numYawSteps) * yawStepSize, cellsX, cellsY);
+
+      YawResult& result (yawResults[yawIndex]);
+
+      this->searchTranslations(cellsX, cellsY, threshold, stack, result);
+
+      if (result.score > threshold) {
+        threshold = result.score;
+      }
+    }
+  }
+
+  /**
+   * Rounds the scan endpoints at the guessed position and the given yaw to map cells.
+   */
+  void discretizeScan(float yaw, std::vector<int>& cellsX, std::vector<int>& cellsY) const
+  {
+    int numPoints = scan->getSize();
+
+    cellsX.resize(numPoints);
+    cellsY.resize(numPoints);
+
+    float cosYaw = std::cos(yaw);
+    float sinYaw = std::sin(yaw);
+
+    const float* pointsX = scan->getXArray();
+    const float* pointsY = scan->getYArray();
+
+    for (int i = 0; i < numPoints; ++i) {
+      float x = guessPoseMap[0] + cosYaw * pointsX[i] - sinYaw * pointsY[i];
+      float y = guessPoseMap[1] + sinYaw * pointsX[i] + cosYaw * pointsY[i];
+
+      cellsX[i] = static_cast<int>(std::floor(x + 0.5f));
+      cellsY[i] = static_cast<int>(std::floor(y + 0.5f));
+    }
+  }
+
+  /**
+   * Depth first branch and bound over the translations [-windowCells, windowCells]^2. Candidates are expanded best
+   * bound first, so good leaves are found early and raise the threshold for the rest.
+   */
+  void searchTranslations(const std::vector<int>& cellsX, const std::vector<int>& cellsY, float threshold, std::vector<Candidate>& stack, YawResult& result) const
+  {
+    stack.clear();
+
+    int topStep = 1 << topDepth;
+
+    for (int y = -windowCells; y <= windowCells; y += topStep) {
+      for (int x = -windowCells; x <= windowCells; x += topStep) {
+        Candidate candidate(x, y, topDepth);
+        candidate.bound = this->getBound(cellsX, cellsY, candidate);
+        stack.push_back(candidate);
+      }
+    }
+
+    //ascending order, the best candidate is on top of the stack
+    std::sort(stack.begin(), stack.end());
+
+    while (!stack.empty()) {
+      Candidate candidate (stack.back());
+      stack.pop_back();
+
+      //ties are kept, the final selection between equally scored yaws must not depend on the search order
+      if (candidate.bound < threshold) {
+        continue;
+      }
+
+      if (candidate.depth == 0) {
+        if (candidate.bound > result.score) {
+          result.x = candidate.x;
+          result.y = candidate.y;
+          result.score = candidate.bound;
+          threshold = candidate.bound;
+        }
+        continue;
+      }
+
+      int childDepth = candidate.depth - 1;
+      int childStep = 1 << childDepth;
+
+      size_t firstChild = stack.size();
+
+      for (int dy = 0; dy < 2; ++dy) {
+        for (int dx = 0; dx < 2; ++dx) {
+          Candidate child(candidate.x + dx * childStep, candidate.y + dy * childStep, childDepth);
+
+          if ((child.x > windowCells) || (child.y > windowCells)) {
+            continue;
+          }
+
+          child.bound = this->getBound(cellsX, cellsY, child);
+
+          if (child.bound >= threshold) {
+            stack.push_back(child);
+          }
+        }
+      }
+
+      std::sort(stack.begin() + firstChild, stack.end());
+    }
+  }
+
+  float getBound(const std::vector<int>& cellsX, const std::vector<int>& cellsY, const Candidate& candidate) const
+  {
+    const PooledMap& pooled (pooledMaps[candidate.depth]);
+
+    int numPoints = static_cast<int>(cellsX.size());
+
+    float sum = 0.0f;
+
+    for (int i = 0; i < numPoints; ++i) {
+      sum += pooled.get(cellsX[i] + candidate.x, cellsY[i] + candidate.y);
+    }
+
+    return sum / static_cast<float>(numPoints);
+  }
+
+  WorkerPool* workerPool;
+
+  float linearWindow;
+  float angularWindow;
+  float angularStep;
+  int maxDepth;
+  float minScore;
+
+  //state of the current relocalize() call
+  const DataContainer* scan;
+  Eigen::Vector3f guessPoseWorld;
+  Eigen::Vector3f guessPoseMap;
+  float cellLength;
+  int windowCells;
+  int topDepth;
+  int numYawSteps;
+  float yawStepSize;
+
+  std::vector<PooledMap> pooledMaps;
+  std::vector<YawResult> yawResults;
+};
+
+}
+
+#endif
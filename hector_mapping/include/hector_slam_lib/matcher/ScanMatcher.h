@@ -36,8 +36,28 @@
 #include "../util/DrawInterface.h"
 #include "../util/HectorDebugInfoInterface.h"
 
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 namespace hectorslam{
 
+/**
+ * Iteration statistics of the last ScanMatcher::matchData() call.
+ */
+struct ScanMatchStatistics
+{
+  ScanMatchStatistics()
+    : numIterations(0)
+    , converged(false)
+    , timeBudgetExceeded(false)
+    , residual(0.0f)
+  {}
+
+  int numIterations;       ///< Gauss-Newton steps done
+  bool converged;          ///< True if stopped by the convergence criteria before maxIterations
+  bool timeBudgetExceeded; ///< True if stopped because the deadline passed
+  float residual;          ///< Mean squared residual at the last evaluated pose
+};
+
 template<typename ConcreteOccGridMapUtil>
 class ScanMatcher
 {
@@ -46,13 +66,44 @@ public:
   ScanMatcher(DrawInterface* drawInterfaceIn = 0, HectorDebugInfoInterface* debugInterfaceIn = 0)
     : drawInterface(drawInterfaceIn)
     , debugInterface(debugInterfaceIn)
+    , minStepTranslation(0.0f)
+    , minStepRotation(0.0f)
+    , minResidualChangeRatio(0.0f)
   {}
 
   ~ScanMatcher()
   {}
 
-  Eigen::Vector3f matchData(const Eigen::Vector3f& beginEstimateWorld, ConcreteOccGridMapUtil& gridMapUtil, const DataContainer& dataContainer, Eigen::Matrix3f& covMatrix, int maxIterations)
+  /**
+   * Sets the criteria for stopping before maxIterations. Matching stops once a step is smaller than minStepTranslationIn
+   * (in map cells) and minStepRotationIn (rad), or the residual changed by less than minResidualChangeRatioIn relative to
+   * the previous iteration. The step criterion needs both step thresholds, zero disables a criterion. All are disabled
+   * by default.
+   */
+  void setConvergenceCriteria(float minStepTranslationIn, float minStepRotationIn, float minResidualChangeRatioIn)
+  {
+    minStepTranslation = minStepTranslationIn;
+    minStepRotation = minStepRotationIn;
+    minResidualChangeRatio = minResidualChangeRatioIn;
+  }
+
+  void setDebugInterfaces(DrawInterface* drawInterfaceIn, HectorDebugInfoInterface* debugInterfaceIn)
+  {
+    drawInterface = drawInterfaceIn;
+    debugInterface = debugInterfaceIn;
+  }
+
+  const ScanMatchStatistics& getLastStatistics() const { return lastStatistics; };
+
+  /**
+   * Matches dataContainer against the map with up to maxIterations Gauss-Newton steps.
+   * @param deadline No further steps are started once this point in time has passed
+   */
+  Eigen::Vector3f matchData(const Eigen::Vector3f& beginEstimateWorld, ConcreteOccGridMapUtil& gridMapUtil, const DataContainerView& dataContainer, Eigen::Matrix3f& covMatrix, int maxIterations,
+                            const boost::posix_time::ptime& deadline = boost::posix_time::ptime(boost::posix_time::pos_infin))
   {
+    lastStatistics = ScanMatchStatistics();
+
     if (drawInterface){
       drawInterface->setScale(0.05f);
       drawInterface->setColor(0.0f,1.0f, 0.0f);
@@ -71,8 +122,7 @@ public:
 
       Eigen::Vector3f estimate(beginEstimateMap);
 
-      estimateTransformationLogLh(estimate, gridMapUtil, dataContainer);
-      //bool notConverged = estimateTransformationLogLh(estimate, gridMapUtil, dataContainer);
+      bool checkDeadline = !deadline.is_pos_infinity();
 
       /*
       const Eigen::Matrix2f& hessian (H.block<2,2>(0,0));
@@ -90,12 +140,23 @@ public:
 
       int numIter = maxIterations;
 
+      float lastResidual = -1.0f;
 
       for (int i = 0; i < numIter; ++i) {
         //std::cout << "\nest:\n" << estimate;
 
-        estimateTransformationLogLh(estimate, gridMapUtil, dataContainer);
-        //notConverged = estimateTransformationLogLh(estimate, gridMapUtil, dataContainer);
+        if (checkDeadline && (boost::posix_time::microsec_clock::universal_time() > deadline)) {
+          lastStatistics.timeBudgetExceeded = true;
+          break;
+        }
+
+        float residual;
+        Eigen::Vector3f step;
+
+        bool notConverged = estimateTransformationLogLh(estimate, gridMapUtil, dataContainer, residual, step);
+
+        ++lastStatistics.numIterations;
+        lastStatistics.residual = residual / static_cast<float>(dataContainer.getSize());
 
         if(drawInterface){
           float invNumIterf = 1.0f/static_cast<float> (numIter);
@@ -107,6 +168,18 @@ public:
         if(debugInterface){
           debugInterface->addHessianMatrix(H);
         }
+
+        //degenerate Hessian, further iterations would evaluate the same pose again
+        if (!notConverged) {
+          break;
+        }
+
+        if (hasConverged(step, residual, lastResidual)) {
+          lastStatistics.converged = true;
+          break;
+        }
+
+        lastResidual = residual;
       }
 
       if (drawInterface){
@@ -191,9 +264,24 @@ public:
 
 protected:
 
-  bool estimateTransformationLogLh(Eigen::Vector3f& estimate, ConcreteOccGridMapUtil& gridMapUtil, const DataContainer& dataPoints)
+  bool hasConverged(const Eigen::Vector3f& step, float residual, float lastResidual) const
+  {
+    if ((minStepTranslation > 0.0f) && (step.head<2>().norm() < minStepTranslation) && (std::fabs(step[2]) < minStepRotation)) {
+      return true;
+    }
+
+    return (minResidualChangeRatio > 0.0f) && (lastResidual > 0.0f) && (std::fabs(lastResidual - residual) < minResidualChangeRatio * lastResidual);
+  }
+
+  /**
+   * Does one Gauss-Newton step.
+   * @param residual Set to the residual at the pose before the step
+   * @param searchDir Set to the step taken
+   * @return False if the Hessian is degenerate and no step was taken
+   */
+  bool estimateTransformationLogLh(Eigen::Vector3f& estimate, ConcreteOccGridMapUtil& gridMapUtil, const DataContainerView& dataPoints, float& residual, Eigen::Vector3f& searchDir)
   {
-    gridMapUtil.getCompleteHessianDerivs(estimate, dataPoints, H, dTr);
+    gridMapUtil.getCompleteHessianDerivs(estimate, dataPoints, H, dTr, residual);
     //std::cout << "\nH\n" << H  << "\n";
     //std::cout << "\ndTr\n" << dTr  << "\n";
 
@@ -202,7 +290,7 @@ protected:
 
 
       //H += Eigen::Matrix3f::Identity() * 1.0f;
-      Eigen::Vector3f searchDir (H.inverse() * dTr);
+      searchDir = H.inverse() * dTr;
 
       //std::cout << "\nsearchdir\n" << searchDir  << "\n";
 
@@ -217,6 +305,8 @@ protected:
       updateEstimatedPose(estimate, searchDir);
       return true;
     }
+
+    searchDir = Eigen::Vector3f::Zero();
     return false;
   }
 
@@ -225,7 +315,7 @@ protected:
     estimate += change;
   }
 
-  void drawScan(const Eigen::Vector3f& pose, const ConcreteOccGridMapUtil& gridMapUtil, const DataContainer& dataContainer)
+  void drawScan(const Eigen::Vector3f& pose, const ConcreteOccGridMapUtil& gridMapUtil, const DataContainerView& dataContainer)
   {
     drawInterface->setScale(0.02);
 
@@ -244,6 +334,12 @@ protected:
 
   DrawInterface* drawInterface;
   HectorDebugInfoInterface* debugInterface;
+
+  float minStepTranslation;
+  float minStepRotation;
+  float minResidualChangeRatio;
+
+  ScanMatchStatistics lastStatistics;
 };
 
 }
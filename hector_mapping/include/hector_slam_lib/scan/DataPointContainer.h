@@ -31,6 +31,8 @@
 
 #include <vector>
 
+#include <Eigen/Core>
+
 namespace hectorslam {
 
 template<typename DataPointType>
@@ -93,7 +95,148 @@ protected:
   DataPointType origo;
 };
 
-typedef DataPointContainer<Eigen::Vector2f> DataContainer;
+class DataPointContainerView;
+
+/**
+ * Structure-of-arrays variant of DataPointContainer for 2D points. The x and y coordinates are
+ * kept in separate aligned arrays so that matching and map updates can stream them directly.
+ */
+class DataPointContainerSoA
+{
+public:
+
+  typedef std::vector<float, Eigen::aligned_allocator<float> > CoordArray;
+
+  DataPointContainerSoA(int size = 1000)
+    : origo(Eigen::Vector2f::Zero())
+  {
+    xCoords.reserve(size);
+    yCoords.reserve(size);
+  }
+
+  void add(const Eigen::Vector2f& dataPoint)
+  {
+    xCoords.push_back(dataPoint.x());
+    yCoords.push_back(dataPoint.y());
+  }
+
+  void clear()
+  {
+    xCoords.clear();
+    yCoords.clear();
+  }
+
+  int getSize() const
+  {
+    return xCoords.size();
+  }
+
+  Eigen::Vector2f getVecEntry(int index) const
+  {
+    return Eigen::Vector2f(xCoords[index], yCoords[index]);
+  }
+
+  const float* getXArray() const
+  {
+    return xCoords.empty() ? 0 : &xCoords[0];
+  }
+
+  const float* getYArray() const
+  {
+    return yCoords.empty() ? 0 : &yCoords[0];
+  }
+
+  Eigen::Vector2f getOrigo() const
+  {
+    return origo;
+  }
+
+  void setOrigo(const Eigen::Vector2f& origoIn)
+  {
+    origo = origoIn;
+  }
+
+  inline DataPointContainerView getView(float factor = 1.0f) const;
+
+protected:
+
+  CoordArray xCoords;
+  CoordArray yCoords;
+  Eigen::Vector2f origo;
+};
+
+/**
+ * Lightweight read only view of a DataPointContainerSoA with a scale factor applied to all points.
+ * Used to present the scan to the coarser levels of the multi resolution map without copying it.
+ * The viewed container has to outlive the view.
+ */
+class DataPointContainerView
+{
+public:
+
+  DataPointContainerView(const DataPointContainerSoA& container, float factor = 1.0f)
+    : xCoords(container.getXArray())
+    , yCoords(container.getYArray())
+    , size(container.getSize())
+    , scaleFactor(factor)
+    , origo(container.getOrigo() * factor)
+  {}
+
+  int getSize() const
+  {
+    return size;
+  }
+
+  /**
+   * Returns the scaled point at index.
+   */
+  Eigen::Vector2f getVecEntry(int index) const
+  {
+    return Eigen::Vector2f(xCoords[index], yCoords[index]) * scaleFactor;
+  }
+
+  /**
+   * Returns the unscaled x coordinates, getScaleFactor() has to be applied by the caller.
+   */
+  const float* getXArray() const
+  {
+    return xCoords;
+  }
+
+  /**
+   * Returns the unscaled y coordinates, getScaleFactor() has to be applied by the caller.
+   */
+  const float* getYArray() const
+  {
+    return yCoords;
+  }
+
+  float getScaleFactor() const
+  {
+    return scaleFactor;
+  }
+
+  Eigen::Vector2f getOrigo() const
+  {
+    return origo;
+  }
+
+protected:
+
+  const float* xCoords;
+  const float* yCoords;
+  int size;
+  float scaleFactor;
+  Eigen::Vector2f origo;
+};
+
+DataPointContainerView DataPointContainerSoA::getView(float factor) const
+{
+  return DataPointContainerView(*this, factor);
+}
+
+typedef DataPointContainerSoA DataContainer;
+typedef DataPointContainerView DataContainerView;
 
 }
 
@@ -0,0 +1,199 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef __DataPointReducer_h_
+#define __DataPointReducer_h_
+
+#include <vector>
+#include <cmath>
+
+#include "DataPointContainer.h"
+
+namespace hectorslam{
+
+/**
+ * Reduces the points of a scan before matching. The stages, each disabled by default, are applied in this order:
+ * - Minimum distance: a point is dropped if it is closer than the given distance to the last kept point. Dense
+ *   returns close to the sensor are thinned out more than sparse ones far away, adapting the angular resolution.
+ * - Cell filter: only the first point in every cell of a grid with the given cell size is kept.
+ * - Point cap: if more points remain than allowed, one point per equally sized stratum of the (angularly sorted)
+ *   sequence is kept, which keeps the coverage of the whole scan.
+ * Sizes and distances are in the units of the container, i.e. map cells when filled as for matching.
+ */
+class DataPointReducer
+{
+public:
+
+  DataPointReducer()
+    : cellSize(0.0f)
+    , minPointDistance(0.0f)
+    , maxPoints(0)
+    , currentStamp(0)
+  {}
+
+  void setCellSize(float cellSizeIn) { cellSize = cellSizeIn; };
+  void setMinPointDistance(float minPointDistanceIn) { minPointDistance = minPointDistanceIn; };
+  void setMaxPoints(int maxPointsIn) { maxPoints = maxPointsIn; };
+
+  bool isEnabled() const { return (cellSize > 0.0f) || (minPointDistance > 0.0f) || (maxPoints > 0); };
+
+  /**
+   * Writes the reduced points of input to output, which must not be the same container.
+   */
+  void reduce(const DataContainer& input, DataContainer& output)
+  {
+    int size = input.getSize();
+
+    output.clear();
+    output.setOrigo(input.getOrigo());
+
+    const float* pointsX = input.getXArray();
+    const float* pointsY = input.getYArray();
+
+    bool useCells = cellSize > 0.0f;
+    float invCellSize = useCells ? (1.0f / cellSize) : 0.0f;
+
+    if (useCells) {
+      this->startCellSet(size);
+    }
+
+    float minDistanceSquared = minPointDistance * minPointDistance;
+    bool haveLastPoint = false;
+    float lastX = 0.0f;
+    float lastY = 0.0f;
+
+    for (int i = 0; i < size; ++i) {
+      float x = pointsX[i];
+      float y = pointsY[i];
+
+      if (haveLastPoint && (((x - lastX) * (x - lastX) + (y - lastY) * (y - lastY)) < minDistanceSquared)) {
+        continue;
+      }
+
+      if (useCells && !this->insertCell(static_cast<int>(std::floor(x * invCellSize)), static_cast<int>(std::floor(y * invCellSize)))) {
+        continue;
+      }
+
+      output.add(Eigen::Vector2f(x, y));
+
+      haveLastPoint = true;
+      lastX = x;
+      lastY = y;
+    }
+
+    if ((maxPoints > 0) && (output.getSize() > maxPoints)) {
+      sampleStratified(output, maxPoints, sampled);
+      output = sampled;
+    }
+  }
+
+  /**
+   * Writes maxPoints points of input to output, the middle one of each of maxPoints equally sized index ranges.
+   */
+  static void sampleStratified(const DataContainer& input, int maxPoints, DataContainer& output)
+  {
+    int size = input.getSize();
+
+    output.clear();
+    output.setOrigo(input.getOrigo());
+
+    const float* pointsX = input.getXArray();
+    const float* pointsY = input.getYArray();
+
+    for (int i = 0; i < maxPoints; ++i) {
+      int begin = static_cast<int>((static_cast<long>(size) * i) / maxPoints);
+      int end = static_cast<int>((static_cast<long>(size) * (i + 1)) / maxPoints);
+      int index = (begin + end) / 2;
+
+      output.add(Eigen::Vector2f(pointsX[index], pointsY[index]));
+    }
+  }
+
+protected:
+
+  /**
+   * Empties the cell set, sizing its table for up to numCells cells.
+   */
+  void startCellSet(int numCells)
+  {
+    unsigned int tableSize = 1024;
+
+    while (tableSize < static_cast<unsigned int>(numCells) * 2) {
+      tableSize *= 2;
+    }
+
+    //entries with an outdated stamp count as empty, so the table does not need to be cleared for every scan
+    if (tableSize > cellStamps.size()) {
+      cellKeysX.resize(tableSize);
+      cellKeysY.resize(tableSize);
+      cellStamps.assign(tableSize, 0);
+      currentStamp = 0;
+    }
+
+    ++currentStamp;
+  }
+
+  /**
+   * Inserts the cell into the set.
+   * @return False if it was already contained
+   */
+  bool insertCell(int x, int y)
+  {
+    unsigned int mask = static_cast<unsigned int>(cellStamps.size()) - 1;
+    unsigned int slot = ((static_cast<unsigned int>(x) * 73856093u) ^ (static_cast<unsigned int>(y) * 19349663u)) & mask;
+
+    while (cellStamps[slot] == currentStamp) {
+      if ((cellKeysX[slot] == x) && (cellKeysY[slot] == y)) {
+        return false;
+      }
+
+      slot = (slot + 1) & mask;
+    }
+
+    cellKeysX[slot] = x;
+    cellKeysY[slot] = y;
+    cellStamps[slot] = currentStamp;
+    return true;
+  }
+
+  float cellSize;
+  float minPointDistance;
+  int maxPoints;
+
+  std::vector<int> cellKeysX;
+  std::vector<int> cellKeysY;
+  std::vector<int> cellStamps;
+  int currentStamp;
+
+  DataContainer sampled;
+};
+
+}
+
+#endif
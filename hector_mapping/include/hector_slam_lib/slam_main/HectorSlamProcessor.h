@@ -38,6 +38,8 @@
 #include "../util/DrawInterface.h"
 #include "../util/HectorDebugInfoInterface.h"
 #include "../util/MapLockerInterface.h"
+#include "../util/MapMutex.h"
+#include "../util/WorkerPool.h"
 
 #include "MapRepresentationInterface.h"
 #include "MapRepMultiMap.h"
@@ -45,6 +47,12 @@
 
 #include <float.h>
 
+#include <deque>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
 namespace hectorslam{
 
 class HectorSlamProcessor
@@ -54,8 +62,12 @@ public:
   HectorSlamProcessor(float mapResolution, int mapSizeX, int mapSizeY , const Eigen::Vector2f& startCoords, int multi_res_size, DrawInterface* drawInterfaceIn = 0, HectorDebugInfoInterface* debugInterfaceIn = 0)
     : drawInterface(drawInterfaceIn)
     , debugInterface(debugInterfaceIn)
+    , workerPool(0)
+    , mapUpdateThread(0)
+    , stopMapUpdateThread(false)
+    , maxQueuedMapUpdates(2)
   {
-    mapRep = new MapRepMultiMap(mapResolution, mapSizeX, mapSizeY, multi_res_size, startCoords, drawInterfaceIn, debugInterfaceIn);
+    mapRep = createMapRepMultiMap(mapResolution, mapSizeX, mapSizeY, multi_res_size, startCoords, drawInterfaceIn, debugInterfaceIn);
 
     this->reset();
 
@@ -65,7 +77,10 @@ public:
 
   ~HectorSlamProcessor()
   {
+    this->setPipelinedMapUpdate(false);
+
     delete mapRep;
+    delete workerPool;
   }
 
   void update(const DataContainer& dataContainer, const Eigen::Vector3f& poseHintWorld, bool map_without_matching = false)
@@ -88,10 +103,24 @@ public:
     //std::cout << "\n" << lastScanMatchPose << "\n";
     if(util::poseDifferenceLargerThan(newPoseEstimateWorld, lastMapUpdatePose, paramMinDistanceDiffForMapUpdate, paramMinAngleDiffForMapUpdate) || map_without_matching){
 
-      mapRep->updateByScan(dataContainer, newPoseEstimateWorld);
+      if (mapUpdateThread){
+        //nothing can be matched before the first scan is in the map, so that one is integrated synchronously
+        bool firstMapUpdate = (lastMapUpdatePose[0] == FLT_MAX);
+
+        //updates forced by the caller must not get lost, wait for queue space for those. Otherwise retry with the next scan.
+        if (queueMapUpdate(dataContainer, newPoseEstimateWorld, map_without_matching || firstMapUpdate)){
+          lastMapUpdatePose = newPoseEstimateWorld;
 
-      mapRep->onMapUpdated();
-      lastMapUpdatePose = newPoseEstimateWorld;
+          if (firstMapUpdate){
+            this->waitForMapUpdates();
+          }
+        }
+      }else{
+        mapRep->updateByScan(dataContainer, newPoseEstimateWorld);
+
+        mapRep->onMapUpdated();
+        lastMapUpdatePose = newPoseEstimateWorld;
+      }
     }
 
     if(drawInterface){
@@ -114,6 +143,8 @@ public:
 
   void reset()
   {
+    this->waitForMapUpdates();
+
     lastMapUpdatePose = Eigen::Vector3f(FLT_MAX, FLT_MAX, FLT_MAX);
     lastScanMatchPose = Eigen::Vector3f::Zero();
     //lastScanMatchPose.x() = -10.0f;
@@ -134,11 +165,162 @@ public:
 
   void setUpdateFactorFree(float free_factor) { mapRep->setUpdateFactorFree(free_factor); };
   void setUpdateFactorOccupied(float occupied_factor) { mapRep->setUpdateFactorOccupied(occupied_factor); };
+  void setProbabilityPlaneEnabled(bool enabled) { mapRep->setProbabilityPlaneEnabled(enabled); };
+  void setConvergenceCriteria(float minStepTranslation, float minStepRotation, float minResidualChangeRatio) { mapRep->setConvergenceCriteria(minStepTranslation, minStepRotation, minResidualChangeRatio); };
+  void setMaxIterations(int mapLevel, int maxIterations) { mapRep->setMaxIterations(mapLevel, maxIterations); };
+  void setMaxMatchPoints(int mapLevel, int maxPoints) { mapRep->setMaxMatchPoints(mapLevel, maxPoints); };
+  void setMatchTimeBudget(double budgetMs) { mapRep->setMatchTimeBudget(budgetMs); };
+  void setMultiHypothesisMatching(int numHypotheses, float linearOffset, float angularOffset) { mapRep->setMultiHypothesisMatching(numHypotheses, linearOffset, angularOffset); };
+  void setRollingWindow(float recenterDistance, MapSpillInterface* spillInterface = 0) { mapRep->setRollingWindow(recenterDistance, spillInterface); };
+  void setCoarseLevelDerivation(bool deriveFromFinest, GridMapPyramidPooling pooling = PyramidPoolingMax) { mapRep->setCoarseLevelDerivation(deriveFromFinest, pooling); };
+  void rebuildCoarseLevels() { mapRep->rebuildCoarseLevels(); };
+  const ScanMatchStatistics& getMatchStatistics(int mapLevel = 0) const { return mapRep->getMatchStatistics(mapLevel); };
   void setMapUpdateMinDistDiff(float minDist) { paramMinDistanceDiffForMapUpdate = minDist; };
   void setMapUpdateMinAngleDiff(float angleChange) { paramMinAngleDiffForMapUpdate = angleChange; };
+
+  /**
+   * Sets the number of worker threads used in addition to the calling thread, e.g. for updating the map levels in
+   * parallel. 0 (the default) does everything on the calling thread.
+   */
+  void setNumWorkerThreads(int numThreads)
+  {
+    //the map update thread may be using the pool
+    this->waitForMapUpdates();
+
+    mapRep->setWorkerPool(0);
+    delete workerPool;
+    workerPool = 0;
+
+    if (numThreads > 0){
+      workerPool = new WorkerPool(numThreads);
+      mapRep->setWorkerPool(workerPool);
+    }
+  }
+
+  WorkerPool* getWorkerPool() { return workerPool; };
+
+  /**
+   * Enables the pipelined mode, in which update() returns right after matching and map updates are done by a
+   * separate thread. At most maxQueuedMapUpdates scans wait for integration; if the queue is full, the map update
+   * is skipped and retried with the next scan. Every map level gets a mutex that is held while matching or updating it.
+   */
+  void setPipelinedMapUpdate(bool enabled)
+  {
+    if (enabled == (mapUpdateThread != 0)){
+      return;
+    }
+
+    if (enabled){
+      int mapLevels = mapRep->getMapLevels();
+
+      for (int i = 0; i < mapLevels; ++i){
+        if (!mapRep->getMapMutex(i)){
+          mapRep->addMapMutex(i, new MapMutex());
+        }
+      }
+
+      mapRep->setLockMapsForMatching(true);
+
+      stopMapUpdateThread = false;
+      mapUpdateThread = new boost::thread(boost::bind(&HectorSlamProcessor::mapUpdateLoop, this));
+    }else{
+      {
+        boost::mutex::scoped_lock lock(mapUpdateQueueMutex);
+        stopMapUpdateThread = true;
+      }
+
+      mapUpdateQueueCondition.notify_all();
+
+      mapUpdateThread->join();
+      delete mapUpdateThread;
+      mapUpdateThread = 0;
+
+      mapRep->setLockMapsForMatching(false);
+    }
+  }
+
+  void setMaxQueuedMapUpdates(int maxQueued) { maxQueuedMapUpdates = maxQueued; };
+
+  /**
+   * Blocks until all queued map updates are integrated, returns immediately if not in pipelined mode.
+   */
+  void waitForMapUpdates()
+  {
+    boost::mutex::scoped_lock lock(mapUpdateQueueMutex);
+
+    while (!mapUpdateQueue.empty()){
+      mapUpdateQueueCondition.wait(lock);
+    }
+  }
   MapRepresentationInterface* mapRep;
 protected:
 
+  struct QueuedMapUpdate
+  {
+    QueuedMapUpdate(const DataContainer& dataContainerIn, const Eigen::Vector3f& robotPoseWorldIn)
+      : dataContainer(dataContainerIn)
+      , robotPoseWorld(robotPoseWorldIn)
+    {}
+
+    DataContainer dataContainer;
+    Eigen::Vector3f robotPoseWorld;
+  };
+
+  /**
+   * Copies the scan into the map update queue.
+   * @return False if the queue is full and waitForSpace is not set
+   */
+  bool queueMapUpdate(const DataContainer& dataContainer, const Eigen::Vector3f& robotPoseWorld, bool waitForSpace)
+  {
+    boost::mutex::scoped_lock lock(mapUpdateQueueMutex);
+
+    while (static_cast<int>(mapUpdateQueue.size()) >= maxQueuedMapUpdates){
+      if (!waitForSpace){
+        return false;
+      }
+
+      mapUpdateQueueCondition.wait(lock);
+    }
+
+    mapUpdateQueue.push_back(new QueuedMapUpdate(dataContainer, robotPoseWorld));
+
+    mapUpdateQueueCondition.notify_all();
+    return true;
+  }
+
+  void mapUpdateLoop()
+  {
+    while (true){
+      QueuedMapUpdate* queuedUpdate = 0;
+
+      {
+        boost::mutex::scoped_lock lock(mapUpdateQueueMutex);
+
+        while (mapUpdateQueue.empty() && !stopMapUpdateThread){
+          mapUpdateQueueCondition.wait(lock);
+        }
+
+        if (mapUpdateQueue.empty()){
+          return;
+        }
+
+        //stays queued until integrated, so waitForMapUpdates() and the queue limit include it
+        queuedUpdate = mapUpdateQueue.front();
+      }
+
+      //no onMapUpdated() here, the matcher resets its caches itself when it sees a new map update index
+      mapRep->updateByScan(queuedUpdate->dataContainer, queuedUpdate->robotPoseWorld);
+
+      {
+        boost::mutex::scoped_lock lock(mapUpdateQueueMutex);
+        mapUpdateQueue.pop_front();
+      }
+
+      delete queuedUpdate;
+      mapUpdateQueueCondition.notify_all();
+    }
+  }
+
   
   
   Eigen::Vector3f lastMapUpdatePose;
@@ -150,6 +332,15 @@ protected:
 
   DrawInterface* drawInterface;
   HectorDebugInfoInterface* debugInterface;
+
+  WorkerPool* workerPool;
+
+  boost::thread* mapUpdateThread;
+  boost::mutex mapUpdateQueueMutex;
+  boost::condition_variable mapUpdateQueueCondition;
+  std::deque<QueuedMapUpdate*> mapUpdateQueue;
+  bool stopMapUpdateThread;
+  int maxQueuedMapUpdates;
 };
 
 }
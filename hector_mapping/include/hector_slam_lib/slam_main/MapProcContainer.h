@@ -33,6 +33,10 @@
 #include "../map/OccGridMapUtilConfig.h"
 #include "../matcher/ScanMatcher.h"
 #include "../util/MapLockerInterface.h"
+#include "../util/MapSpillInterface.h"
+
+#include <algorithm>
+#include <vector>
 
 class GridMap;
 class ConcreteOccGridMapUtil;
@@ -40,21 +44,50 @@ class DataContainer;
 
 namespace hectorslam{
 
-class MapProcContainer
+/**
+ * One level of a multi resolution map: the map, the util used for matching against it and the scan matcher. Containers
+ * can be copied, the components are only deleted by cleanup().
+ */
+template<typename ConcreteGridMap, typename ConcreteOccGridMapUtil>
+class MapProcContainerT
 {
 public:
-  MapProcContainer(GridMap* gridMapIn, OccGridMapUtilConfig<GridMap>* gridMapUtilIn, ScanMatcher<OccGridMapUtilConfig<GridMap> >* scanMatcherIn)
+
+  typedef ScanMatcher<ConcreteOccGridMapUtil> ConcreteScanMatcher;
+
+  MapProcContainerT()
+    : gridMap(0)
+    , gridMapUtil(0)
+    , scanMatcher(0)
+    , mapMutex(0)
+    , lockForMatching(false)
+    , cacheUpdateIndex(-1)
+    , statisticsSlot(0)
+    , rollingWindowDistance(0.0f)
+    , spillInterface(0)
+    , mapLevel(0)
+  {}
+
+  MapProcContainerT(ConcreteGridMap* gridMapIn, ConcreteOccGridMapUtil* gridMapUtilIn, ConcreteScanMatcher* scanMatcherIn)
     : gridMap(gridMapIn)
     , gridMapUtil(gridMapUtilIn)
     , scanMatcher(scanMatcherIn)
     , mapMutex(0)
+    , lockForMatching(false)
+    , cacheUpdateIndex(gridMapIn->getUpdateIndex())
+    , statisticsSlot(0)
+    , rollingWindowDistance(0.0f)
+    , spillInterface(0)
+    , mapLevel(0)
   {}
 
-  virtual ~MapProcContainer()
+  virtual ~MapProcContainerT()
   {}
 
   void cleanup()
   {
+    this->setNumMatchSlots(1);
+
     delete gridMap;
     delete gridMapUtil;
     delete scanMatcher;
@@ -67,18 +100,63 @@ public:
   void reset()
   {
     gridMap->reset();
-    gridMapUtil->resetCachedData();
+    this->resetCachedData();
   }
 
   void resetCachedData()
   {
     gridMapUtil->resetCachedData();
+
+    for (size_t i = 0; i < extraSlots.size(); ++i){
+      extraSlots[i].gridMapUtil->resetCachedData();
+    }
+  }
+
+  /**
+   * Sets the number of independent matcher/cache pairs, so that up to numSlots poses can be matched against this level
+   * concurrently with matchDataInSlot(). Slot 0 is the one used by matchData(), every further slot has its own cache
+   * of the size of the map.
+   */
+  void setNumMatchSlots(int numSlots)
+  {
+    int numExtraSlots = std::max(0, numSlots - 1);
+
+    while (static_cast<int>(extraSlots.size()) > numExtraSlots){
+      delete extraSlots.back().gridMapUtil;
+      delete extraSlots.back().scanMatcher;
+      extraSlots.pop_back();
+    }
+
+    while (static_cast<int>(extraSlots.size()) < numExtraSlots){
+      MatchSlot slot;
+      slot.gridMapUtil = new ConcreteOccGridMapUtil(gridMap);
+
+      //no debug drawing, slots are used from several threads at once
+      slot.scanMatcher = new ConcreteScanMatcher(*scanMatcher);
+      slot.scanMatcher->setDebugInterfaces(0, 0);
+
+      slot.cacheUpdateIndex = -1;
+      extraSlots.push_back(slot);
+    }
+
+    statisticsSlot = 0;
+  }
+
+  int getNumMatchSlots() const { return static_cast<int>(extraSlots.size()) + 1; };
+
+  void setConvergenceCriteria(float minStepTranslation, float minStepRotation, float minResidualChangeRatio)
+  {
+    scanMatcher->setConvergenceCriteria(minStepTranslation, minStepRotation, minResidualChangeRatio);
+
+    for (size_t i = 0; i < extraSlots.size(); ++i){
+      extraSlots[i].scanMatcher->setConvergenceCriteria(minStepTranslation, minStepRotation, minResidualChangeRatio);
+    }
   }
 
   float getScaleToMap() const { return gridMap->getScaleToMap(); };
 
-  const GridMap& getGridMap() const { return *gridMap; };
-  GridMap& getGridMap() { return *gridMap; };
+  const ConcreteGridMap& getGridMap() const { return *gridMap; };
+  ConcreteGridMap& getGridMap() { return *gridMap; };
 
   void addMapMutex(MapLockerInterface* mapMutexIn)
   {
@@ -95,18 +173,130 @@ public:
     return mapMutex;
   }
 
-  Eigen::Vector3f matchData(const Eigen::Vector3f& beginEstimateWorld, const DataContainer& dataContainer, Eigen::Matrix3f& covMatrix, int maxIterations)
+  /**
+   * If enabled, the map mutex is held while matching, needed if the map is updated from another thread.
+   */
+  void setLockForMatching(bool lock)
+  {
+    lockForMatching = lock;
+  }
+
+  Eigen::Vector3f matchData(const Eigen::Vector3f& beginEstimateWorld, const DataContainerView& dataContainer, Eigen::Matrix3f& covMatrix, int maxIterations,
+                            const boost::posix_time::ptime& deadline = boost::posix_time::ptime(boost::posix_time::pos_infin))
+  {
+    this->lockForMatchingIfNeeded();
+
+    Eigen::Vector3f result (this->matchDataInSlot(0, beginEstimateWorld, dataContainer, covMatrix, maxIterations, deadline));
+    statisticsSlot = 0;
+
+    this->unlockForMatchingIfNeeded();
+
+    return result;
+  }
+
+  /**
+   * Matches with the matcher and cache of the given slot. Does not lock the map, different slots may be used concurrently.
+   */
+  Eigen::Vector3f matchDataInSlot(int slot, const Eigen::Vector3f& beginEstimateWorld, const DataContainerView& dataContainer, Eigen::Matrix3f& covMatrix, int maxIterations,
+                                  const boost::posix_time::ptime& deadline = boost::posix_time::ptime(boost::posix_time::pos_infin))
+  {
+    ConcreteOccGridMapUtil& slotMapUtil (this->getSlotMapUtil(slot));
+
+    return this->getSlotMatcher(slot).matchData(beginEstimateWorld, slotMapUtil, dataContainer, covMatrix, maxIterations, deadline);
+  }
+
+  /**
+   * Returns the residual of dataContainer at the given world pose, evaluated with the cache of the given slot. Does not lock the map.
+   */
+  float getResidualInSlot(int slot, const Eigen::Vector3f& poseWorld, const DataContainerView& dataContainer)
+  {
+    ConcreteOccGridMapUtil& slotMapUtil (this->getSlotMapUtil(slot));
+
+    return slotMapUtil.getResidualForState(slotMapUtil.getMapCoordsPose(poseWorld), dataContainer);
+  }
+
+  /**
+   * Locks the map if matching needs to be protected against updates from another thread, see setLockForMatching().
+   */
+  void lockForMatchingIfNeeded()
+  {
+    if (lockForMatching && mapMutex)
+    {
+      mapMutex->lockMap();
+    }
+  }
+
+  void unlockForMatchingIfNeeded()
   {
-    return scanMatcher->matchData(beginEstimateWorld, *gridMapUtil, dataContainer, covMatrix, maxIterations);
+    if (lockForMatching && mapMutex)
+    {
+      mapMutex->unlockMap();
+    }
   }
 
-  void updateByScan(const DataContainer& dataContainer, const Eigen::Vector3f& robotPoseWorld)
+  /**
+   * Selects the slot whose statistics getMatchStatistics() returns, i.e. the one whose result was used.
+   */
+  void setStatisticsSlot(int slot)
   {
+    statisticsSlot = slot;
+  }
+
+  const ScanMatchStatistics& getMatchStatistics() const
+  {
+    return (statisticsSlot == 0) ? scanMatcher->getLastStatistics() : extraSlots[statisticsSlot - 1].scanMatcher->getLastStatistics();
+  }
+
+  /**
+   * Enables the rolling window mode if recenterDistance > 0: before every update, the map window is moved to be
+   * centered on the robot again if it is more than recenterDistance (world units) away from the center. Cells
+   * leaving the window are passed to spillInterfaceIn (if set, not owned) as cells of mapLevelIn.
+   */
+  void setRollingWindow(float recenterDistance, MapSpillInterface* spillInterfaceIn, int mapLevelIn)
+  {
+    rollingWindowDistance = recenterDistance;
+    spillInterface = spillInterfaceIn;
+    mapLevel = mapLevelIn;
+  }
+
+  /**
+   * Moves the rolling window (if enabled) like updateByScan() does, for levels that are not updated by scans.
+   * @return True if the window has been moved
+   */
+  bool updateWindow(const Eigen::Vector3f& robotPoseWorld)
+  {
+    if (rollingWindowDistance <= 0.0f)
+    {
+      return false;
+    }
+
     if (mapMutex)
     {
       mapMutex->lockMap();
     }
 
+    bool moved = gridMap->centerWindowOn(robotPoseWorld.head<2>(), rollingWindowDistance, spillInterface, mapLevel);
+
+    if (mapMutex)
+    {
+      mapMutex->unlockMap();
+    }
+
+    return moved;
+  }
+
+  void updateByScan(const DataContainerView& dataContainer, const Eigen::Vector3f& robotPoseWorld)
+  {
+    if (mapMutex)
+    {
+      mapMutex->lockMap();
+    }
+
+    if (rollingWindowDistance > 0.0f)
+    {
+      gridMap->centerWindowOn(robotPoseWorld.head<2>(), rollingWindowDistance, spillInterface, mapLevel);
+    }
+
     gridMap->updateByScan(dataContainer, robotPoseWorld);
 
     if (mapMutex)
@@ -115,12 +305,56 @@ public:
     }
   }
 
-  GridMap* gridMap;
-  OccGridMapUtilConfig<GridMap>* gridMapUtil;
-  ScanMatcher<OccGridMapUtilConfig<GridMap> >* scanMatcher;
+  ConcreteGridMap* gridMap;
+  ConcreteOccGridMapUtil* gridMapUtil;
+  ConcreteScanMatcher* scanMatcher;
   MapLockerInterface* mapMutex;
+
+  bool lockForMatching;
+  int cacheUpdateIndex;
+
+protected:
+
+  struct MatchSlot
+  {
+    ConcreteOccGridMapUtil* gridMapUtil;
+    ConcreteScanMatcher* scanMatcher;
+    int cacheUpdateIndex;
+  };
+
+  /**
+   * Returns the map util of the given slot with its cache valid for the current map.
+   */
+  ConcreteOccGridMapUtil& getSlotMapUtil(int slot)
+  {
+    ConcreteOccGridMapUtil* slotMapUtil = (slot == 0) ? gridMapUtil : extraSlots[slot - 1].gridMapUtil;
+    int& slotCacheUpdateIndex ((slot == 0) ? cacheUpdateIndex : extraSlots[slot - 1].cacheUpdateIndex);
+
+    //the map may have been updated without onMapUpdated() (e.g. by the pipelined map update thread), cached values are stale then
+    if (gridMap->getUpdateIndex() != slotCacheUpdateIndex)
+    {
+      slotMapUtil->resetCachedData();
+      slotCacheUpdateIndex = gridMap->getUpdateIndex();
+    }
+
+    return *slotMapUtil;
+  }
+
+  ConcreteScanMatcher& getSlotMatcher(int slot)
+  {
+    return (slot == 0) ? *scanMatcher : *extraSlots[slot - 1].scanMatcher;
+  }
+
+  std::vector<MatchSlot> extraSlots;
+  int statisticsSlot;
+
+  float rollingWindowDistance;        ///< Recenter distance of the rolling window mode, 0 if disabled
+  MapSpillInterface* spillInterface;
+  int mapLevel;
 };
 
+typedef MapProcContainerT<GridMap, OccGridMapUtilConfig<GridMap> > MapProcContainer;
+
 }
 
 #endif
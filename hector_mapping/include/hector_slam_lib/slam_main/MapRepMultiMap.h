@@ -34,18 +34,62 @@
 
 #include "../map/GridMap.h"
 #include "../map/OccGridMapUtilConfig.h"
+#include "../map/GridMapPyramidBuilder.h"
 #include "../matcher/ScanMatcher.h"
+#include "../scan/DataPointReducer.h"
 
 #include "../util/DrawInterface.h"
 #include "../util/HectorDebugInfoInterface.h"
+#include "../util/WorkerPool.h"
+
+#include <vector>
+
+#include <boost/array.hpp>
 
 namespace hectorslam{
 
-class MapRepMultiMap : public MapRepresentationInterface
+/**
+ * Storage of per level data of MapRepMultiMapT, inline for a fixed number of levels and a vector if the number of
+ * levels is only known at runtime (Levels == 0).
+ */
+template<typename T, int Levels>
+struct MapLevelStorage
+{
+  typedef boost::array<T, Levels> Type;
+
+  static void resize(Type&, unsigned int) {}
+};
+
+template<typename T>
+struct MapLevelStorage<T, 0>
+{
+  typedef std::vector<T> Type;
+
+  static void resize(Type& levels, unsigned int numLevels) { levels.resize(numLevels); }
+};
+
+/**
+ * Multi resolution map with coarse to fine matching. The number of levels, the map type (cell type and layout) and the
+ * map util (cache method) are template parameters, so all calls within the class are resolved at compile time and with
+ * a fixed number of levels the level loops have constant bounds. Levels == 0 takes the number of levels from the
+ * constructor. See MapRepMultiMapLevels for use through MapRepresentationInterface.
+ */
+template<int Levels, typename ConcreteGridMap = GridMap, typename ConcreteOccGridMapUtil = OccGridMapUtilConfig<ConcreteGridMap> >
+class MapRepMultiMapT
 {
 
 public:
-  MapRepMultiMap(float mapResolution, int mapSizeX, int mapSizeY, unsigned int numDepth, const Eigen::Vector2f& startCoords, DrawInterface* drawInterfaceIn, HectorDebugInfoInterface* debugInterfaceIn)
+
+  typedef MapProcContainerT<ConcreteGridMap, ConcreteOccGridMapUtil> Level;
+  typedef ScanMatcher<ConcreteOccGridMapUtil> ConcreteScanMatcher;
+
+  MapRepMultiMapT(float mapResolution, int mapSizeX, int mapSizeY, unsigned int numDepth, const Eigen::Vector2f& startCoords, DrawInterface* drawInterfaceIn, HectorDebugInfoInterface* debugInterfaceIn)
+    : workerPool(0)
+    , matchTimeBudgetMs(0.0)
+    , numHypotheses(1)
+    , hypothesisLinearOffset(0.0f)
+    , hypothesisAngularOffset(0.0f)
+    , deriveCoarseLevels(false)
   {
     //unsigned int numDepth = 3;
     Eigen::Vector2i resolution(mapSizeX, mapSizeY);
@@ -56,22 +100,32 @@ public:
     float totalMapSizeY = mapResolution * static_cast<float>(mapSizeY);
     float mid_offset_y = totalMapSizeY * startCoords.y();
 
-    for (unsigned int i = 0; i < numDepth; ++i){
+    unsigned int numLevels = (Levels > 0) ? Levels : numDepth;
+
+    MapLevelStorage<Level, Levels>::resize(mapContainer, numLevels);
+    MapLevelStorage<int, Levels>::resize(maxIterations, numLevels);
+    MapLevelStorage<int, Levels>::resize(maxMatchPoints, numLevels);
+    MapLevelStorage<DataContainer, Levels>::resize(sampledMatchPoints, numLevels);
+    MapLevelStorage<const DataContainer*, Levels>::resize(hypothesisLevelPoints, numLevels);
+
+    for (unsigned int i = 0; i < numLevels; ++i){
       std::cout << "HectorSM map lvl " << i << ": cellLength: " << mapResolution << " res x:" << resolution.x() << " res y: " << resolution.y() << "\n";
-      GridMap* gridMap = new hectorslam::GridMap(mapResolution,resolution, Eigen::Vector2f(mid_offset_x, mid_offset_y));
-      OccGridMapUtilConfig<GridMap>* gridMapUtil = new OccGridMapUtilConfig<GridMap>(gridMap);
-      ScanMatcher<OccGridMapUtilConfig<GridMap> >* scanMatcher = new hectorslam::ScanMatcher<OccGridMapUtilConfig<GridMap> >(drawInterfaceIn, debugInterfaceIn);
+      ConcreteGridMap* gridMap = new ConcreteGridMap(mapResolution,resolution, Eigen::Vector2f(mid_offset_x, mid_offset_y));
+      ConcreteOccGridMapUtil* gridMapUtil = new ConcreteOccGridMapUtil(gridMap);
+      ConcreteScanMatcher* scanMatcher = new ConcreteScanMatcher(drawInterfaceIn, debugInterfaceIn);
 
-      mapContainer.push_back(MapProcContainer(gridMap, gridMapUtil, scanMatcher));
+      mapContainer[i] = Level(gridMap, gridMapUtil, scanMatcher);
+
+      //one more step than the loop count used before, the initial step used to be done outside the loop
+      maxIterations[i] = (i == 0 ? 6 : 4);
+      maxMatchPoints[i] = 0;
 
       resolution /= 2;
       mapResolution*=2.0f;
     }
-
-    dataContainers.resize(numDepth-1);
   }
 
-  virtual ~MapRepMultiMap()
+  ~MapRepMultiMapT()
   {
     unsigned int size = mapContainer.size();
 
@@ -80,7 +134,7 @@ public:
     }
   }
 
-  virtual void reset()
+  void reset()
   {
     unsigned int size = mapContainer.size();
 
@@ -89,12 +143,12 @@ public:
     }
   }
 
-  virtual float getScaleToMap() const { return mapContainer[0].getScaleToMap(); };
+  float getScaleToMap() const { return mapContainer[0].getScaleToMap(); }
 
-  virtual int getMapLevels() const { return mapContainer.size(); };
-  virtual const GridMap& getGridMap(int mapLevel) const { return mapContainer[mapLevel].getGridMap(); };
-  virtual GridMap& getGridMap(int mapLevel) { return mapContainer[mapLevel].getGridMap(); };
-  virtual void addMapMutex(int i, MapLockerInterface* mapMutex)
+  int getMapLevels() const { return mapContainer.size(); }
+  const ConcreteGridMap& getGridMap(int mapLevel) const { return mapContainer[mapLevel].getGridMap(); }
+  ConcreteGridMap& getGridMap(int mapLevel) { return mapContainer[mapLevel].getGridMap(); }
+  void addMapMutex(int i, MapLockerInterface* mapMutex)
   {
     mapContainer[i].addMapMutex(mapMutex);
   }
@@ -104,7 +158,7 @@ public:
     return mapContainer[i].getMapMutex();
   }
 
-  virtual void onMapUpdated()
+  void onMapUpdated()
   {
     unsigned int size = mapContainer.size();
 
@@ -113,64 +167,519 @@ public:
     }
   }
 
-  virtual Eigen::Vector3f matchData(const Eigen::Vector3f& beginEstimateWorld, const DataContainer& dataContainer, Eigen::Matrix3f& covMatrix)
+  Eigen::Vector3f matchData(const Eigen::Vector3f& beginEstimateWorld, const DataContainer& dataContainer, Eigen::Matrix3f& covMatrix)
   {
     size_t size = mapContainer.size();
 
     Eigen::Vector3f tmp(beginEstimateWorld);
 
+    //the time budget only cuts the coarse levels short, the finest level always runs to convergence
+    boost::posix_time::ptime deadline (boost::posix_time::pos_infin);
+
+    if (matchTimeBudgetMs > 0.0){
+      deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::microseconds(static_cast<long>(matchTimeBudgetMs * 1000.0));
+    }
+
+    if (numHypotheses > 1){
+      return matchHypotheses(beginEstimateWorld, dataContainer, covMatrix, deadline);
+    }
+
     for (int index = size - 1; index >= 0; --index){
       //std::cout << " m " << i;
+      const DataContainer& levelPoints (getMatchPoints(dataContainer, index));
+
       if (index == 0){
-        tmp  = (mapContainer[index].matchData(tmp, dataContainer, covMatrix, 5));
+        tmp  = (mapContainer[index].matchData(tmp, levelPoints, covMatrix, maxIterations[index]));
       }else{
-        dataContainers[index-1].setFrom(dataContainer, static_cast<float>(1.0 / pow(2.0, static_cast<double>(index))));
-        tmp  = (mapContainer[index].matchData(tmp, dataContainers[index-1], covMatrix, 3));
+        tmp  = (mapContainer[index].matchData(tmp, getLevelView(levelPoints, index), covMatrix, maxIterations[index], deadline));
       }
     }
     return tmp;
   }
 
-  virtual void updateByScan(const DataContainer& dataContainer, const Eigen::Vector3f& robotPoseWorld)
+  void updateByScan(const DataContainer& dataContainer, const Eigen::Vector3f& robotPoseWorld)
   {
     unsigned int size = mapContainer.size();
 
+    if (deriveCoarseLevels && (size > 1)){
+      //only the finest level is painted, the cells it changed are pooled into the coarser ones
+      int sinceUpdateIndex = mapContainer[0].getGridMap().getUpdateIndex();
+
+      mapContainer[0].updateByScan(getLevelView(dataContainer, 0), robotPoseWorld);
+
+      bool windowMoved = false;
+
+      for (unsigned int i = 1; i < size; ++i){
+        windowMoved = mapContainer[i].updateWindow(robotPoseWorld) || windowMoved;
+      }
+
+      this->syncCoarseLevels(windowMoved ? -1 : sinceUpdateIndex);
+      return;
+    }
+
+    if (workerPool && (size > 1)){
+      //levels are independent (own map, own mutex), update the coarser ones on the pool and level 0 here
+      WorkerPool::TaskGroup levelUpdates;
+
+      for (unsigned int i = 1; i < size; ++i){
+        workerPool->run(levelUpdates, boost::bind(&Level::updateByScan, &mapContainer[i], getLevelView(dataContainer, i), robotPoseWorld));
+      }
+
+      mapContainer[0].updateByScan(getLevelView(dataContainer, 0), robotPoseWorld);
+
+      workerPool->waitForGroup(levelUpdates);
+      return;
+    }
+
     for (unsigned int i = 0; i < size; ++i){
       //std::cout << " u " <<  i;
-      if (i==0){
-        mapContainer[i].updateByScan(dataContainer, robotPoseWorld);
-      }else{
-        mapContainer[i].updateByScan(dataContainers[i-1], robotPoseWorld);
-      }
+      mapContainer[i].updateByScan(getLevelView(dataContainer, i), robotPoseWorld);
     }
     //std::cout << "\n";
   }
 
-  virtual void setUpdateFactorFree(float free_factor)
+  void setUpdateFactorFree(float free_factor)
   {
     size_t size = mapContainer.size();
 
     for (unsigned int i = 0; i < size; ++i){
-      GridMap& map = mapContainer[i].getGridMap();
+      ConcreteGridMap& map = mapContainer[i].getGridMap();
       map.setUpdateFreeFactor(free_factor);
     }
   }
 
-  virtual void setUpdateFactorOccupied(float occupied_factor)
+  void setUpdateFactorOccupied(float occupied_factor)
   {
     size_t size = mapContainer.size();
 
     for (unsigned int i = 0; i < size; ++i){
-      GridMap& map = mapContainer[i].getGridMap();
+      ConcreteGridMap& map = mapContainer[i].getGridMap();
       map.setUpdateOccupiedFactor(occupied_factor);
     }
   }
-  std::vector<MapProcContainer> mapContainer;
+
+  void setProbabilityPlaneEnabled(bool enabled)
+  {
+    size_t size = mapContainer.size();
+
+    for (unsigned int i = 0; i < size; ++i){
+      ConcreteGridMap& map = mapContainer[i].getGridMap();
+      map.setProbabilityPlaneEnabled(enabled);
+    }
+  }
+  /**
+   * Sets the pool used for updating the map levels (and casting the beams of large scans) in parallel, 0 updates
+   * them sequentially. Not owned.
+   */
+  void setWorkerPool(WorkerPool* workerPoolIn)
+  {
+    workerPool = workerPoolIn;
+
+    size_t size = mapContainer.size();
+
+    for (unsigned int i = 0; i < size; ++i){
+      mapContainer[i].getGridMap().setWorkerPool(workerPool);
+    }
+
+    pyramidBuilder.setWorkerPool(workerPool);
+  }
+
+  /**
+   * If deriveFromFinest is set, scans are only painted into the finest level and the coarser levels are derived from
+   * the cells it changed, see GridMapPyramidBuilder. Otherwise (the default) every level is painted on its own.
+   * The pooling is also used by rebuildCoarseLevels().
+   */
+  void setCoarseLevelDerivation(bool deriveFromFinest, GridMapPyramidPooling pooling)
+  {
+    deriveCoarseLevels = deriveFromFinest;
+    pyramidBuilder.setPooling(pooling);
+  }
+
+  /**
+   * Derives all coarser levels from the finest one anew, e.g. after cells of the finest level have been set directly.
+   */
+  void rebuildCoarseLevels()
+  {
+    std::vector<ConcreteGridMap*> levels;
+
+    this->lockLevels(levels);
+    pyramidBuilder.build(levels);
+    this->unlockLevels();
+  }
+
+  /**
+   * Enables the rolling window mode on all levels if recenterDistance > 0, see MapProcContainerT::setRollingWindow().
+   * Memory use stays that of the configured map size however far the robot travels, cells farther away are dropped
+   * (or passed to spillInterface, not owned).
+   */
+  void setRollingWindow(float recenterDistance, MapSpillInterface* spillInterface)
+  {
+    size_t size = mapContainer.size();
+
+    for (unsigned int i = 0; i < size; ++i){
+      mapContainer[i].setRollingWindow(recenterDistance, spillInterface, i);
+    }
+  }
+
+  void setLockMapsForMatching(bool lock)
+  {
+    size_t size = mapContainer.size();
+
+    for (unsigned int i = 0; i < size; ++i){
+      mapContainer[i].setLockForMatching(lock);
+    }
+  }
+
+  /**
+   * Sets the criteria for stopping Gauss-Newton iterations early on all levels, see ScanMatcher::setConvergenceCriteria().
+   */
+  void setConvergenceCriteria(float minStepTranslation, float minStepRotation, float minResidualChangeRatio)
+  {
+    size_t size = mapContainer.size();
+
+    for (unsigned int i = 0; i < size; ++i){
+      mapContainer[i].setConvergenceCriteria(minStepTranslation, minStepRotation, minResidualChangeRatio);
+    }
+  }
+
+  void setMaxIterations(int mapLevel, int maxIterationsIn)
+  {
+    maxIterations[mapLevel] = maxIterationsIn;
+  }
+
+  /**
+   * Limits the number of scan points used for matching on the given level, 0 (the default) uses all. The points are
+   * sampled evenly over the scan. Map updates always use all points.
+   */
+  void setMaxMatchPoints(int mapLevel, int maxPoints)
+  {
+    maxMatchPoints[mapLevel] = maxPoints;
+  }
+
+  /**
+   * Sets the wall clock time per scan after which no further iterations are started on the coarse levels, 0 disables it.
+   */
+  void setMatchTimeBudget(double budgetMs)
+  {
+    matchTimeBudgetMs = budgetMs;
+  }
+
+  /**
+   * Enables matching from several start poses per scan. Besides the begin estimate, numHypothesesIn - 1 seeds offset by
+   * multiples of linearOffset (m, along x and y) and angularOffset (rad) are matched through all levels concurrently on
+   * the worker pool, and the result with the lowest residual on the finest level is used. 1 (the default) disables it.
+   * Every hypothesis needs its own cache per level. Without a worker pool the hypotheses are matched one after another.
+   */
+  void setMultiHypothesisMatching(int numHypothesesIn, float linearOffset, float angularOffset)
+  {
+    numHypotheses = std::max(1, numHypothesesIn);
+    hypothesisLinearOffset = linearOffset;
+    hypothesisAngularOffset = angularOffset;
+
+    hypotheses.resize(numHypotheses);
+
+    size_t size = mapContainer.size();
+
+    for (unsigned int i = 0; i < size; ++i){
+      mapContainer[i].setNumMatchSlots(numHypotheses);
+    }
+  }
+
+  /**
+   * Returns the iteration statistics of the given level for the last matchData() call.
+   */
+  const ScanMatchStatistics& getMatchStatistics(int mapLevel) const
+  {
+    return mapContainer[mapLevel].getMatchStatistics();
+  }
+
+  typename MapLevelStorage<Level, Levels>::Type mapContainer;
 protected:
-  
-  std::vector<DataContainer> dataContainers;
+
+  WorkerPool* workerPool;
+
+  typename MapLevelStorage<int, Levels>::Type maxIterations;
+  double matchTimeBudgetMs;
+
+  typename MapLevelStorage<int, Levels>::Type maxMatchPoints;
+  typename MapLevelStorage<DataContainer, Levels>::Type sampledMatchPoints; ///< Per level buffer for the points matched, if reduced
+
+  struct Hypothesis
+  {
+    Eigen::Vector3f beginEstimateWorld;
+    Eigen::Vector3f poseWorld;
+    Eigen::Matrix3f covMatrix;
+    float residual;
+  };
+
+  int numHypotheses;
+  float hypothesisLinearOffset;
+  float hypothesisAngularOffset;
+
+  std::vector<Hypothesis> hypotheses;
+  typename MapLevelStorage<const DataContainer*, Levels>::Type hypothesisLevelPoints;
+
+  bool deriveCoarseLevels;
+  GridMapPyramidBuilder<ConcreteGridMap> pyramidBuilder;
+
+  /**
+   * Locks all levels (in level order) and returns their maps.
+   */
+  void lockLevels(std::vector<ConcreteGridMap*>& levels)
+  {
+    size_t size = mapContainer.size();
+
+    for (unsigned int i = 0; i < size; ++i){
+      if (mapContainer[i].getMapMutex()){
+        mapContainer[i].getMapMutex()->lockMap();
+      }
+
+      levels.push_back(&mapContainer[i].getGridMap());
+    }
+  }
+
+  void unlockLevels()
+  {
+    size_t size = mapContainer.size();
+
+    for (unsigned int i = 0; i < size; ++i){
+      if (mapContainer[i].getMapMutex()){
+        mapContainer[i].getMapMutex()->unlockMap();
+      }
+    }
+  }
+
+  /**
+   * Derives the cells of the coarser levels covering the cells of the finest level changed since its update index
+   * sinceUpdateIndex, or covering its whole explored area if these are not known.
+   */
+  void syncCoarseLevels(int sinceUpdateIndex)
+  {
+    std::vector<ConcreteGridMap*> levels;
+
+    this->lockLevels(levels);
+
+    Eigen::Vector2i areaMin, areaMax;
+
+    if ((sinceUpdateIndex < 0) || !levels[0]->getUpdateAreaSince(sinceUpdateIndex, areaMin, areaMax)){
+      levels[0]->getExploredArea(areaMin, areaMax);
+    }
+
+    pyramidBuilder.sync(levels, areaMin, areaMax);
+
+    this->unlockLevels();
+  }
+
+  /**
+   * Matches all hypotheses, hypothesis 0 (the begin estimate) on the calling thread, and returns the best result.
+   * Ties are resolved in favor of the lower index, so the begin estimate wins if the seeds converge to the same pose.
+   */
+  Eigen::Vector3f matchHypotheses(const Eigen::Vector3f& beginEstimateWorld, const DataContainer& dataContainer, Eigen::Matrix3f& covMatrix, const boost::posix_time::ptime& deadline)
+  {
+    int size = static_cast<int>(mapContainer.size());
+
+    //points are selected up front, the hypotheses only read them
+    for (int index = 0; index < size; ++index){
+      hypothesisLevelPoints[index] = &getMatchPoints(dataContainer, index);
+    }
+
+    for (int i = 0; i < numHypotheses; ++i){
+      hypotheses[i].beginEstimateWorld = getHypothesisSeed(beginEstimateWorld, i);
+    }
+
+    //each hypothesis uses its own slot on every level, but the map must not change during any of them
+    for (int index = 0; index < size; ++index){
+      mapContainer[index].lockForMatchingIfNeeded();
+    }
+
+    if (workerPool){
+      //the level mutexes stay locked during the wait, this relies on waitForGroup() only running tasks of this group,
+      //a level update queued by the map update thread would block on them
+      WorkerPool::TaskGroup hypothesisMatches;
+
+      for (int i = 1; i < numHypotheses; ++i){
+        workerPool->run(hypothesisMatches, boost::bind(&MapRepMultiMapT::matchHypothesis, this, i, deadline));
+      }
+
+      matchHypothesis(0, deadline);
+
+      workerPool->waitForGroup(hypothesisMatches);
+    }else{
+      for (int i = 0; i < numHypotheses; ++i){
+        matchHypothesis(i, deadline);
+      }
+    }
+
+    for (int index = size - 1; index >= 0; --index){
+      mapContainer[index].unlockForMatchingIfNeeded();
+    }
+
+    int best = 0;
+
+    for (int i = 1; i < numHypotheses; ++i){
+      if (hypotheses[i].residual < hypotheses[best].residual){
+        best = i;
+      }
+    }
+
+    for (int index = 0; index < size; ++index){
+      mapContainer[index].setStatisticsSlot(best);
+    }
+
+    covMatrix = hypotheses[best].covMatrix;
+    return hypotheses[best].poseWorld;
+  }
+
+  /**
+   * Matches hypothesis i coarse to fine in slot i of every level and scores the result on the finest level.
+   */
+  void matchHypothesis(int i, const boost::posix_time::ptime& deadline)
+  {
+    Hypothesis& hypothesis (hypotheses[i]);
+
+    Eigen::Vector3f tmp(hypothesis.beginEstimateWorld);
+
+    int size = static_cast<int>(mapContainer.size());
+
+    for (int index = size - 1; index >= 0; --index){
+      const DataContainer& levelPoints (*hypothesisLevelPoints[index]);
+
+      if (index == 0){
+        tmp = mapContainer[index].matchDataInSlot(i, tmp, levelPoints, hypothesis.covMatrix, maxIterations[index]);
+      }else{
+        tmp = mapContainer[index].matchDataInSlot(i, tmp, getLevelView(levelPoints, index), hypothesis.covMatrix, maxIterations[index], deadline);
+      }
+    }
+
+    hypothesis.poseWorld = tmp;
+    hypothesis.residual = mapContainer[0].getResidualInSlot(i, tmp, *hypothesisLevelPoints[0]);
+  }
+
+  /**
+   * Returns the start pose of hypothesis i. Seeds cycle through +-angle, +-x and +-y offsets, growing by one
+   * offset per cycle.
+   */
+  Eigen::Vector3f getHypothesisSeed(const Eigen::Vector3f& beginEstimateWorld, int i) const
+  {
+    if (i == 0){
+      return beginEstimateWorld;
+    }
+
+    static const float directions[6][3] = { {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f},
+                                            {1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f},
+                                            {0.0f, 1.0f, 0.0f}, {0.0f, -1.0f, 0.0f} };
+
+    const float* direction = directions[(i - 1) % 6];
+    float scale = static_cast<float>((i - 1) / 6 + 1);
+
+    Eigen::Vector3f seed (beginEstimateWorld + scale * Eigen::Vector3f(direction[0] * hypothesisLinearOffset,
+                                                                        direction[1] * hypothesisLinearOffset,
+                                                                        direction[2] * hypothesisAngularOffset));
+    seed[2] = util::normalize_angle(seed[2]);
+    return seed;
+  }
+
+  /**
+   * Returns the points to match on the given level, either dataContainer or a subset of it within the level's budget.
+   */
+  const DataContainer& getMatchPoints(const DataContainer& dataContainer, int level)
+  {
+    int maxPoints = maxMatchPoints[level];
+
+    if ((maxPoints <= 0) || (dataContainer.getSize() <= maxPoints)){
+      return dataContainer;
+    }
+
+    DataPointReducer::sampleStratified(dataContainer, maxPoints, sampledMatchPoints[level]);
+    return sampledMatchPoints[level];
+  }
+
+  /**
+   * Returns a view of the scan data scaled for the given map level (1 / 2^level), no data is copied.
+   */
+  DataContainerView getLevelView(const DataContainer& dataContainer, int level) const
+  {
+    return dataContainer.getView(1.0f / static_cast<float>(1 << level));
+  }
+};
+
+/**
+ * MapRepMultiMapT on GridMap, usable through MapRepresentationInterface.
+ */
+template<int Levels>
+class MapRepMultiMapLevels : public MapRepresentationInterface, public MapRepMultiMapT<Levels>
+{
+public:
+
+  typedef MapRepMultiMapT<Levels> Base;
+
+  MapRepMultiMapLevels(float mapResolution, int mapSizeX, int mapSizeY, unsigned int numDepth, const Eigen::Vector2f& startCoords, DrawInterface* drawInterfaceIn, HectorDebugInfoInterface* debugInterfaceIn)
+    : Base(mapResolution, mapSizeX, mapSizeY, numDepth, startCoords, drawInterfaceIn, debugInterfaceIn)
+  {}
+
+  virtual void reset() { Base::reset(); }
+
+  virtual float getScaleToMap() const { return Base::getScaleToMap(); }
+
+  virtual int getMapLevels() const { return Base::getMapLevels(); }
+  virtual const GridMap& getGridMap(int mapLevel) const { return Base::getGridMap(mapLevel); }
+  virtual GridMap& getGridMap(int mapLevel) { return Base::getGridMap(mapLevel); }
+  virtual void addMapMutex(int i, MapLockerInterface* mapMutex) { Base::addMapMutex(i, mapMutex); }
+  virtual MapLockerInterface* getMapMutex(int i) { return Base::getMapMutex(i); }
+
+  virtual void onMapUpdated() { Base::onMapUpdated(); }
+
+  virtual Eigen::Vector3f matchData(const Eigen::Vector3f& beginEstimateWorld, const DataContainer& dataContainer, Eigen::Matrix3f& covMatrix) { return Base::matchData(beginEstimateWorld, dataContainer, covMatrix); }
+
+  virtual void updateByScan(const DataContainer& dataContainer, const Eigen::Vector3f& robotPoseWorld) { Base::updateByScan(dataContainer, robotPoseWorld); }
+
+  virtual void setUpdateFactorFree(float free_factor) { Base::setUpdateFactorFree(free_factor); }
+  virtual void setUpdateFactorOccupied(float occupied_factor) { Base::setUpdateFactorOccupied(occupied_factor); }
+
+  virtual void setProbabilityPlaneEnabled(bool enabled) { Base::setProbabilityPlaneEnabled(enabled); }
+
+  virtual void setWorkerPool(WorkerPool* workerPool) { Base::setWorkerPool(workerPool); }
+
+  virtual void setLockMapsForMatching(bool lock) { Base::setLockMapsForMatching(lock); }
+
+  virtual void setRollingWindow(float recenterDistance, MapSpillInterface* spillInterface) { Base::setRollingWindow(recenterDistance, spillInterface); }
+
+  virtual void setCoarseLevelDerivation(bool deriveFromFinest, GridMapPyramidPooling pooling) { Base::setCoarseLevelDerivation(deriveFromFinest, pooling); }
+  virtual void rebuildCoarseLevels() { Base::rebuildCoarseLevels(); }
+
+  virtual void setConvergenceCriteria(float minStepTranslation, float minStepRotation, float minResidualChangeRatio) { Base::setConvergenceCriteria(minStepTranslation, minStepRotation, minResidualChangeRatio); }
+  virtual void setMaxIterations(int mapLevel, int maxIterations) { Base::setMaxIterations(mapLevel, maxIterations); }
+  virtual void setMaxMatchPoints(int mapLevel, int maxPoints) { Base::setMaxMatchPoints(mapLevel, maxPoints); }
+  virtual void setMatchTimeBudget(double budgetMs) { Base::setMatchTimeBudget(budgetMs); }
+  virtual void setMultiHypothesisMatching(int numHypotheses, float linearOffset, float angularOffset) { Base::setMultiHypothesisMatching(numHypotheses, linearOffset, angularOffset); }
+  virtual const ScanMatchStatistics& getMatchStatistics(int mapLevel) const { return Base::getMatchStatistics(mapLevel); }
 };
 
+/**
+ * Multi resolution map with the number of levels configured at runtime.
+ */
+typedef MapRepMultiMapLevels<0> MapRepMultiMap;
+
+/**
+ * Creates a multi resolution map with numDepth levels, using an instantiation with a fixed number of levels for the
+ * common configurations.
+ */
+inline MapRepresentationInterface* createMapRepMultiMap(float mapResolution, int mapSizeX, int mapSizeY, unsigned int numDepth, const Eigen::Vector2f& startCoords, DrawInterface* drawInterfaceIn, HectorDebugInfoInterface* debugInterfaceIn)
+{
+  switch (numDepth){
+    case 1:
+      return new MapRepMultiMapLevels<1>(mapResolution, mapSizeX, mapSizeY, numDepth, startCoords, drawInterfaceIn, debugInterfaceIn);
+    case 2:
+      return new MapRepMultiMapLevels<2>(mapResolution, mapSizeX, mapSizeY, numDepth, startCoords, drawInterfaceIn, debugInterfaceIn);
+    case 3:
+      return new MapRepMultiMapLevels<3>(mapResolution, mapSizeX, mapSizeY, numDepth, startCoords, drawInterfaceIn, debugInterfaceIn);
+    case 4:
+      return new MapRepMultiMapLevels<4>(mapResolution, mapSizeX, mapSizeY, numDepth, startCoords, drawInterfaceIn, debugInterfaceIn);
+    default:
+      return new MapRepMultiMap(mapResolution, mapSizeX, mapSizeY, numDepth, startCoords, drawInterfaceIn, debugInterfaceIn);
+  }
+}
+
 }
 
 #endif
@@ -34,6 +34,7 @@
 #include "../map/GridMap.h"
 #include "../map/OccGridMapUtilConfig.h"
 #include "../matcher/ScanMatcher.h"
+#include "../scan/DataPointReducer.h"
 
 #include "../util/DrawInterface.h"
 #include "../util/HectorDebugInfoInterface.h"
@@ -49,6 +50,10 @@ public:
     gridMap = new hectorslam::GridMap(mapResolution,Eigen::Vector2i(1024,1024), Eigen::Vector2f(20.0f, 20.0f));
     gridMapUtil = new OccGridMapUtilConfig<GridMap>(gridMap);
     scanMatcher = new hectorslam::ScanMatcher<OccGridMapUtilConfig<GridMap> >(drawInterfaceIn, debugInterfaceIn);
+    maxIterations = 20;
+    maxMatchPoints = 0;
+    rollingWindowDistance = 0.0f;
+    spillInterface = 0;
   }
 
   virtual ~MapRepSingleMap()
@@ -76,18 +81,82 @@ public:
 
   virtual Eigen::Vector3f matchData(const Eigen::Vector3f& beginEstimateWorld, const DataContainer& dataContainer, Eigen::Matrix3f& covMatrix)
   {
-    return scanMatcher->matchData(beginEstimateWorld, *gridMapUtil, dataContainer, covMatrix, 20);
+    if ((maxMatchPoints > 0) && (dataContainer.getSize() > maxMatchPoints)){
+      DataPointReducer::sampleStratified(dataContainer, maxMatchPoints, sampledMatchPoints);
+      return scanMatcher->matchData(beginEstimateWorld, *gridMapUtil, sampledMatchPoints, covMatrix, maxIterations);
+    }
+
+    return scanMatcher->matchData(beginEstimateWorld, *gridMapUtil, dataContainer, covMatrix, maxIterations);
   }
 
   virtual void updateByScan(const DataContainer& dataContainer, const Eigen::Vector3f& robotPoseWorld)
   {
+    if (rollingWindowDistance > 0.0f){
+      gridMap->centerWindowOn(robotPoseWorld.head<2>(), rollingWindowDistance, spillInterface);
+    }
+
     gridMap->updateByScan(dataContainer, robotPoseWorld);
   }
 
+  virtual void setProbabilityPlaneEnabled(bool enabled)
+  {
+    gridMap->setProbabilityPlaneEnabled(enabled);
+  }
+
+  virtual void setWorkerPool(WorkerPool* workerPool)
+  {
+    gridMap->setWorkerPool(workerPool);
+  }
+
+  virtual void setLockMapsForMatching(bool lock)
+  {}
+
+  virtual void setRollingWindow(float recenterDistance, MapSpillInterface* spillInterfaceIn)
+  {
+    rollingWindowDistance = recenterDistance;
+    spillInterface = spillInterfaceIn;
+  }
+
+  //a single level has no coarser levels
+  virtual void setCoarseLevelDerivation(bool deriveFromFinest, GridMapPyramidPooling pooling) {};
+  virtual void rebuildCoarseLevels() {};
+
+  virtual void setConvergenceCriteria(float minStepTranslation, float minStepRotation, float minResidualChangeRatio)
+  {
+    scanMatcher->setConvergenceCriteria(minStepTranslation, minStepRotation, minResidualChangeRatio);
+  }
+
+  virtual void setMaxIterations(int mapLevel, int maxIterationsIn)
+  {
+    maxIterations = maxIterationsIn;
+  }
+
+  virtual void setMaxMatchPoints(int mapLevel, int maxPoints)
+  {
+    maxMatchPoints = maxPoints;
+  }
+
+  virtual void setMatchTimeBudget(double budgetMs)
+  {}
+
+  virtual void setMultiHypothesisMatching(int numHypotheses, float linearOffset, float angularOffset)
+  {}
+
+  virtual const ScanMatchStatistics& getMatchStatistics(int mapLevel) const
+  {
+    return scanMatcher->getLastStatistics();
+  }
+
 protected:
   GridMap* gridMap;
   OccGridMapUtilConfig<GridMap>* gridMapUtil;
   ScanMatcher<OccGridMapUtilConfig<GridMap> >* scanMatcher;
+  int maxIterations;
+  int maxMatchPoints;
+  DataContainer sampledMatchPoints;
+
+  float rollingWindowDistance;
+  MapSpillInterface* spillInterface;
 };
 
 }
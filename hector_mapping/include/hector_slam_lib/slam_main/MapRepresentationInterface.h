@@ -29,12 +29,17 @@
 #ifndef _hectormaprepresentationinterface_h__
 #define _hectormaprepresentationinterface_h__
 
+#include "../map/GridMapPyramidBuilder.h"
+
 class GridMap;
 class ConcreteOccGridMapUtil;
 class DataContainer;
 
 namespace hectorslam{
 
+class WorkerPool;
+struct ScanMatchStatistics;
+
 class MapRepresentationInterface
 {
 public:
@@ -47,7 +52,7 @@ public:
 
   virtual int getMapLevels() const = 0;
   virtual const GridMap& getGridMap(int mapLevel = 0) const = 0;
-  //virtual GridMap& getGridMap(int mapLevel = 0) const = 0;
+  virtual GridMap& getGridMap(int mapLevel = 0) = 0;
   virtual void addMapMutex(int i, MapLockerInterface* mapMutex) = 0;
   virtual MapLockerInterface* getMapMutex(int i) = 0;
 
@@ -59,6 +64,24 @@ public:
 
   virtual void setUpdateFactorFree(float free_factor) = 0;
   virtual void setUpdateFactorOccupied(float occupied_factor) = 0;
+
+  virtual void setProbabilityPlaneEnabled(bool enabled) = 0;
+
+  virtual void setWorkerPool(WorkerPool* workerPool) = 0;
+
+  virtual void setLockMapsForMatching(bool lock) = 0;
+
+  virtual void setRollingWindow(float recenterDistance, MapSpillInterface* spillInterface) = 0;
+
+  virtual void setCoarseLevelDerivation(bool deriveFromFinest, GridMapPyramidPooling pooling) = 0;
+  virtual void rebuildCoarseLevels() = 0;
+
+  virtual void setConvergenceCriteria(float minStepTranslation, float minStepRotation, float minResidualChangeRatio) = 0;
+  virtual void setMaxIterations(int mapLevel, int maxIterations) = 0;
+  virtual void setMaxMatchPoints(int mapLevel, int maxPoints) = 0;
+  virtual void setMatchTimeBudget(double budgetMs) = 0;
+  virtual void setMultiHypothesisMatching(int numHypotheses, float linearOffset, float angularOffset) = 0;
+  virtual const ScanMatchStatistics& getMatchStatistics(int mapLevel) const = 0;
 };
 
 }
@@ -32,6 +32,7 @@
 class MapLockerInterface
 {
 public:
+  virtual ~MapLockerInterface() {}
   virtual void lockMap() = 0;
   virtual void unlockMap() = 0;
 };
@@ -0,0 +1,123 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#ifndef simdfunctions_h__
+#define simdfunctions_h__
+
+// Selects the vector instruction set used by the batched scan matching code at compile time.
+// AVX2 is used if the compiler targets it (e.g. -mavx2), SSE2 otherwise. Define SLAM_DISABLE_SIMD
+// to force the scalar code path.
+//#define SLAM_DISABLE_SIMD
+#if !defined(SLAM_DISABLE_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define SLAM_USE_SIMD
+#define SLAM_USE_AVX2
+#elif !defined(SLAM_DISABLE_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SLAM_USE_SIMD
+#define SLAM_USE_SSE2
+#endif
+
+#ifdef SLAM_USE_SIMD
+
+namespace simd{
+
+#ifdef SLAM_USE_AVX2
+
+typedef __m256 Floats;
+typedef __m256i Ints;
+
+enum { width = 8 };
+
+static inline Floats set1(float val) { return _mm256_set1_ps(val); }
+static inline Floats zero() { return _mm256_setzero_ps(); }
+static inline Floats load(const float* src) { return _mm256_loadu_ps(src); }
+static inline void store(float* dst, Floats val) { _mm256_storeu_ps(dst, val); }
+static inline void store(int* dst, Ints val) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), val); }
+
+static inline Floats add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+static inline Floats sub(Floats a, Floats b) { return _mm256_sub_ps(a, b); }
+static inline Floats mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+
+static inline Floats lessThan(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline Floats greaterThan(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline Floats orMask(Floats a, Floats b) { return _mm256_or_ps(a, b); }
+static inline Floats clearMasked(Floats mask, Floats val) { return _mm256_andnot_ps(mask, val); }
+static inline int moveMask(Floats mask) { return _mm256_movemask_ps(mask); }
+
+static inline Ints truncate(Floats val) { return _mm256_cvttps_epi32(val); }
+static inline Floats toFloats(Ints val) { return _mm256_cvtepi32_ps(val); }
+
+static inline float horizontalSum(Floats val)
+{
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(val), _mm256_extractf128_ps(val, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+#else
+
+typedef __m128 Floats;
+typedef __m128i Ints;
+
+enum { width = 4 };
+
+static inline Floats set1(float val) { return _mm_set1_ps(val); }
+static inline Floats zero() { return _mm_setzero_ps(); }
+static inline Floats load(const float* src) { return _mm_loadu_ps(src); }
+static inline void store(float* dst, Floats val) { _mm_storeu_ps(dst, val); }
+static inline void store(int* dst, Ints val) { _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), val); }
+
+static inline Floats add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+static inline Floats sub(Floats a, Floats b) { return _mm_sub_ps(a, b); }
+static inline Floats mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+
+static inline Floats lessThan(Floats a, Floats b) { return _mm_cmplt_ps(a, b); }
+static inline Floats greaterThan(Floats a, Floats b) { return _mm_cmpgt_ps(a, b); }
+static inline Floats orMask(Floats a, Floats b) { return _mm_or_ps(a, b); }
+static inline Floats clearMasked(Floats mask, Floats val) { return _mm_andnot_ps(mask, val); }
+static inline int moveMask(Floats mask) { return _mm_movemask_ps(mask); }
+
+static inline Ints truncate(Floats val) { return _mm_cvttps_epi32(val); }
+static inline Floats toFloats(Ints val) { return _mm_cvtepi32_ps(val); }
+
+static inline float horizontalSum(Floats val)
+{
+  __m128 sum = _mm_add_ps(val, _mm_movehl_ps(val, val));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+#endif
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#ifndef __WorkerPool_h_
+#define __WorkerPool_h_
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <boost/bind/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace hectorslam {
+
+/**
+ * Small persistent thread pool for fork-join parallelism. Tasks are added to a TaskGroup with run() and
+ * waitForGroup() blocks until all tasks of the group are done. A waiting thread executes the queued tasks of its own
+ * group itself, so waiting from within a task (nested parallelism) does not deadlock. Tasks of other groups are never
+ * run by a waiting thread, so a caller may hold locks while waiting as long as its own tasks do not take them.
+ * A pool with zero worker threads executes every task directly in run().
+ */
+class WorkerPool
+{
+public:
+
+  typedef boost::function<void ()> Task;
+
+  /**
+   * Counts the unfinished tasks of one fork-join section. Must outlive the waitForGroup() call.
+   */
+  class TaskGroup
+  {
+  public:
+    TaskGroup() : numPending(0) {};
+
+  protected:
+    friend class WorkerPool;
+    int numPending;
+  };
+
+  WorkerPool(int numThreads)
+    : stopRequested(false)
+  {
+    for (int i = 0; i < numThreads; ++i) {
+      threads.push_back(new boost::thread(boost::bind(&WorkerPool::workerLoop, this)));
+    }
+  }
+
+  ~WorkerPool()
+  {
+    {
+      boost::mutex::scoped_lock lock(queueMutex);
+      stopRequested = true;
+    }
+
+    taskAvailable.notify_all();
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+      threads[i]->join();
+      delete threads[i];
+    }
+  }
+
+  int getNumThreads() const { return static_cast<int>(threads.size()); };
+
+  /**
+   * Queues task as part of group.
+   */
+  void run(TaskGroup& group, const Task& task)
+  {
+    if (threads.empty()) {
+      task();
+      return;
+    }
+
+    {
+      boost::mutex::scoped_lock lock(queueMutex);
+      ++group.numPending;
+      queue.push_back(QueueEntry(task, &group));
+    }
+
+    taskAvailable.notify_one();
+  }
+
+  /**
+   * Blocks until all tasks of group have finished, executing queued tasks of group in the meantime. Tasks of other
+   * groups (e.g. queued by other threads while the caller holds a lock they need) are left to the workers.
+   */
+  void waitForGroup(TaskGroup& group)
+  {
+    boost::mutex::scoped_lock lock(queueMutex);
+
+    while (group.numPending > 0) {
+      std::deque<QueueEntry>::iterator it = queue.begin();
+
+      while ((it != queue.end()) && (it->group != &group)) {
+        ++it;
+      }
+
+      if (it != queue.end()) {
+        executeEntry(lock, it);
+      } else {
+        taskDone.wait(lock);
+      }
+    }
+  }
+
+  /**
+   * Calls function(begin, end) on consecutive index ranges that together cover [0, count), distributed over the
+   * worker threads and the calling thread, and waits for all of them.
+   */
+  void parallelFor(int count, const boost::function<void (int, int)>& function)
+  {
+    int numChunks = std::min(count, getNumThreads() + 1);
+
+    if (numChunks <= 1) {
+      if (count > 0) {
+        function(0, count);
+      }
+      return;
+    }
+
+    TaskGroup group;
+
+    for (int i = 1; i < numChunks; ++i) {
+      run(group, boost::bind(function, (count * i) / numChunks, (count * (i + 1)) / numChunks));
+    }
+
+    function(0, count / numChunks);
+
+    waitForGroup(group);
+  }
+
+protected:
+
+  struct QueueEntry
+  {
+    QueueEntry(const Task& taskIn, TaskGroup* groupIn) : task(taskIn), group(groupIn) {};
+
+    Task task;
+    TaskGroup* group;
+  };
+
+  /**
+   * Removes the queued task at it from the queue and executes it, the lock is released while the task runs.
+   */
+  void executeEntry(boost::mutex::scoped_lock& lock, std::deque<QueueEntry>::iterator it)
+  {
+    QueueEntry entry (*it);
+    queue.erase(it);
+
+    lock.unlock();
+    entry.task();
+    lock.lock();
+
+    --entry.group->numPending;
+    taskDone.notify_all();
+  }
+
+  void workerLoop()
+  {
+    boost::mutex::scoped_lock lock(queueMutex);
+
+    while (true) {
+      while (queue.empty() && !stopRequested) {
+        taskAvailable.wait(lock);
+      }
+
+      if (queue.empty()) {
+        return;
+      }
+
+      executeEntry(lock, queue.begin());
+    }
+  }
+
+private:
+
+  //not copyable, owns its threads
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+
+  std::vector<boost::thread*> threads;
+  std::deque<QueueEntry> queue;
+
+  boost::mutex queueMutex;
+  boost::condition_variable taskAvailable;
+  boost::condition_variable taskDone;
+
+  bool stopRequested;
+};
+
+}
+
+#endif
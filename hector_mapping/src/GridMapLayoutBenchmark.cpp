@@ -0,0 +1,165 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+//Compares the row major and tiled grid map layouts, the array and hash caches and the probability plane on large maps. Only depends on hector_slam_lib, run as
+//  grid_map_layout_benchmark [map size in cells, default 4096] [number of scans, default 400]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "map/GridMap.h"
+#include "map/OccGridMapUtil.h"
+#include "map/GridMapCacheArray.h"
+#include "map/GridMapCacheHash.h"
+
+using namespace hectorslam;
+
+typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutRowMajor> RowMajorGridMap;
+typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutRowMajorPow2> RowMajorPow2GridMap;
+typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutTiled<3> > Tiled8GridMap;
+typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutTiled<4> > Tiled16GridMap;
+typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutSparse<6> > Sparse64GridMap;
+typedef OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, GridMapLayoutToroidal> ToroidalGridMap;
+
+static double getElapsedMs(const boost::posix_time::ptime& start)
+{
+  return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() * 0.001;
+}
+
+/**
+ * Synthetic 270 degree scan with 1080 beams and ranges up to 30m, so rays cross many tiles in all directions.
+ */
+static void createScan(DataContainer& dataContainer, float scaleToMap, float phase)
+{
+  dataContainer.clear();
+  dataContainer.setOrigo(Eigen::Vector2f::Zero());
+
+  for (int i = 0; i < 1080; ++i) {
+    float angle = -2.356f + i * (4.712f / 1080.0f);
+    float range = 16.0f + 10.0f * std::sin(3.0f * angle + phase) + 4.0f * std::cos(7.0f * angle);
+    dataContainer.add(Eigen::Vector2f(std::cos(angle) * range, std::sin(angle) * range) * scaleToMap);
+  }
+}
+
+/**
+ * Robot poses spread over the whole map in world coordinates, so the benchmark does not run from a warm cache.
+ */
+static void createPoses(std::vector<Eigen::Vector3f>& poses, int numPoses, float mapExtent)
+{
+  std::srand(42);
+
+  float border = 35.0f;
+  float range = mapExtent - 2.0f * border;
+
+  for (int i = 0; i < numPoses; ++i) {
+    float x = border + range * (std::rand() / static_cast<float>(RAND_MAX));
+    float y = border + range * (std::rand() / static_cast<float>(RAND_MAX));
+    float yaw = 6.283f * (std::rand() / static_cast<float>(RAND_MAX));
+    poses.push_back(Eigen::Vector3f(x, y, yaw));
+  }
+}
+
+template<typename ConcreteGridMap, typename ConcreteCacheMethod>
+void runBenchmark(const char* name, int mapSize, const std::vector<Eigen::Vector3f>& poses, bool useProbabilityPlane = false)
+{
+  float cellLength = 0.05f;
+
+  ConcreteGridMap gridMap(cellLength, Eigen::Vector2i(mapSize, mapSize), Eigen::Vector2f::Zero());
+  gridMap.setUpdateFreeFactor(0.4f);
+  gridMap.setUpdateOccupiedFactor(0.9f);
+  gridMap.setProbabilityPlaneEnabled(useProbabilityPlane);
+
+  OccGridMapUtil<ConcreteGridMap, ConcreteCacheMethod> gridMapUtil(&gridMap);
+
+  DataContainer dataContainer;
+
+  int numPoses = static_cast<int>(poses.size());
+
+  boost::posix_time::ptime start (boost::posix_time::microsec_clock::universal_time());
+
+  for (int i = 0; i < numPoses; ++i) {
+    createScan(dataContainer, gridMap.getScaleToMap(), static_cast<float>(i));
+    gridMap.updateByScan(dataContainer, poses[i]);
+  }
+
+  double updateMs = getElapsedMs(start);
+
+  Eigen::Matrix3f H;
+  Eigen::Vector3f dTr;
+  float checksum = 0.0f;
+
+  start = boost::posix_time::microsec_clock::universal_time();
+
+  for (int i = 0; i < numPoses; ++i) {
+    createScan(dataContainer, gridMap.getScaleToMap(), static_cast<float>(i));
+
+    //offset the pose like an odometry prior would, then take a few Gauss-Newton steps worth of map reads
+    Eigen::Vector3f mapPose (gridMap.getMapCoordsPose(poses[i]));
+    mapPose += Eigen::Vector3f(1.5f, -1.0f, 0.02f);
+
+    gridMapUtil.resetCachedData();
+
+    for (int j = 0; j < 5; ++j) {
+      gridMapUtil.getCompleteHessianDerivs(mapPose, dataContainer, H, dTr);
+      mapPose[0] -= 0.2f;
+      checksum += dTr.norm();
+    }
+  }
+
+  double matchMs = getElapsedMs(start);
+
+  std::printf("%-22s %6d  update %9.3f ms/scan  match %9.3f ms/scan  storage %6.1f Mcells  (checksum %g)\n",
+              name, mapSize, updateMs / numPoses, matchMs / numPoses, gridMap.getStorageSize() * 1.0e-6, checksum);
+}
+
+int main(int argc, char** argv)
+{
+  int mapSize = argc > 1 ? std::atoi(argv[1]) : 4096;
+  int numPoses = argc > 2 ? std::atoi(argv[2]) : 400;
+
+  std::vector<Eigen::Vector3f> poses;
+  createPoses(poses, numPoses, mapSize * 0.05f);
+
+  runBenchmark<RowMajorGridMap, GridMapCacheArray>("row major", mapSize, poses);
+  runBenchmark<RowMajorPow2GridMap, GridMapCacheArray>("row major pow2", mapSize, poses);
+  runBenchmark<Tiled8GridMap, GridMapCacheArray>("tiled 8x8", mapSize, poses);
+  runBenchmark<Tiled16GridMap, GridMapCacheArray>("tiled 16x16", mapSize, poses);
+  runBenchmark<Sparse64GridMap, GridMapCacheArray>("sparse 64x64", mapSize, poses);
+  runBenchmark<ToroidalGridMap, GridMapCacheArray>("toroidal", mapSize, poses);
+  runBenchmark<RowMajorGridMap, GridMapCacheHash>("row major, hash cache", mapSize, poses);
+  runBenchmark<Tiled8GridMap, GridMapCacheHash>("tiled 8x8, hash cache", mapSize, poses);
+  runBenchmark<Sparse64GridMap, GridMapCacheHash>("sparse 64x64, hash", mapSize, poses);
+  runBenchmark<RowMajorGridMap, GridMapCacheArray>("row major, plane", mapSize, poses, true);
+  runBenchmark<Tiled8GridMap, GridMapCacheArray>("tiled 8x8, plane", mapSize, poses, true);
+
+  return 0;
+}
@@ -29,6 +29,7 @@
 #include "HectorMappingRos.h"
 
 #include "map/GridMap.h"
+#include "map/GridMapOccupancyConversion.h"
 
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 #include <nav_msgs/Odometry.h>
@@ -46,11 +47,7 @@
 #include <boost/foreach.hpp>
 #include <sensor_msgs/LaserScan.h>
 #include <nav_msgs/OccupancyGrid.h>
-#include <fstream>
 #include <Eigen/Geometry>
-#include <pcl/io/pcd_io.h>
-#include <pcl/point_types.h>
-#include <pcl/registration/icp.h>
 //Mod by sameer
 
 #ifndef TF_SCALAR_H
@@ -60,7 +57,7 @@ using namespace std;
 HectorMappingRos::HectorMappingRos()
 : debugInfoProvider(0)
 , hectorDrawings(0)
-, lastGetMapUpdateIndex(-100)
+, tfCache_(tf_)
 , tfB_(0)
 , map__publish_thread_(0)
 , initial_pose_set_(false)
@@ -69,17 +66,22 @@ HectorMappingRos::HectorMappingRos()
 , first_scan_(true)
 , initial_pose_slam_()
 , mapr_()
-, map_points_()
-, initialscanguess_()
+, mapFileThread_(0)
+, relocThread_(0)
+, relocFound_(false)
+, relocScore_(0.0f)
 {
 	ros::NodeHandle private_nh_("~");
 
 	std::string mapTopic_ = "map";
 	//Mod by Sameer
 	private_nh_.param("load_map", load_map_, false);
+	private_nh_.param("map_file", p_map_file_, std::string(""));
 	//Mod by Sameer
 	private_nh_.param("pub_drawings", p_pub_drawings, false);
 	private_nh_.param("pub_debug_output", p_pub_debug_output_, false);
+	private_nh_.param("pub_map_updates", p_pub_map_updates_, false);
+	private_nh_.param("map_crop_to_explored", p_map_crop_to_explored_, false);
 	private_nh_.param("pub_map_odom_transform", p_pub_map_odom_transform_,true);
 	private_nh_.param("pub_odometry", p_pub_odometry_,false);
 	private_nh_.param("advertise_map_service", p_advertise_map_service_,true);
@@ -90,20 +92,53 @@ HectorMappingRos::HectorMappingRos()
 	private_nh_.param("map_start_x", p_map_start_x_, 0.5);
 	private_nh_.param("map_start_y", p_map_start_y_, 0.5);
 	private_nh_.param("map_multi_res_levels", p_map_multi_res_levels_, 3);
+	private_nh_.param("worker_threads", p_worker_threads_, 0);
 
 	private_nh_.param("update_factor_free", p_update_factor_free_, 0.4);
 	private_nh_.param("update_factor_occupied", p_update_factor_occupied_, 0.9);
+	private_nh_.param("use_probability_plane", p_use_probability_plane_, false);
 
 	private_nh_.param("map_update_distance_thresh", p_map_update_distance_threshold_, 0.4);
 	private_nh_.param("map_update_angle_thresh", p_map_update_angle_threshold_, 0.9);
 
+	private_nh_.param("match_min_step_cells", p_match_min_step_cells_, 0.02);
+	private_nh_.param("match_min_step_angle", p_match_min_step_angle_, 0.001);
+	private_nh_.param("match_min_residual_change", p_match_min_residual_change_, 0.001);
+	private_nh_.param("match_time_budget_ms", p_match_time_budget_ms_, 0.0);
+
+	private_nh_.param("match_hypotheses", p_match_hypotheses_, 1);
+	private_nh_.param("match_hypothesis_linear_offset", p_match_hypothesis_linear_offset_, 0.1);
+	private_nh_.param("match_hypothesis_angular_offset", p_match_hypothesis_angular_offset_, 0.3);
+
+	//rolling window mode: the map follows the robot, by default once it is a quarter of the map size off the center
+	private_nh_.param("map_rolling_window", p_map_rolling_window_, false);
+	private_nh_.param("map_rolling_window_recenter_distance", p_map_rolling_window_recenter_distance_, 0.25 * p_map_resolution_ * p_map_size_);
+
+	//coarse levels pooled from the finest one ("max" or "mean"), on every update or only after loading a map
+	private_nh_.param("map_derive_coarse_levels", p_map_derive_coarse_levels_, false);
+	private_nh_.param("map_pyramid_pooling", p_map_pyramid_pooling_, std::string("max"));
+
+	private_nh_.param("match_max_points", p_match_max_points_, 0);
+	private_nh_.param("match_max_points_coarse", p_match_max_points_coarse_, 0);
+
+	private_nh_.param("scan_reduction_cell_size", p_scan_reduction_cell_size_, 0.0);
+	private_nh_.param("scan_reduction_min_distance", p_scan_reduction_min_distance_, 0.0);
+	private_nh_.param("scan_reduction_max_points", p_scan_reduction_max_points_, 0);
+
+	private_nh_.param("reloc_linear_window", p_reloc_linear_window_, 1.0);
+	private_nh_.param("reloc_angular_window", p_reloc_angular_window_, M_PI);
+	private_nh_.param("reloc_min_score", p_reloc_min_score_, 0.55);
+
 	private_nh_.param("scan_topic", p_scan_topic_, std::string("scan"));
 	private_nh_.param("sys_msg_topic", p_sys_msg_topic_, std::string("syscommand"));
 	private_nh_.param("pose_update_topic", p_pose_update_topic_, std::string("poseupdate"));
 
 	private_nh_.param("use_tf_scan_transformation", p_use_tf_scan_transformation_,true);
 	private_nh_.param("use_tf_pose_start_estimate", p_use_tf_pose_start_estimate_,false);
+	private_nh_.param("laser_transform_static", p_laser_transform_static_, false);
+	private_nh_.param("tf_max_age", p_tf_max_age_, 0.5);
 	private_nh_.param("map_with_known_poses", p_map_with_known_poses_, false);
+	private_nh_.param("pipelined_map_update", p_pipelined_map_update_, false);
 
 	private_nh_.param("base_frame", p_base_frame_, std::string("base_link"));
 	private_nh_.param("map_frame", p_map_frame_, std::string("map"));
@@ -129,6 +164,8 @@ HectorMappingRos::HectorMappingRos()
 	private_nh_.param("laser_z_max_value", tmp, 1.0);
 	p_laser_z_max_value_ = static_cast<float>(tmp);
 
+	laserScanConverter_.setFilter(sqrt(p_sqr_laser_min_dist_), sqrt(p_sqr_laser_max_dist_), p_laser_z_min_value_, p_laser_z_max_value_);
+
 	if (p_pub_drawings)
 	{
 		ROS_INFO("HectorSM publishing debug drawings");
@@ -149,8 +186,27 @@ HectorMappingRos::HectorMappingRos()
 	slamProcessor = new hectorslam::HectorSlamProcessor(static_cast<float>(p_map_resolution_), p_map_size_, p_map_size_, Eigen::Vector2f(p_map_start_x_, p_map_start_y_), p_map_multi_res_levels_, hectorDrawings, debugInfoProvider);
 	slamProcessor->setUpdateFactorFree(p_update_factor_free_);
 	slamProcessor->setUpdateFactorOccupied(p_update_factor_occupied_);
+	slamProcessor->setProbabilityPlaneEnabled(p_use_probability_plane_);
+	slamProcessor->setNumWorkerThreads(p_worker_threads_);
+	slamProcessor->setPipelinedMapUpdate(p_pipelined_map_update_);
 	slamProcessor->setMapUpdateMinDistDiff(p_map_update_distance_threshold_);
 	slamProcessor->setMapUpdateMinAngleDiff(p_map_update_angle_threshold_);
+	slamProcessor->setConvergenceCriteria(p_match_min_step_cells_, p_match_min_step_angle_, p_match_min_residual_change_);
+	slamProcessor->setMatchTimeBudget(p_match_time_budget_ms_);
+	slamProcessor->setMultiHypothesisMatching(p_match_hypotheses_, static_cast<float>(p_match_hypothesis_linear_offset_), static_cast<float>(p_match_hypothesis_angular_offset_));
+	slamProcessor->setRollingWindow(p_map_rolling_window_ ? static_cast<float>(p_map_rolling_window_recenter_distance_) : 0.0f);
+	slamProcessor->setCoarseLevelDerivation(p_map_derive_coarse_levels_, (p_map_pyramid_pooling_ == "mean") ? hectorslam::PyramidPoolingMean : hectorslam::PyramidPoolingMax);
+
+	for (int i = 0; i < slamProcessor->getMapLevels(); ++i)
+	{
+		slamProcessor->setMaxMatchPoints(i, (i == 0) ? p_match_max_points_ : p_match_max_points_coarse_);
+	}
+
+	//the scan containers are in map cells of the finest level
+	float scaleToMap = slamProcessor->getScaleToMap();
+	scanReducer_.setCellSize(static_cast<float>(p_scan_reduction_cell_size_) * scaleToMap);
+	scanReducer_.setMinPointDistance(static_cast<float>(p_scan_reduction_min_distance_) * scaleToMap);
+	scanReducer_.setMaxPoints(p_scan_reduction_max_points_);
 
 	int mapLevels = slamProcessor->getMapLevels();
 	mapLevels = 1;
@@ -171,9 +227,16 @@ HectorMappingRos::HectorMappingRos()
 		mapMetaTopicStr.append("_metadata");
 
 		MapPublisherContainer& tmp = mapPubContainer[i];
-		tmp.mapPublisher_ = node_.advertise<nav_msgs::OccupancyGrid>(mapTopicStr, 1, true);
+		tmp.mapSnapshot_.reset(new hectorslam::GridMapSnapshot<hectorslam::GridMap>());
+		tmp.mapMessageMutex_.reset(new boost::mutex());
+		tmp.mapPublisher_ = node_.advertise<nav_msgs::OccupancyGrid>(mapTopicStr, 1, boost::bind(&HectorMappingRos::mapSubscriberConnected, this, _1, i), ros::SubscriberStatusCallback(), ros::VoidConstPtr(), true);
 		tmp.mapMetadataPublisher_ = node_.advertise<nav_msgs::MapMetaData>(mapMetaTopicStr, 1, true);
 
+		if (p_pub_map_updates_)
+		{
+			tmp.mapUpdatePublisher_ = node_.advertise<map_msgs::OccupancyGridUpdate>(mapTopicStr + "_updates", 10, false);
+		}
+
 		if ( (i == 0) && p_advertise_map_service_)
 		{
 			tmp.dynamicMapServiceServer_ = node_.advertiseService("dynamic_map", &HectorMappingRos::mapCallback, this);
@@ -194,12 +257,25 @@ HectorMappingRos::HectorMappingRos()
 	ROS_INFO("HectorSM p_pub_map_odom_transform_: %s", p_pub_map_odom_transform_ ? ("true") : ("false"));
 	ROS_INFO("HectorSM p_scan_subscriber_queue_size_: %d", p_scan_subscriber_queue_size_);
 	ROS_INFO("HectorSM p_map_pub_period_: %f", p_map_pub_period_);
+	ROS_INFO("HectorSM p_pub_map_updates_: %s", p_pub_map_updates_ ? ("true") : ("false"));
+	ROS_INFO("HectorSM p_map_crop_to_explored_: %s", p_map_crop_to_explored_ ? ("true") : ("false"));
+	ROS_INFO("HectorSM p_map_file_: %s", p_map_file_.c_str());
 	ROS_INFO("HectorSM p_update_factor_free_: %f", p_update_factor_free_);
 	ROS_INFO("HectorSM p_update_factor_occupied_: %f", p_update_factor_occupied_);
 	ROS_INFO("HectorSM p_map_update_distance_threshold_: %f ", p_map_update_distance_threshold_);
 	ROS_INFO("HectorSM p_map_update_angle_threshold_: %f", p_map_update_angle_threshold_);
+	ROS_INFO("HectorSM p_map_rolling_window_: %s", p_map_rolling_window_ ? ("true") : ("false"));
+	ROS_INFO("HectorSM p_map_rolling_window_recenter_distance_: %f", p_map_rolling_window_recenter_distance_);
+	ROS_INFO("HectorSM p_map_derive_coarse_levels_: %s", p_map_derive_coarse_levels_ ? ("true") : ("false"));
+	ROS_INFO("HectorSM p_map_pyramid_pooling_: %s", p_map_pyramid_pooling_.c_str());
 	ROS_INFO("HectorSM p_laser_z_min_value_: %f", p_laser_z_min_value_);
 	ROS_INFO("HectorSM p_laser_z_max_value_: %f", p_laser_z_max_value_);
+	ROS_INFO("HectorSM p_laser_transform_static_: %s", p_laser_transform_static_ ? ("true") : ("false"));
+	ROS_INFO("HectorSM p_tf_max_age_: %f", p_tf_max_age_);
+
+	tfCache_.setMaxAge(ros::Duration(p_tf_max_age_));
+	tfCache_.subscribeStaticChanges(node_);
+
 	scanSubscriber_ = node_.subscribe(p_scan_topic_, p_scan_subscriber_queue_size_, &HectorMappingRos::scanCallback, this);
 	sysMsgSubscriber_ = node_.subscribe(p_sys_msg_topic_, 2, &HectorMappingRos::sysMsgCallback, this);
 	initialposesubscriber_ = private_nh_.subscribe("/initialpose",1,&HectorMappingRos::initPoseCallback,this);
@@ -247,6 +323,16 @@ load_status_ = true;
 
 HectorMappingRos::~HectorMappingRos()
 {
+	//a running relocalization uses the worker pool of the slam processor
+	finishPoseCorrection();
+
+	//a running save reads the map levels
+	if (mapFileThread_)
+	{
+		mapFileThread_->join();
+		delete mapFileThread_;
+	}
+
 	delete slamProcessor;
 
 	if (hectorDrawings)
@@ -261,189 +347,133 @@ HectorMappingRos::~HectorMappingRos()
 	if(map__publish_thread_)
 	delete map__publish_thread_;
 }
-void HectorMappingRos::poseCorrection(sensor_msgs::LaserScan scan)
+void HectorMappingRos::poseCorrection(const sensor_msgs::LaserScan& scan)
 {
+	//a search started for a previous initial pose still uses the relocalizer
+	finishPoseCorrection();
 
-    double minangle = 0, maxangle = 0, angleinc = 0, minrange = 0, maxrange = 0, lrange = 0, laserx = 0, lasery = 0, current_angle = 0;
-    minangle = scan.angle_min;
-    maxangle = scan.angle_max;
-    minrange = scan.range_min;
-    maxrange = scan.range_max;
-    angleinc = scan.angle_increment;
-    double size_estimate;
-    size_estimate = (maxangle - minangle) / angleinc + 1;
-    for (int i = 0; i < int(size_estimate); i++)
-    {
-        lrange = scan.ranges[i];
-        if (lrange >= minrange && lrange <= maxrange)
-        {
-            current_angle = minangle + i * angleinc;
-            laserx = lrange * cos(current_angle);
-            lasery = lrange * sin(current_angle);
-        }
-    }
+	tf::Pose guessTf;
+	tf::poseMsgToTF(initial_pose_slam_->pose.pose, guessTf);
+	Eigen::Vector3f guessPose(initial_pose_slam_->pose.pose.position.x, initial_pose_slam_->pose.pose.position.y, tf::getYaw(guessTf.getRotation()));
 
-    geometry_msgs::PoseWithCovarianceStamped guesspose;
-    guesspose = *initial_pose_slam_;
-    // Basically we want to transform the points from the laser frame to the
-    // world frame, for this purpose we need two transforms, one from the laser
-    // frame to the base frame and one from the base frame to the world frame the
-    // transform from the laser frame to the base frame is already given and is
-    // fixed. The transform from the base frame to the world frame is on which we
-    // have to determine, after correction using ICP. This is given in the form
-    // of a "guesspose" and is then refined and this refinement is reflected in
-    // the form of an updated guesspose of the robot which in turn is the updated
-    // initial pose of the robot. Make the transformation matrix from the base
-    // frame of the robot to the world
-    Eigen::Quaternionf quat_base_world(
-            guesspose.pose.pose.orientation.w,
-            guesspose.pose.pose.orientation.x,
-            guesspose.pose.pose.orientation.y,
-            guesspose.pose.pose.orientation.z);
-    Eigen::Matrix3f rot_base_world = quat_base_world.toRotationMatrix();
-    Eigen::Vector4f t_base_world;
-    t_base_world(0) = guesspose.pose.pose.position.x;
-    t_base_world(1) = guesspose.pose.pose.position.y;
-    t_base_world(2) = guesspose.pose.pose.position.z;
-    t_base_world(3) = 1;
-    ROS_INFO("[sameer][base-world transform] Quaternion is %f , %f, %f, %f", guesspose.pose.pose.orientation.w, guesspose.pose.pose.orientation.x, guesspose.pose.pose.orientation.y, guesspose.pose.pose.orientation.z);
-    Eigen::Matrix4f trafo_base_world;
-    trafo_base_world.setIdentity();
-    trafo_base_world.block<3, 3>(0, 0) = rot_base_world;
-    trafo_base_world.rightCols<1>() = t_base_world;
-
-    //Make the transformation matrix from laser frame to the base frame of the robot
-    ros::Duration dur(0.5);
-    tf::StampedTransform laserTransform;
-    if (tf_.waitForTransform(p_base_frame_, scan.header.frame_id, ros::Time(0), dur))
-    {
-        tf_.lookupTransform(p_base_frame_, scan.header.frame_id, ros::Time(0), laserTransform);
-    }
-    else
-    {
-        ROS_INFO("[pose correction][sameer]Could not get transform from base frame to laser frame, something is wrong.");
-    }
-    Eigen::Vector4f laserpoint;
-    tf::Vector3 laser_in;
-    initialscanguess_ = Eigen::MatrixXd::Zero(int(size_estimate), 2);
-    int count = 0;
-    for (int i = 0; i < int(size_estimate); i++)
-    {
-        lrange = scan.ranges[i];
-        if (lrange >= minrange && lrange <= maxrange)
-        {
-            current_angle = minangle + i * angleinc;
-            laserx = lrange * cos(current_angle);
-            lasery = lrange * sin(current_angle);
-            laser_in.setX(laserx);
-            laser_in.setY(lasery);
-            laser_in.setZ(0);
-            laser_in = laserTransform(laser_in);
-            laserpoint(0) = laser_in.x();
-            laserpoint(1) = laser_in.y();
-            laserpoint(2) = 0;
-            laserpoint(3) = 1;
-            laserpoint = trafo_base_world * laserpoint;
-            initialscanguess_(count, 0) = laserpoint(0) / laserpoint(3);
-            initialscanguess_(count, 1) = laserpoint(1) / laserpoint(3);
-            count++;
-        }
-    }
-    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_in(new pcl::PointCloud<pcl::PointXYZ>);
-    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_out(new pcl::PointCloud<pcl::PointXYZ>);
-    cloud_in->width = map_points_.rows();
-    cloud_in->height = 1;
-    cloud_in->is_dense = true;
-    cloud_in->points.resize(cloud_in->width * cloud_in->height);
-    count = 0;
-    for (size_t i = 0; i< cloud_in->points.size(); ++i)
-    {
-        cloud_in->points[i].x = map_points_(count, 0);
-        cloud_in->points[i].y = map_points_(count, 1);
-        cloud_in->points[i].z = 0;
-        count++;
-    }
+	initial_pose_ = guessPose;
 
-    cloud_out->width = initialscanguess_.rows();
-    cloud_out->height = 1;
-    cloud_out->is_dense = true;
-    cloud_out->points.resize(cloud_out->width * cloud_out->height);
-    count = 0;
-    for (size_t i = 0; i< cloud_out->points.size(); ++i)
-    {
-        cloud_out->points[i].x = initialscanguess_(count, 0);
-        cloud_out->points[i].y = initialscanguess_(count, 1);
-        cloud_out->points[i].z = 0;
-        count++;
-    }
-    double seed_dist = 400;
-    pcl::IterativeClosestPoint<pcl::PointXYZ, pcl::PointXYZ> icp;
-    icp.setInputSource(cloud_out);
-    icp.setInputTarget(cloud_in);
-    icp.setMaximumIterations(100);
-		icp.setRANSACOutlierRejectionThreshold(0.01);
-    icp.setTransformationEpsilon(1e-8);
-    icp.setEuclideanFitnessEpsilon(0.005);
-    Eigen::Matrix4f correction;
-    pcl::PointCloud<pcl::PointXYZ> temp;
-    pcl::PointCloud<pcl::PointXYZ>::Ptr Final(new pcl::PointCloud<pcl::PointXYZ>);
-    correction.setIdentity();
-    for (int i = 0; i < 200; i++)
-    {
-        icp.setMaxCorrespondenceDistance(seed_dist / (pow(2, i)));
-        //icp.setRANSACOutlierRejectionThreshold(0.01);
-        icp.align(temp);
-        *Final = temp;
-        temp.clear();
-        icp.setInputSource(Final);
-        cout << "ICP result:" << icp.hasConverged() << " with quality:" << icp.getFitnessScore() << endl;
-        cout << "Correspondence distance is:" << icp.getMaxCorrespondenceDistance() << endl;
-        cout << icp.getFinalTransformation() << endl;
-        correction = (icp.getFinalTransformation()) * correction;
-    }
-    trafo_base_world = correction * trafo_base_world;
-    rot_base_world = trafo_base_world.block<3, 3>(0, 0);
-    t_base_world = trafo_base_world.rightCols<1>();
-    guesspose.pose.pose.position.x = t_base_world(0);
-    guesspose.pose.pose.position.y = t_base_world(1);
-    guesspose.pose.pose.position.z = t_base_world(2);
-    quat_base_world = rot_base_world;
-    guesspose.pose.pose.orientation.w = quat_base_world.w();
-    guesspose.pose.pose.orientation.x = quat_base_world.x();
-    guesspose.pose.pose.orientation.y = quat_base_world.y();
-    guesspose.pose.pose.orientation.z = quat_base_world.z();
-		sensor_msgs::PointCloud check_cloud; //Scan to be published to check if everything is okay.
-		check_cloud.header.frame_id = p_map_frame_;
-		check_cloud.header.stamp = ros::Time::now();
-		check_cloud.points.resize(initialscanguess_.rows());
-
-		//check_cloud.channels.intensities.values.resize(initialscanguess_.rows());
-		for (int i = 0; i < initialscanguess_.rows(); i++)
-    {
-        laserpoint(0) = initialscanguess_(i, 0);
-        laserpoint(1) = initialscanguess_(i, 1);
-        laserpoint(2) = 0;
-        laserpoint(3) = 1;
-        laserpoint = correction*laserpoint;
-
-				check_cloud.points[i].x = laserpoint(0);
-				check_cloud.points[i].y = laserpoint(1);
-				check_cloud.points[i].z = 0.0;
-
-				//check_cloud.channels.intensity.values[i] = 0;
-  	}
-		geometry_msgs::PoseStamped check_pose;
-		check_pose.header = guesspose.header;
-		check_pose.pose = guesspose.pose.pose;
-		corrected_points_publisher_.publish(check_cloud);
-		guess_pose_publisher_.publish(check_pose);
-    tf::Pose correctpose;
-    tf::poseMsgToTF(guesspose.pose.pose, correctpose);
-
-
-    initial_pose_(0) = guesspose.pose.pose.position.x;
-    initial_pose_(1) = guesspose.pose.pose.position.y;
-    initial_pose_(2) = tf::getYaw(correctpose.getRotation());
+	if (!p_use_tf_scan_transformation_)
+	{
+		rosLaserScanToDataContainer(scan, relocScanContainer_, slamProcessor->getScaleToMap());
+	}
+	else
+	{
+		tf::StampedTransform laserTransform;
+		if (!getLaserTransform(scan.header.frame_id, laserTransform))
+		{
+			ROS_WARN("lookupTransform %s to %s failed, using the initial pose without relocalization.", p_base_frame_.c_str(), scan.header.frame_id.c_str());
+			return;
+		}
+
+		rosLaserScanToDataContainer(scan, laserTransform, relocScanContainer_, slamProcessor->getScaleToMap());
+	}
+
+	relocStartTime_ = ros::WallTime::now();
+
+	relocalizer_.setWorkerPool(slamProcessor->getWorkerPool());
+	relocalizer_.setSearchWindow(static_cast<float>(p_reloc_linear_window_), static_cast<float>(p_reloc_angular_window_));
+	relocalizer_.setMinScore(static_cast<float>(p_reloc_min_score_));
+
+	MapLockerInterface* mapMutex = slamProcessor->getMapMutex(0);
+
+	//the map is only locked while the relocalizer copies the part it searches, the search runs on that copy
+	if (mapMutex)
+	{
+		mapMutex->lockMap();
+	}
+
+	relocalizer_.copyMap(slamProcessor->getGridMap(0), relocScanContainer_, guessPose);
+
+	if (mapMutex)
+	{
+		mapMutex->unlockMap();
+	}
+
+	//the search takes up to a few hundred ms for large windows, scans are dropped instead of blocking the callback meanwhile
+	relocThread_ = new boost::thread(boost::bind(&HectorMappingRos::searchPoseCorrection, this));
+}
+
+void HectorMappingRos::searchPoseCorrection()
+{
+	relocFound_ = relocalizer_.search(relocPose_, relocScore_);
+}
+
+bool HectorMappingRos::poseCorrectionPending()
+{
+	if (!relocThread_)
+	{
+		return false;
+	}
+
+	if (!relocThread_->timed_join(boost::posix_time::seconds(0)))
+	{
+		return true;
+	}
+
+	delete relocThread_;
+	relocThread_ = 0;
+
+	applyPoseCorrection();
+	return false;
+}
+
+void HectorMappingRos::finishPoseCorrection()
+{
+	if (relocThread_)
+	{
+		relocThread_->join();
+		delete relocThread_;
+		relocThread_ = 0;
+	}
+}
+
+void HectorMappingRos::applyPoseCorrection()
+{
+	if (!relocFound_)
+	{
+		ROS_WARN("Relocalization found no pose with score >= %f around the initial pose, using it unchanged.", p_reloc_min_score_);
+		return;
+	}
+
+	//the search is limited to cell and yaw step resolution, the regular matcher refines that
+	Eigen::Matrix3f cov;
+	initial_pose_ = slamProcessor->mapRep->matchData(relocPose_, relocScanContainer_, cov);
+
+	ROS_INFO("Relocalized x: %f y: %f yaw: %f with score %f in %f milliseconds", initial_pose_[0], initial_pose_[1], initial_pose_[2], relocScore_, (ros::WallTime::now() - relocStartTime_).toSec()*1000.0);
+
+	//scan at the corrected pose and the pose itself, to check the result
+	sensor_msgs::PointCloud check_cloud;
+	check_cloud.header.frame_id = p_map_frame_;
+	check_cloud.header.stamp = ros::Time::now();
+
+	float cellLength = slamProcessor->getGridMap(0).getCellLength();
+	Eigen::Rotation2Df rotation(initial_pose_[2]);
+	int numPoints = relocScanContainer_.getSize();
+
+	check_cloud.points.resize(numPoints);
+
+	for (int i = 0; i < numPoints; ++i)
+	{
+		Eigen::Vector2f point (initial_pose_.head<2>() + rotation * (relocScanContainer_.getVecEntry(i) * cellLength));
+		check_cloud.points[i].x = point.x();
+		check_cloud.points[i].y = point.y();
+		check_cloud.points[i].z = 0.0;
+	}
+
+	geometry_msgs::PoseStamped check_pose;
+	check_pose.header = initial_pose_slam_->header;
+	check_pose.pose.position.x = initial_pose_[0];
+	check_pose.pose.position.y = initial_pose_[1];
+	check_pose.pose.orientation = tf::createQuaternionMsgFromYaw(initial_pose_[2]);
+
+	corrected_points_publisher_.publish(check_cloud);
+	guess_pose_publisher_.publish(check_pose);
 }
 void HectorMappingRos::scanCallback(sensor_msgs::LaserScan scan)
 {
@@ -453,6 +483,12 @@ void HectorMappingRos::scanCallback(sensor_msgs::LaserScan scan)
 		poseCorrection(scan);
 	}
 
+	//the pose is unknown until the relocalization finishes, mapping at the guess would corrupt the loaded map
+	if (poseCorrectionPending())
+	{
+		return;
+	}
+
 	scan.header.stamp = ros::Time::now();
 	if (hectorDrawings)
 	{
@@ -479,22 +515,19 @@ void HectorMappingRos::scanCallback(sensor_msgs::LaserScan scan)
 	}
 	else
 	{
-		ros::Duration dur (0.5);
-		if (tf_.waitForTransform(p_base_frame_,scan.header.frame_id, ros::Time(0),dur))
-		{ //ROS_INFO("yoooo");
 		tf::StampedTransform laserTransform;
-		tf_.lookupTransform(p_base_frame_,scan.header.frame_id, ros::Time(0), laserTransform);
-
-		//projector_.transformLaserScanToPointCloud(p_base_frame_ ,scan, pointCloud,tf_);
-		projector_.projectLaser(scan, laser_point_cloud_,30.0);
+		if (getLaserTransform(scan.header.frame_id, laserTransform))
+		{
 
+		//the cloud is only a debug output, matching uses the scan directly
 		if (scan_point_cloud_publisher_.getNumSubscribers() > 0){
+			projector_.projectLaser(scan, laser_point_cloud_,30.0);
 			scan_point_cloud_publisher_.publish(laser_point_cloud_);
 		}
 
 		Eigen::Vector3f startEstimate(Eigen::Vector3f::Zero());
 
-		if(rosPointCloudToDataContainer(laser_point_cloud_, laserTransform, laserScanContainer, slamProcessor->getScaleToMap()))
+		if(rosLaserScanToDataContainer(scan, laserTransform, laserScanContainer, slamProcessor->getScaleToMap()))
 		{
 			//	ROS_INFO("%s",load_status_ ? "true":"false");
 			if (initial_pose_set_ && load_status_)
@@ -504,18 +537,16 @@ void HectorMappingRos::scanCallback(sensor_msgs::LaserScan scan)
 			}
 			else if (p_use_tf_pose_start_estimate_)
 			{
-				try
-				{
-					tf::StampedTransform stamped_pose;
-					tf_.waitForTransform(p_map_frame_,p_base_frame_, ros::Time(0), ros::Duration(0.5));
-					tf_.lookupTransform(p_map_frame_, p_base_frame_,  ros::Time(0), stamped_pose);
+				tf::StampedTransform stamped_pose;
 
+				if (tfCache_.lookupLatest(p_map_frame_, p_base_frame_, stamped_pose))
+				{
 					tfScalar yaw, pitch, roll;
 					stamped_pose.getBasis().getEulerYPR(yaw, pitch, roll);
 
 					startEstimate = Eigen::Vector3f(stamped_pose.getOrigin().getX(),stamped_pose.getOrigin().getY(), yaw);
 				}
-				catch(tf::TransformException e)
+				else
 				{
 					ROS_ERROR("Transform from %s to %s failed\n", p_map_frame_.c_str(), p_base_frame_.c_str());
 					startEstimate = slamProcessor->getLastScanMatchPose();
@@ -541,7 +572,7 @@ void HectorMappingRos::scanCallback(sensor_msgs::LaserScan scan)
 		}
 
 	}else{
-		ROS_INFO("lookupTransform %s to %s timed out. Could not transform laser scan into base_frame.", p_base_frame_.c_str(), scan.header.frame_id.c_str());
+		ROS_INFO("lookupTransform %s to %s failed. Could not transform laser scan into base_frame.", p_base_frame_.c_str(), scan.header.frame_id.c_str());
 		return;
 	}
 }
@@ -550,6 +581,14 @@ if (p_timing_output_)
 {
 	ros::WallDuration duration = ros::WallTime::now() - startTime;
 	ROS_INFO("HectorSLAM Iter took: %f milliseconds", duration.toSec()*1000.0f );
+
+	for (int i = slamProcessor->getMapLevels() - 1; i >= 0; --i)
+	{
+		const hectorslam::ScanMatchStatistics& stats (slamProcessor->getMatchStatistics(i));
+		ROS_INFO("HectorSLAM level %d: %d iterations, converged: %d, time budget exceeded: %d, residual: %f", i, stats.numIterations, stats.converged, stats.timeBudgetExceeded, stats.residual);
+	}
+
+	tfCache_.logStatistics();
 }
 
 //If we're just building a map with known poses, we're finished now. Code below this point publishes the localization results.
@@ -576,18 +615,15 @@ if (p_pub_map_odom_transform_)
 {
 	tf::StampedTransform odom_to_base;
 
-	try
+	//without a current odometry transform, the last map_odom transform is published again
+	if (tfCache_.lookupLatest(p_odom_frame_, p_base_frame_, odom_to_base))
 	{
-		tf_.waitForTransform(p_odom_frame_, p_base_frame_, ros::Time(0), ros::Duration(0.5));
-
-		tf_.lookupTransform(p_odom_frame_, p_base_frame_, ros::Time(0), odom_to_base);
+		map_to_odom_ = tf::Transform(poseInfoContainer_.getTfTransform() * odom_to_base.inverse());
 	}
-	catch(tf::TransformException e)
+	else
 	{
-		ROS_ERROR("Transform failed during publishing of map_odom transform: %s",e.what());
-		odom_to_base.setIdentity();
+		ROS_ERROR("Transform failed during publishing of map_odom transform");
 	}
-	map_to_odom_ = tf::Transform(poseInfoContainer_.getTfTransform() * odom_to_base.inverse());
 	tfB_->sendTransform( tf::StampedTransform (map_to_odom_, scan.header.stamp, p_map_frame_, p_odom_frame_));
 }
 
@@ -596,6 +632,16 @@ if (p_pub_map_scanmatch_transform_){
 }
 }
 
+bool HectorMappingRos::getLaserTransform(const std::string& laserFrame, tf::StampedTransform& laserTransform)
+{
+	if (p_laser_transform_static_)
+	{
+		return tfCache_.lookupStatic(p_base_frame_, laserFrame, laserTransform);
+	}
+
+	return tfCache_.lookupLatest(p_base_frame_, laserFrame, laserTransform);
+}
+
 void HectorMappingRos::sysMsgCallback(const std_msgs::String& string)
 {
 	ROS_INFO("HectorSM sysMsgCallback, msg contents: %s", string.data.c_str());
@@ -605,12 +651,35 @@ void HectorMappingRos::sysMsgCallback(const std_msgs::String& string)
 		ROS_INFO("HectorSM reset");
 		slamProcessor->reset();
 	}
+	else if (string.data == "savemap")
+	{
+		if (p_map_file_.empty())
+		{
+			ROS_WARN("HectorSM savemap requested, but no map_file is set");
+			return;
+		}
+
+		if (mapFileThread_)
+		{
+			if (!mapFileThread_->timed_join(boost::posix_time::seconds(0)))
+			{
+				ROS_WARN("HectorSM map is already being saved");
+				return;
+			}
+
+			delete mapFileThread_;
+		}
+
+		//the snapshots are taken and written in the background, mapping goes on meanwhile
+		mapFileThread_ = new boost::thread(boost::bind(&HectorMappingRos::saveMapFile, this));
+	}
 }
 
 bool HectorMappingRos::mapCallback(nav_msgs::GetMap::Request  &req,
 	nav_msgs::GetMap::Response &res)
 	{
 		ROS_INFO("HectorSM Map service called");
+		boost::mutex::scoped_lock messageLock(*mapPubContainer[0].mapMessageMutex_);
 		res = mapPubContainer[0].map_;
 		return true;
 	}
@@ -619,48 +688,140 @@ bool HectorMappingRos::mapCallback(nav_msgs::GetMap::Request  &req,
 	{
 		nav_msgs::GetMap::Response& map_ (mapPublisher.map_);
 
-		//only update map if it changed
-		if (lastGetMapUpdateIndex != gridMap.getUpdateIndex() || !load_status_)
+		//the map mutex is only held for bringing the snapshot up to date, scan integration can go on while converting it
+		if (mapMutex)
 		{
-			//ROS_INFO("heyhey");
-			int sizeX = gridMap.getSizeX();
-			int sizeY = gridMap.getSizeY();
+			mapMutex->lockMap();
+		}
+
+		bool mapChanged = mapPublisher.mapSnapshot_->update(gridMap);
+
+		if (mapMutex)
+		{
+			mapMutex->unlockMap();
+		}
 
-			int size = sizeX * sizeY;
+		const hectorslam::GridMap& snapshotMap (mapPublisher.mapSnapshot_->getGridMap());
 
-			std::vector<int8_t>& data = map_.map.data;
+		boost::mutex::scoped_lock messageLock(*mapPublisher.mapMessageMutex_);
 
-			//std::vector contents are guaranteed to be contiguous, use memset to set all to unknown to save time in loop
-			memset(&data[0], -1, sizeof(int8_t) * size);
+		//with map updates, subscribers follow the updates and only get the full map when its geometry changes or a new
+		//subscriber connects (the latched message may be outdated by then)
+		bool publishFullMap = !p_pub_map_updates_ || mapPublisher.fullMapRequested_;
+		mapPublisher.fullMapRequested_ = false;
 
-			if (mapMutex)
+		//only update map if it changed
+		if (!mapChanged && load_status_)
+		{
+			if (publishFullMap)
 			{
-				mapMutex->lockMap();
+				map_.map.header.stamp = timestamp;
+				mapPublisher.mapPublisher_.publish(map_.map);
 			}
+			return;
+		}
 
-			for(int i=0; i < size; ++i)
+		//sparse maps and the explored area grow, so the exported area is updated every time
+		Eigen::Vector2i areaMin, areaMax;
+		getMapExportArea(snapshotMap, areaMin, areaMax);
+
+		Eigen::Vector2i changedMin, changedMax;
+
+		//only the cells changed since the last conversion are converted, unless the message geometry changes
+		bool incremental = mapChanged && mapPublisher.mapSnapshot_->getLastChangedArea(changedMin, changedMax) &&
+		                   (areaMin == mapPublisher.mapAreaMin_) && (areaMax == mapPublisher.mapAreaMax_);
+
+		if (incremental)
+		{
+			changedMin = changedMin.cwiseMax(areaMin);
+			changedMax = changedMax.cwiseMin(areaMax);
+		}
+		else
+		{
+			nav_msgs::MapMetaData previousInfo (map_.map.info);
+
+			setServiceGetMapData(map_, snapshotMap, areaMin, areaMax);
+			mapPublisher.mapAreaMin_ = areaMin;
+			mapPublisher.mapAreaMax_ = areaMax;
+
+			changedMin = areaMin;
+			changedMax = areaMax;
+
+			//the latched metadata has to follow the grid when it grows or moves
+			if (mapInfoChanged(previousInfo, map_.map.info))
 			{
-				if(gridMap.isFree(i))
-				{
-					data[i] = 0;
-				}
-				else if (gridMap.isOccupied(i))
-				{
-					data[i] = 100;
-				}
+				mapPublisher.mapMetadataPublisher_.publish(map_.map.info);
 			}
+		}
+
+		convertMapArea(map_, snapshotMap, areaMin, changedMin, changedMax);
 
-			lastGetMapUpdateIndex = gridMap.getUpdateIndex();
+		map_.map.header.stamp = timestamp;
 
-			if (mapMutex)
+		if (incremental && p_pub_map_updates_)
+		{
+			if ((changedMin.x() <= changedMax.x()) && (changedMin.y() <= changedMax.y()))
 			{
-				mapMutex->unlockMap();
+				publishMapUpdate(mapPublisher, areaMin, changedMin, changedMax);
 			}
 		}
+		else
+		{
+			publishFullMap = true;
+		}
 
-		map_.map.header.stamp = timestamp;
+		if (publishFullMap)
+		{
+			mapPublisher.mapPublisher_.publish(map_.map);
+		}
+	}
+
+	bool HectorMappingRos::mapInfoChanged(const nav_msgs::MapMetaData& previousInfo, const nav_msgs::MapMetaData& info)
+	{
+		return (previousInfo.width != info.width) || (previousInfo.height != info.height) ||
+		       (previousInfo.resolution != info.resolution) ||
+		       (previousInfo.origin.position.x != info.origin.position.x) ||
+		       (previousInfo.origin.position.y != info.origin.position.y) ||
+		       (previousInfo.origin.orientation.w != info.origin.orientation.w);
+	}
+
+	void HectorMappingRos::mapSubscriberConnected(const ros::SingleSubscriberPublisher&, int mapLevel)
+	{
+		MapPublisherContainer& mapPublisher (mapPubContainer[mapLevel]);
+
+		boost::mutex::scoped_lock messageLock(*mapPublisher.mapMessageMutex_);
+		mapPublisher.fullMapRequested_ = true;
+	}
+
+	void HectorMappingRos::convertMapArea(nav_msgs::GetMap::Response& map_, const hectorslam::GridMap& gridMap, const Eigen::Vector2i& messageAreaMin, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+	{
+		if ((areaMin.x() > areaMax.x()) || (areaMin.y() > areaMax.y()))
+		{
+			return;
+		}
 
-		mapPublisher.mapPublisher_.publish(map_.map);
+		hectorslam::GridMapOccupancyConversion<hectorslam::GridMap>::convertArea(gridMap, &map_.map.data[0], map_.map.info.width, messageAreaMin, areaMin, areaMax);
+	}
+
+	void HectorMappingRos::publishMapUpdate(MapPublisherContainer& mapPublisher, const Eigen::Vector2i& messageAreaMin, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+	{
+		const nav_msgs::OccupancyGrid& map (mapPublisher.map_.map);
+
+		map_msgs::OccupancyGridUpdate update;
+		update.header = map.header;
+		update.x = areaMin.x() - messageAreaMin.x();
+		update.y = areaMin.y() - messageAreaMin.y();
+		update.width = areaMax.x() - areaMin.x() + 1;
+		update.height = areaMax.y() - areaMin.y() + 1;
+		update.data.resize(update.width * update.height);
+
+		for (unsigned int y = 0; y < update.height; ++y)
+		{
+			const int8_t* row = &map.data[(update.y + y) * map.info.width + update.x];
+			std::copy(row, row + update.width, &update.data[y * update.width]);
+		}
+
+		mapPublisher.mapUpdatePublisher_.publish(update);
 	}
 
 	bool HectorMappingRos::rosLaserScanToDataContainer(const sensor_msgs::LaserScan& scan, hectorslam::DataContainer& dataContainer, float scaleToMap)
@@ -688,49 +849,67 @@ bool HectorMappingRos::mapCallback(nav_msgs::GetMap::Request  &req,
 			angle += scan.angle_increment;
 		}
 
+		reduceScan(dataContainer);
+
 		return true;
 	}
 
-	bool HectorMappingRos::rosPointCloudToDataContainer(const sensor_msgs::PointCloud& pointCloud, const tf::StampedTransform& laserTransform, hectorslam::DataContainer& dataContainer, float scaleToMap)
+	bool HectorMappingRos::rosLaserScanToDataContainer(const sensor_msgs::LaserScan& scan, const tf::StampedTransform& laserTransform, hectorslam::DataContainer& dataContainer, float scaleToMap)
 	{
-		size_t size = pointCloud.points.size();
-		//ROS_INFO("size: %d", size);
+		laserScanConverter_.convert(scan, laserTransform, dataContainer, scaleToMap, 30.0f);
 
-		dataContainer.clear();
+		reduceScan(dataContainer);
 
-		tf::Vector3 laserPos (laserTransform.getOrigin());
-		dataContainer.setOrigo(Eigen::Vector2f(laserPos.x(), laserPos.y())*scaleToMap);
+		return true;
+	}
 
-		for (size_t i = 0; i < size; ++i)
+	void HectorMappingRos::reduceScan(hectorslam::DataContainer& dataContainer)
+	{
+		if (!scanReducer_.isEnabled())
 		{
+			return;
+		}
 
-			const geometry_msgs::Point32& currPoint(pointCloud.points[i]);
-
-			float dist_sqr = currPoint.x*currPoint.x + currPoint.y* currPoint.y;
-
-			if ( (dist_sqr > p_sqr_laser_min_dist_) && (dist_sqr < p_sqr_laser_max_dist_) ){
-
-				if ( (currPoint.x < 0.0f) && (dist_sqr < 0.50f)){
-					continue;
-				}
+		scanReducer_.reduce(dataContainer, reducedScanContainer_);
+		dataContainer = reducedScanContainer_;
+	}
 
-				tf::Vector3 pointPosBaseFrame(laserTransform * tf::Vector3(currPoint.x, currPoint.y, currPoint.z));
+	void HectorMappingRos::getMapExportArea(const hectorslam::GridMap& gridMap, Eigen::Vector2i& areaMin, Eigen::Vector2i& areaMax)
+	{
+		//the whole map for dense layouts, the allocated tiles for sparse ones
+		if (!gridMap.getAllocatedArea(areaMin, areaMax))
+		{
+			areaMin = Eigen::Vector2i::Zero();
+			areaMax = Eigen::Vector2i::Zero();
+			return;
+		}
 
-				float pointPosLaserFrameZ = pointPosBaseFrame.z() - laserPos.z();
+		Eigen::Vector2i exploredMin, exploredMax;
 
-				if (pointPosLaserFrameZ > p_laser_z_min_value_ && pointPosLaserFrameZ < p_laser_z_max_value_)
-				{
-					dataContainer.add(Eigen::Vector2f(pointPosBaseFrame.x(),pointPosBaseFrame.y())*scaleToMap);
-				}
-			}
+		if (!p_map_crop_to_explored_ || !gridMap.getExploredArea(exploredMin, exploredMax))
+		{
+			return;
 		}
 
-		return true;
+		//the explored area is rounded out to blocks, so the message geometry changes rarely while exploring
+		int blockMask = exploredAreaBlockSize - 1;
+		exploredMin = Eigen::Vector2i(exploredMin.x() & ~blockMask, exploredMin.y() & ~blockMask);
+		exploredMax = Eigen::Vector2i(exploredMax.x() | blockMask, exploredMax.y() | blockMask);
+
+		areaMin = areaMin.cwiseMax(exploredMin);
+		areaMax = areaMax.cwiseMin(exploredMax);
 	}
 
 	void HectorMappingRos::setServiceGetMapData(nav_msgs::GetMap::Response& map_, const hectorslam::GridMap& gridMap)
 	{
-		Eigen::Vector2f mapOrigin (gridMap.getWorldCoords(Eigen::Vector2f::Zero()));
+		Eigen::Vector2i areaMin, areaMax;
+		getMapExportArea(gridMap, areaMin, areaMax);
+		setServiceGetMapData(map_, gridMap, areaMin, areaMax);
+	}
+
+	void HectorMappingRos::setServiceGetMapData(nav_msgs::GetMap::Response& map_, const hectorslam::GridMap& gridMap, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax)
+	{
+		Eigen::Vector2f mapOrigin (gridMap.getWorldCoords(areaMin.cast<float>()));
 		mapOrigin.array() -= gridMap.getCellLength()*0.5f;
 
 		map_.map.info.origin.position.x = mapOrigin.x();
@@ -739,8 +918,8 @@ bool HectorMappingRos::mapCallback(nav_msgs::GetMap::Request  &req,
 
 		map_.map.info.resolution = gridMap.getCellLength();
 
-		map_.map.info.width = gridMap.getSizeX();
-		map_.map.info.height = gridMap.getSizeY();
+		map_.map.info.width = areaMax.x() - areaMin.x() + 1;
+		map_.map.info.height = areaMax.y() - areaMin.y() + 1;
 
 		map_.map.header.frame_id = p_map_frame_;
 		map_.map.data.resize(map_.map.info.width * map_.map.info.height);
@@ -798,71 +977,192 @@ void HectorMappingRos::initialPoseCallback(const geometry_msgs::PoseWithCovarian
 
 void HectorMappingRos::loadMap()
 {
+    //scans queued for the map update thread would be integrated into the loaded map otherwise
+    slamProcessor->waitForMapUpdates();
 
-    mapr_ = ros::topic::waitForMessage<nav_msgs::OccupancyGrid>("staticmap");
-    hectorslam::MapRepMultiMap* maprep_multimap = dynamic_cast<hectorslam::MapRepMultiMap*>(slamProcessor->mapRep);
-    hectorslam::GridMap& mod_map = maprep_multimap->mapContainer[0].getGridMap();
-    int sizeofmapX = mod_map.getSizeX();
-    int sizeofmapY = mod_map.getSizeY();
-    int sizeofmap = sizeofmapX * sizeofmapY;
-    int map_points_count = 0;
-    for (int i = 0; i < sizeofmap; ++i)
+    if (!p_map_file_.empty())
     {
-        if (mapr_->data[i] == 0)
-        {
-
-            mod_map.updateSetFree(i);
-        }
-        else if (mapr_->data[i] == 100)
+        //all levels are restored with their raw cells, no static map is needed
+        if (!loadMapFile())
         {
-
-            mod_map.updateSetOccupied(i);
-            map_points_count++;
+            return;
         }
     }
-    ROS_INFO("Origin of the map is at x:%f, y:%f, z:%f, posex:%f, posey:%f, posez:%f, posew:%f",
-            mapr_->info.origin.position.x, mapr_->info.origin.position.y,
-            mapr_->info.origin.position.z, mapr_->info.origin.orientation.x,
-            mapr_->info.origin.orientation.y, mapr_->info.origin.orientation.z,
-            mapr_->info.origin.orientation.w);
-    ofstream mapwriter;
-    mapwriter.open("map_points_.csv");
-    double xoffset, yoffset, xcoord, ycoord, zcoord, mapwidth, mapheight, mapres;
-    zcoord = 0;
-    xoffset = 0;
-    yoffset = 0;
-    xoffset = mapr_->info.origin.position.x;
-    yoffset = mapr_->info.origin.position.y;
-    mapwidth = mapr_->info.width;
-    mapheight = mapr_->info.height;
-    mapres = mapr_->info.resolution;
-    ROS_INFO("Saving map into csv, hold on.. ");
-    int count = 0;
-    int occ_count = 0;
-    map_points_ = Eigen::MatrixXd::Zero(map_points_count, 2);
-    for (int i = 0; i < mapheight; i++)
+    else
     {
-        for (int j = 0; j < mapwidth; j++)
+        mapr_ = ros::topic::waitForMessage<nav_msgs::OccupancyGrid>("staticmap");
+        hectorslam::GridMap& mod_map = slamProcessor->mapRep->getGridMap(0);
+
+        //the static map may cover only part of the map (e.g. saved from a cropped map topic), its cells are placed by
+        //their world coordinates and cells outside of the map are dropped
+        int staticSizeX = mapr_->info.width;
+        int staticSizeY = mapr_->info.height;
+        float staticCellLength = mapr_->info.resolution;
+        Eigen::Vector2f staticOrigin (mapr_->info.origin.position.x, mapr_->info.origin.position.y);
+
+        if (mapr_->data.size() < static_cast<size_t>(staticSizeX) * staticSizeY)
         {
-            if (mapr_->data[count] == 100)
+            ROS_ERROR("HectorSM static map has %u cells, %d x %d expected", static_cast<unsigned int>(mapr_->data.size()), staticSizeX, staticSizeY);
+            return;
+        }
+
+        int numDropped = 0;
+
+        //the map publishing and saving threads read the levels meanwhile
+        lockMapLevels();
+
+        for (int y = 0; y < staticSizeY; ++y)
+        {
+            for (int x = 0; x < staticSizeX; ++x)
             {
-                xcoord = j * mapres + xoffset;
-                ycoord = i * mapres + yoffset;
-                map_points_(occ_count, 0) = xcoord;
-                map_points_(occ_count, 1) = ycoord;
-                mapwriter << map_points_(occ_count, 0) << "," << map_points_(occ_count, 1) << "," << 0 << endl;
-                occ_count++;
+                int8_t value = mapr_->data[y * staticSizeX + x];
+
+                if ((value != 0) && (value != 100))
+                {
+                    continue;
+                }
+
+                Eigen::Vector2f mapCoords (mod_map.getMapCoords(staticOrigin + Eigen::Vector2f(x, y) * staticCellLength));
+                int mapX = static_cast<int>(floor(mapCoords.x() + 0.5f));
+                int mapY = static_cast<int>(floor(mapCoords.y() + 0.5f));
+
+                if (!mod_map.hasGridValue(mapX, mapY))
+                {
+                    ++numDropped;
+                    continue;
+                }
+
+                if (value == 0)
+                {
+                    mod_map.updateSetFree(mod_map.getCellIndexForUpdate(mapX, mapY));
+                }
+                else
+                {
+                    mod_map.updateSetOccupied(mod_map.getCellIndexForUpdate(mapX, mapY));
+                }
             }
-            count++;
         }
+
+        //cells were changed directly, this makes matchers drop cached values derived from the map
+        mod_map.recomputeExploredArea();
+        mod_map.setUpdated();
+
+        unlockMapLevels();
+
+        if (numDropped > 0)
+        {
+            ROS_WARN("HectorSM %d known cells of the static map are outside of the map", numDropped);
+        }
+
+        ROS_INFO("Origin of the map is at x:%f, y:%f, z:%f, posex:%f, posey:%f, posez:%f, posew:%f",
+                mapr_->info.origin.position.x, mapr_->info.origin.position.y,
+                mapr_->info.origin.position.z, mapr_->info.origin.orientation.x,
+                mapr_->info.origin.orientation.y, mapr_->info.origin.orientation.z,
+                mapr_->info.origin.orientation.w);
+        //the static map only fills the finest level, the coarse to fine matcher needs the others as well
+        slamProcessor->rebuildCoarseLevels();
     }
-    mapwriter.close();
-    ROS_INFO(" ..Done");
     ros::Time mapTime(ros::Time::now());
     publishMap(mapPubContainer[0], slamProcessor->getGridMap(0), mapTime, slamProcessor->getMapMutex(0));
     //mod_map.updateSetFree(0);
     tf_.clear();
 }
+
+void HectorMappingRos::lockMapLevels()
+{
+    int numLevels = slamProcessor->getMapLevels();
+
+    for (int i = 0; i < numLevels; ++i)
+    {
+        if (slamProcessor->getMapMutex(i))
+        {
+            slamProcessor->getMapMutex(i)->lockMap();
+        }
+    }
+}
+
+void HectorMappingRos::unlockMapLevels()
+{
+    int numLevels = slamProcessor->getMapLevels();
+
+    for (int i = 0; i < numLevels; ++i)
+    {
+        if (slamProcessor->getMapMutex(i))
+        {
+            slamProcessor->getMapMutex(i)->unlockMap();
+        }
+    }
+}
+
+bool HectorMappingRos::loadMapFile()
+{
+    int numLevels = slamProcessor->getMapLevels();
+
+    std::vector<hectorslam::GridMap*> levels;
+
+    for (int i = 0; i < numLevels; ++i)
+    {
+        levels.push_back(&slamProcessor->mapRep->getGridMap(i));
+    }
+
+    lockMapLevels();
+
+    ros::WallTime startTime (ros::WallTime::now());
+
+    hectorslam::GridMapFile<hectorslam::GridMap> mapFile;
+    bool loaded = mapFile.load(p_map_file_, levels);
+
+    unlockMapLevels();
+
+    if (!loaded)
+    {
+        ROS_ERROR("HectorSM cannot load map: %s", mapFile.getErrorMessage().c_str());
+        return false;
+    }
+
+    ROS_INFO("HectorSM loaded map from %s in %f ms", p_map_file_.c_str(), (ros::WallTime::now() - startTime).toSec() * 1000.0);
+    return true;
+}
+
+void HectorMappingRos::saveMapFile()
+{
+    int numLevels = slamProcessor->getMapLevels();
+
+    mapFileSnapshots_.resize(numLevels);
+
+    std::vector<const hectorslam::GridMap*> levels;
+
+    //all levels are locked together, so the saved levels belong to the same scan
+    lockMapLevels();
+
+    //the snapshots are kept between saves, so later saves only copy the cells changed since
+    for (int i = 0; i < numLevels; ++i)
+    {
+        if (!mapFileSnapshots_[i])
+        {
+            mapFileSnapshots_[i].reset(new hectorslam::GridMapSnapshot<hectorslam::GridMap>());
+        }
+
+        mapFileSnapshots_[i]->update(slamProcessor->getGridMap(i));
+
+        levels.push_back(&mapFileSnapshots_[i]->getGridMap());
+    }
+
+    unlockMapLevels();
+
+    ros::WallTime startTime (ros::WallTime::now());
+
+    hectorslam::GridMapFile<hectorslam::GridMap> mapFile;
+
+    if (!mapFile.save(p_map_file_, levels))
+    {
+        ROS_ERROR("HectorSM cannot save map: %s", mapFile.getErrorMessage().c_str());
+        return;
+    }
+
+    ROS_INFO("HectorSM saved map to %s in %f ms", p_map_file_.c_str(), (ros::WallTime::now() - startTime).toSec() * 1000.0);
+}
+
 void HectorMappingRos::initPoseCallback(const geometry_msgs::PoseWithCovarianceStamped& initialpose)
 {
 	if (!load_map_)
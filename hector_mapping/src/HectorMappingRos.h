@@ -41,15 +41,23 @@
 
 #include "laser_geometry/laser_geometry.h"
 #include "nav_msgs/GetMap.h"
+#include "map_msgs/OccupancyGridUpdate.h"
 
 #include "slam_main/HectorSlamProcessor.h"
+#include "map/GridMapSnapshot.h"
+#include "map/GridMapFile.h"
+#include "matcher/BranchAndBoundRelocalizer.h"
 
 #include "scan/DataPointContainer.h"
+#include "scan/DataPointReducer.h"
 #include "util/MapLockerInterface.h"
 
 #include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "PoseInfoContainer.h"
+#include "LaserScanConverter.h"
+#include "TransformCache.h"
 
 
 class HectorDrawings;
@@ -58,10 +66,28 @@ class HectorDebugInfoProvider;
 class MapPublisherContainer
 {
 public:
+  MapPublisherContainer()
+    : mapAreaMin_(0, 0)
+    , mapAreaMax_(-1, -1)
+    , fullMapRequested_(false)
+  {}
+
   ros::Publisher mapPublisher_;
   ros::Publisher mapMetadataPublisher_;
+  ros::Publisher mapUpdatePublisher_;
   nav_msgs::GetMap::Response map_;
   ros::ServiceServer dynamicMapServiceServer_;
+
+  //map_ is converted from the snapshot without holding the map mutex, the message mutex protects it against the map service
+  boost::shared_ptr<hectorslam::GridMapSnapshot<hectorslam::GridMap> > mapSnapshot_;
+  boost::shared_ptr<boost::mutex> mapMessageMutex_;
+
+  //map cells map_ covers, it is converted incrementally as long as they do not change
+  Eigen::Vector2i mapAreaMin_;
+  Eigen::Vector2i mapAreaMax_;
+
+  //set when a map subscriber connects, the next publishMap() call publishes the full map even with map updates enabled
+  bool fullMapRequested_;
 };
 
 class HectorMappingRos
@@ -72,7 +98,11 @@ public:
 
 
   void scanCallback(sensor_msgs::LaserScan scan);
-  void poseCorrection(sensor_msgs::LaserScan scan);
+  void poseCorrection(const sensor_msgs::LaserScan& scan);
+  void searchPoseCorrection();
+  bool poseCorrectionPending();
+  void finishPoseCorrection();
+  void applyPoseCorrection();
   void sysMsgCallback(const std_msgs::String& string);
 
   bool mapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
@@ -80,9 +110,17 @@ public:
   void publishMap(MapPublisherContainer& map_, const hectorslam::GridMap& gridMap, ros::Time timestamp, MapLockerInterface* mapMutex = 0);
 
   bool rosLaserScanToDataContainer(const sensor_msgs::LaserScan& scan, hectorslam::DataContainer& dataContainer, float scaleToMap);
-  bool rosPointCloudToDataContainer(const sensor_msgs::PointCloud& pointCloud, const tf::StampedTransform& laserTransform, hectorslam::DataContainer& dataContainer, float scaleToMap);
+  bool rosLaserScanToDataContainer(const sensor_msgs::LaserScan& scan, const tf::StampedTransform& laserTransform, hectorslam::DataContainer& dataContainer, float scaleToMap);
+  void reduceScan(hectorslam::DataContainer& dataContainer);
+  bool getLaserTransform(const std::string& laserFrame, tf::StampedTransform& laserTransform);
 
   void setServiceGetMapData(nav_msgs::GetMap::Response& map_, const hectorslam::GridMap& gridMap);
+  void setServiceGetMapData(nav_msgs::GetMap::Response& map_, const hectorslam::GridMap& gridMap, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax);
+  void getMapExportArea(const hectorslam::GridMap& gridMap, Eigen::Vector2i& areaMin, Eigen::Vector2i& areaMax);
+  void convertMapArea(nav_msgs::GetMap::Response& map_, const hectorslam::GridMap& gridMap, const Eigen::Vector2i& messageAreaMin, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax);
+  void publishMapUpdate(MapPublisherContainer& mapPublisher, const Eigen::Vector2i& messageAreaMin, const Eigen::Vector2i& areaMin, const Eigen::Vector2i& areaMax);
+  void mapSubscriberConnected(const ros::SingleSubscriberPublisher& publisher, int mapLevel);
+  bool mapInfoChanged(const nav_msgs::MapMetaData& previousInfo, const nav_msgs::MapMetaData& info);
 
   void publishTransformLoop(double p_transform_pub_period_);
   void publishMapLoop(double p_map_pub_period_);
@@ -96,10 +134,11 @@ public:
   */
 protected:
 
+  enum { exploredAreaBlockSize = 64 }; ///< Cropped maps are exported in whole blocks of this many cells (power of 2)
+
   HectorDebugInfoProvider* debugInfoProvider;
   HectorDrawings* hectorDrawings;
 
-  int lastGetMapUpdateIndex;
 
   ros::NodeHandle node_;
 
@@ -122,9 +161,11 @@ protected:
   std::vector<MapPublisherContainer> mapPubContainer;
 
   tf::TransformListener tf_;
+  TransformCache tfCache_;
   tf::TransformBroadcaster* tfB_;
 
   laser_geometry::LaserProjection projector_;
+  LaserScanConverter laserScanConverter_;
 
   tf::Transform map_to_odom_;
 
@@ -132,6 +173,8 @@ protected:
 
   hectorslam::HectorSlamProcessor* slamProcessor;
   hectorslam::DataContainer laserScanContainer;
+  hectorslam::DataContainer reducedScanContainer_;
+  hectorslam::DataPointReducer scanReducer_;
 
   PoseInfoContainer poseInfoContainer_;
 
@@ -164,26 +207,58 @@ protected:
   bool p_pub_drawings;
   bool p_pub_debug_output_;
   bool p_pub_map_odom_transform_;
+  bool p_pub_map_updates_;
+  bool p_map_crop_to_explored_;
   bool p_pub_odometry_;
   bool p_advertise_map_service_;
   int p_scan_subscriber_queue_size_;
 
   double p_update_factor_free_;
   double p_update_factor_occupied_;
+  bool p_use_probability_plane_;
   double p_map_update_distance_threshold_;
   double p_map_update_angle_threshold_;
 
+  double p_match_min_step_cells_;
+  double p_match_min_step_angle_;
+  double p_match_min_residual_change_;
+  double p_match_time_budget_ms_;
+
+  int p_match_hypotheses_;
+  double p_match_hypothesis_linear_offset_;
+  double p_match_hypothesis_angular_offset_;
+
+  int p_match_max_points_;
+  int p_match_max_points_coarse_;
+
+  double p_scan_reduction_cell_size_;
+  double p_scan_reduction_min_distance_;
+  int p_scan_reduction_max_points_;
+
+  double p_reloc_linear_window_;
+  double p_reloc_angular_window_;
+  double p_reloc_min_score_;
+
   double p_map_resolution_;
   int p_map_size_;
   double p_map_start_x_;
   double p_map_start_y_;
   int p_map_multi_res_levels_;
+  bool p_map_rolling_window_;
+  double p_map_rolling_window_recenter_distance_;
+
+  bool p_map_derive_coarse_levels_;
+  std::string p_map_pyramid_pooling_;
+  int p_worker_threads_;
 
   double p_map_pub_period_;
 
   bool p_use_tf_scan_transformation_;
   bool p_use_tf_pose_start_estimate_;
+  bool p_laser_transform_static_;
+  double p_tf_max_age_;
   bool p_map_with_known_poses_;
+  bool p_pipelined_map_update_;
   bool p_timing_output_;
 
 
@@ -193,16 +268,30 @@ protected:
   float p_laser_z_max_value_;
 
   //Mod by Sameer
-  bool load_map_;   ///< Whether to wait for an initial map before starting slam
+  bool load_map_;   ///< Whether to load an initial map (map_file, or the staticmap topic) before starting slam
   bool load_status_;
   bool first_scan_;
   geometry_msgs::PoseWithCovarianceStampedConstPtr initial_pose_slam_;
   void initPoseCallback(const geometry_msgs::PoseWithCovarianceStamped& initialpose);
   nav_msgs::OccupancyGrid::ConstPtr mapr_;
-  Eigen::MatrixXd map_points_;
-  Eigen::MatrixXd initialscanguess_;
+  std::string p_map_file_;   ///< Binary map file loaded on start if load_map is set and written on "savemap"
 
   void loadMap();
+  bool loadMapFile();
+  void lockMapLevels();
+  void unlockMapLevels();
+  void saveMapFile();
+
+  std::vector<boost::shared_ptr<hectorslam::GridMapSnapshot<hectorslam::GridMap> > > mapFileSnapshots_;
+  boost::thread* mapFileThread_;   ///< Last "savemap" thread, joined before the next save and on destruction
+
+  hectorslam::BranchAndBoundRelocalizer<hectorslam::GridMap> relocalizer_;
+  hectorslam::DataContainer relocScanContainer_;   ///< First scan after the initial pose, searched by relocThread_
+  boost::thread* relocThread_;   ///< Running relocalization search, its result is applied by the first scan after it finished
+  bool relocFound_;
+  Eigen::Vector3f relocPose_;
+  float relocScore_;
+  ros::WallTime relocStartTime_;
   //Mod by Sameer
 };
 
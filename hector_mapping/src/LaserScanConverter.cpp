@@ -0,0 +1,130 @@
+//=================================================================================================
+// Copyright (c) 2012, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#include "LaserScanConverter.h"
+
+#include <cmath>
+#include <algorithm>
+
+LaserScanConverter::LaserScanConverter()
+: tableValid_(false)
+, tableAngleMin_(0.0f)
+, tableAngleIncrement_(0.0f)
+, minDist_(0.0f)
+, maxDist_(0.0f)
+, zMin_(0.0f)
+, zMax_(0.0f)
+{
+}
+
+void LaserScanConverter::setFilter(float minDist, float maxDist, float zMin, float zMax)
+{
+  minDist_ = minDist;
+  maxDist_ = maxDist;
+  zMin_ = zMin;
+  zMax_ = zMax;
+}
+
+void LaserScanConverter::convert(const sensor_msgs::LaserScan& scan, const tf::Transform& laserTransform, hectorslam::DataContainer& dataContainer, float scaleToMap, float rangeCutoff)
+{
+  updateBeamTable(scan, laserTransform);
+
+  dataContainer.clear();
+
+  const tf::Vector3& laserPos (laserTransform.getOrigin());
+  dataContainer.setOrigo(Eigen::Vector2f(laserPos.x(), laserPos.y())*scaleToMap);
+
+  float originX = static_cast<float>(laserPos.x());
+  float originY = static_cast<float>(laserPos.y());
+
+  //range_min is inclusive and the cutoff exclusive, as for laser_geometry projections
+  float rangeMax = std::min(std::min(scan.range_max, rangeCutoff), maxDist_);
+
+  size_t size = scan.ranges.size();
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    float range = scan.ranges[i];
+
+    //also rejects NaN
+    if (!((range >= scan.range_min) && (range > minDist_) && (range < rangeMax)))
+    {
+      continue;
+    }
+
+    //ignore returns close behind the laser, typically from the robot itself
+    if (beamBackwards_[i] && (range * range < 0.50f))
+    {
+      continue;
+    }
+
+    float z = range * beamDirZ_[i];
+
+    if ((z > zMin_) && (z < zMax_))
+    {
+      dataContainer.add(Eigen::Vector2f(originX + range * beamDirX_[i], originY + range * beamDirY_[i])*scaleToMap);
+    }
+  }
+}
+
+void LaserScanConverter::updateBeamTable(const sensor_msgs::LaserScan& scan, const tf::Transform& laserTransform)
+{
+  size_t size = scan.ranges.size();
+
+  if (tableValid_ && (beamDirX_.size() == size) && (tableAngleMin_ == scan.angle_min) && (tableAngleIncrement_ == scan.angle_increment) &&
+      (tableBasis_ == laserTransform.getBasis()))
+  {
+    return;
+  }
+
+  beamDirX_.resize(size);
+  beamDirY_.resize(size);
+  beamDirZ_.resize(size);
+  beamBackwards_.resize(size);
+
+  const tf::Matrix3x3& basis (laserTransform.getBasis());
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    double angle = scan.angle_min + static_cast<double>(i) * scan.angle_increment;
+    double cosAngle = cos(angle);
+    double sinAngle = sin(angle);
+
+    tf::Vector3 dir (basis * tf::Vector3(cosAngle, sinAngle, 0.0));
+
+    beamDirX_[i] = static_cast<float>(dir.x());
+    beamDirY_[i] = static_cast<float>(dir.y());
+    beamDirZ_[i] = static_cast<float>(dir.z());
+    beamBackwards_[i] = cosAngle < 0.0;
+  }
+
+  tableValid_ = true;
+  tableAngleMin_ = scan.angle_min;
+  tableAngleIncrement_ = scan.angle_increment;
+  tableBasis_ = laserTransform.getBasis();
+}
@@ -0,0 +1,86 @@
+//=================================================================================================
+// Copyright (c) 2012, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#ifndef LASER_SCAN_CONVERTER_H__
+#define LASER_SCAN_CONVERTER_H__
+
+#include <vector>
+
+#include <sensor_msgs/LaserScan.h>
+#include <tf/transform_datatypes.h>
+
+#include "scan/DataPointContainer.h"
+
+/**
+ * Converts laser scans directly into DataContainers in the robot base frame. The beam directions in the base frame
+ * are kept in a table that is only rebuilt when the scan angles or the laser orientation change, so every beam costs
+ * a few multiplications and no intermediate point cloud is built.
+ * Applies the same filters as projecting the scan with laser_geometry and filtering the cloud.
+ */
+class LaserScanConverter
+{
+public:
+
+  LaserScanConverter();
+
+  /**
+   * Beams are used if their range is within (minDist, maxDist) and the end point height relative to the laser (in
+   * the base frame) is within (zMin, zMax).
+   */
+  void setFilter(float minDist, float maxDist, float zMin, float zMax);
+
+  /**
+   * Fills dataContainer with the end points of scan in the base frame, scaled by scaleToMap.
+   * @param laserTransform Transform from the laser frame to the base frame
+   * @param rangeCutoff Beams at or beyond this range are dropped, additionally to scan.range_max
+   */
+  void convert(const sensor_msgs::LaserScan& scan, const tf::Transform& laserTransform, hectorslam::DataContainer& dataContainer, float scaleToMap, float rangeCutoff);
+
+protected:
+
+  void updateBeamTable(const sensor_msgs::LaserScan& scan, const tf::Transform& laserTransform);
+
+  //beam directions in the base frame, by beam index
+  std::vector<float> beamDirX_;
+  std::vector<float> beamDirY_;
+  std::vector<float> beamDirZ_;
+  std::vector<char> beamBackwards_;  ///< Beam points backwards in the laser frame
+
+  //key of the table
+  bool tableValid_;
+  float tableAngleMin_;
+  float tableAngleIncrement_;
+  tf::Matrix3x3 tableBasis_;  ///< Only the rotation of the laser transform enters the table
+
+  float minDist_;
+  float maxDist_;
+  float zMin_;
+  float zMax_;
+};
+
+#endif
@@ -0,0 +1,164 @@
+//=================================================================================================
+// Copyright (c) 2012, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#include "TransformCache.h"
+
+#include <algorithm>
+
+TransformCache::TransformCache(tf::TransformListener& listener)
+: listener_(listener)
+, staticTimeout_(0.5)
+, maxAge_(0.5)
+{
+}
+
+void TransformCache::subscribeStaticChanges(ros::NodeHandle& nh)
+{
+  tfStaticSubscriber_ = nh.subscribe("/tf_static", 10, &TransformCache::tfStaticCallback, this);
+}
+
+bool TransformCache::lookupStatic(const std::string& targetFrame, const std::string& sourceFrame, tf::StampedTransform& transform)
+{
+  std::string key (getKey(targetFrame, sourceFrame));
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    std::map<std::string, tf::StampedTransform>::const_iterator it = staticTransforms_.find(key);
+
+    if ((it != staticTransforms_.end()) && (ros::WallTime::now() > staticRefreshUntil_))
+    {
+      transform = it->second;
+      return true;
+    }
+  }
+
+  std::string error;
+
+  if (!lookup(targetFrame, sourceFrame, staticTimeout_, transform, error))
+  {
+    ROS_WARN_THROTTLE(1.0, "Static transform %s not available: %s", key.c_str(), error.c_str());
+    return false;
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  staticTransforms_[key] = transform;
+  return true;
+}
+
+bool TransformCache::lookupLatest(const std::string& targetFrame, const std::string& sourceFrame, tf::StampedTransform& transform)
+{
+  std::string error;
+
+  if (!lookup(targetFrame, sourceFrame, ros::Duration(0.0), transform, error))
+  {
+    ROS_WARN_THROTTLE(1.0, "Transform %s not available: %s", getKey(targetFrame, sourceFrame).c_str(), error.c_str());
+    return false;
+  }
+
+  ros::Duration age (ros::Time::now() - transform.stamp_);
+
+  //chains of static transforms (or identical frames) have no stamp, those never get old
+  if (!transform.stamp_.isZero() && (age > maxAge_))
+  {
+    ROS_WARN_THROTTLE(1.0, "Transform %s is %f s old, the maximum age is %f s", getKey(targetFrame, sourceFrame).c_str(), age.toSec(), maxAge_.toSec());
+    return false;
+  }
+
+  return true;
+}
+
+void TransformCache::logStatistics()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  for (std::map<std::string, LookupStatistics>::const_iterator it = statistics_.begin(); it != statistics_.end(); ++it)
+  {
+    const LookupStatistics& stats (it->second);
+    double averageMs = (stats.numLookups > 0) ? (stats.totalLatency / stats.numLookups * 1000.0) : 0.0;
+
+    ROS_INFO("HectorSM tf %s: %d lookups, %d failed, avg %f ms, max %f ms", it->first.c_str(), stats.numLookups, stats.numFailures, averageMs, stats.maxLatency * 1000.0);
+  }
+}
+
+void TransformCache::tfStaticCallback(const tf2_msgs::TFMessage&)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  if (staticTransforms_.empty())
+  {
+    return;
+  }
+
+  //any cached chain may contain a changed transform
+  staticTransforms_.clear();
+  staticRefreshUntil_ = ros::WallTime::now() + ros::WallDuration(1.0);
+
+  ROS_INFO("HectorSM static transforms changed, refreshing cached transforms");
+}
+
+bool TransformCache::lookup(const std::string& targetFrame, const std::string& sourceFrame, const ros::Duration& timeout, tf::StampedTransform& transform, std::string& error)
+{
+  ros::WallTime startTime = ros::WallTime::now();
+
+  bool success = true;
+
+  try
+  {
+    if (timeout > ros::Duration(0.0))
+    {
+      listener_.waitForTransform(targetFrame, sourceFrame, ros::Time(0), timeout);
+    }
+
+    listener_.lookupTransform(targetFrame, sourceFrame, ros::Time(0), transform);
+  }
+  catch(tf::TransformException e)
+  {
+    error = e.what();
+    success = false;
+  }
+
+  addStatistics(getKey(targetFrame, sourceFrame), (ros::WallTime::now() - startTime).toSec(), success);
+
+  return success;
+}
+
+void TransformCache::addStatistics(const std::string& key, double latency, bool success)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+
+  LookupStatistics& stats (statistics_[key]);
+  ++stats.numLookups;
+  stats.totalLatency += latency;
+  stats.maxLatency = std::max(stats.maxLatency, latency);
+
+  if (!success)
+  {
+    ++stats.numFailures;
+  }
+}
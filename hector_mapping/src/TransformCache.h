@@ -0,0 +1,110 @@
+//=================================================================================================
+// Copyright (c) 2012, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+#ifndef TRANSFORM_CACHE_H__
+#define TRANSFORM_CACHE_H__
+
+#include <map>
+#include <string>
+
+#include <ros/ros.h>
+#include <tf/transform_listener.h>
+#include <tf2_msgs/TFMessage.h>
+
+#include <boost/thread/mutex.hpp>
+
+/**
+ * Wraps the transform lookups of the scan pipeline so none of them blocks for long.
+ * Static transforms (sensor extrinsics) are resolved once, waiting for them if needed, and cached until a change is
+ * published on /tf_static. Other transforms are looked up without waiting and rejected if older than a maximum age.
+ * Latency and failures are counted per frame pair.
+ */
+class TransformCache
+{
+public:
+
+  struct LookupStatistics
+  {
+    LookupStatistics() : numLookups(0), numFailures(0), totalLatency(0.0), maxLatency(0.0) {};
+
+    int numLookups;       ///< Lookups that did not hit the static cache
+    int numFailures;
+    double totalLatency;  ///< Sum of lookup wall times in s
+    double maxLatency;    ///< Longest lookup wall time in s
+  };
+
+  TransformCache(tf::TransformListener& listener);
+
+  /**
+   * Starts listening for static transform changes on /tf_static.
+   */
+  void subscribeStaticChanges(ros::NodeHandle& nh);
+
+  void setStaticTimeout(const ros::Duration& timeout) { staticTimeout_ = timeout; };
+  void setMaxAge(const ros::Duration& maxAge) { maxAge_ = maxAge; };
+
+  /**
+   * Returns the transform from sourceFrame to targetFrame, which is assumed to be static. Only the first lookup
+   * (and the first after a /tf_static change) waits for it, up to the static timeout.
+   */
+  bool lookupStatic(const std::string& targetFrame, const std::string& sourceFrame, tf::StampedTransform& transform);
+
+  /**
+   * Returns the latest available transform from sourceFrame to targetFrame without waiting.
+   * @return False if there is none or it is older than the maximum age
+   */
+  bool lookupLatest(const std::string& targetFrame, const std::string& sourceFrame, tf::StampedTransform& transform);
+
+  void logStatistics();
+
+protected:
+
+  void tfStaticCallback(const tf2_msgs::TFMessage& msg);
+
+  bool lookup(const std::string& targetFrame, const std::string& sourceFrame, const ros::Duration& timeout, tf::StampedTransform& transform, std::string& error);
+  void addStatistics(const std::string& key, double latency, bool success);
+
+  static std::string getKey(const std::string& targetFrame, const std::string& sourceFrame) { return targetFrame + " <- " + sourceFrame; };
+
+  tf::TransformListener& listener_;
+  ros::Subscriber tfStaticSubscriber_;
+
+  ros::Duration staticTimeout_;
+  ros::Duration maxAge_;
+
+  boost::mutex mutex_;
+  std::map<std::string, tf::StampedTransform> staticTransforms_;
+  std::map<std::string, LookupStatistics> statistics_;
+
+  /**
+   * The listener may not have processed a /tf_static change when we do, so the static cache is bypassed until then.
+   */
+  ros::WallTime staticRefreshUntil_;
+};
+
+#endif
@@ -0,0 +1,48 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#ifndef __test_grid_map_layouts_h_
+#define __test_grid_map_layouts_h_
+
+#include <gtest/gtest.h>
+
+#include "map/GridMap.h"
+
+/**
+ * The log odds map with every storage layout, for typed tests that have to hold for all of them.
+ */
+typedef ::testing::Types<
+  hectorslam::GridMap,
+  hectorslam::OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, hectorslam::GridMapLayoutRowMajorPow2>,
+  hectorslam::OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, hectorslam::GridMapLayoutToroidal>,
+  hectorslam::OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, hectorslam::GridMapLayoutTiled<3> >,
+  hectorslam::OccGridMapBase<LogOddsCell, GridMapLogOddsFunctions, hectorslam::GridMapLayoutSparse<4> >
+> GridMapLayoutTypes;
+
+#endif
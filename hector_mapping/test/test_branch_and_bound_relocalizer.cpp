@@ -0,0 +1,133 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#include <gtest/gtest.h>
+
+#include "map/GridMap.h"
+#include "matcher/BranchAndBoundRelocalizer.h"
+#include "util/WorkerPool.h"
+
+using namespace hectorslam;
+
+namespace {
+
+/**
+ * Endpoints of an irregular closed outline around the map center, in world coordinates.
+ */
+std::vector<Eigen::Vector2f> makeOutline()
+{
+  std::vector<Eigen::Vector2f> outline;
+  for (int i = 0; i < 720; ++i) {
+    float angle = static_cast<float>(i) * 6.2f / 720.0f;
+    float range = 40.0f + 5.0f * sin(angle * 7.0f) + 3.0f * cos(angle * 3.0f);
+    outline.push_back(Eigen::Vector2f(128.0f, 128.0f) + Eigen::Vector2f(cos(angle), sin(angle)) * range);
+  }
+  return outline;
+}
+
+/**
+ * The outline as seen from pose, no occlusion handling is needed as the outline is star shaped around the poses used.
+ */
+DataContainer makeScan(const std::vector<Eigen::Vector2f>& outline, const Eigen::Vector3f& pose)
+{
+  Eigen::Rotation2Df toScan (-pose[2]);
+
+  DataContainer scan;
+  for (size_t i = 0; i < outline.size(); ++i) {
+    scan.add(toScan * (outline[i] - pose.head<2>()));
+  }
+  return scan;
+}
+
+void buildMap(GridMap& map, const std::vector<Eigen::Vector2f>& outline)
+{
+  Eigen::Vector3f scanPose (128.0f, 128.0f, 0.0f);
+  DataContainer scan (makeScan(outline, scanPose));
+
+  for (int i = 0; i < 5; ++i) {
+    map.updateByScan(scan, scanPose);
+  }
+}
+
+}
+
+TEST(BranchAndBoundRelocalizer, RecoversOffsetPose)
+{
+  GridMap map (1.0f, Eigen::Vector2i(256, 256), Eigen::Vector2f::Zero());
+  std::vector<Eigen::Vector2f> outline (makeOutline());
+  buildMap(map, outline);
+
+  Eigen::Vector3f truePose (131.0f, 125.0f, 0.2f);
+  Eigen::Vector3f guessPose (truePose + Eigen::Vector3f(3.0f, -2.5f, -0.15f));
+  DataContainer scan (makeScan(outline, truePose));
+
+  BranchAndBoundRelocalizer<GridMap> relocalizer;
+  relocalizer.setSearchWindow(5.0f, 0.3f);
+
+  Eigen::Vector3f pose;
+  float score = 0.0f;
+  ASSERT_TRUE(relocalizer.relocalize(map, scan, guessPose, pose, score));
+
+  //exact up to the search resolution of one cell and the yaw step (about 1/range)
+  EXPECT_NEAR(truePose[0], pose[0], 1.0f);
+  EXPECT_NEAR(truePose[1], pose[1], 1.0f);
+  EXPECT_NEAR(truePose[2], pose[2], 0.03f);
+  EXPECT_GT(score, 0.55f);
+
+  //searching the yaws in parallel does not change the result
+  WorkerPool workerPool (3);
+  relocalizer.setWorkerPool(&workerPool);
+
+  Eigen::Vector3f parallelPose;
+  float parallelScore = 0.0f;
+  ASSERT_TRUE(relocalizer.relocalize(map, scan, guessPose, parallelPose, parallelScore));
+
+  EXPECT_EQ(pose, parallelPose);
+  EXPECT_EQ(score, parallelScore);
+}
+
+TEST(BranchAndBoundRelocalizer, RejectsGuessOutsideOfWindow)
+{
+  GridMap map (1.0f, Eigen::Vector2i(256, 256), Eigen::Vector2f::Zero());
+  std::vector<Eigen::Vector2f> outline (makeOutline());
+  buildMap(map, outline);
+
+  Eigen::Vector3f truePose (131.0f, 125.0f, 0.2f);
+  DataContainer scan (makeScan(outline, truePose));
+
+  BranchAndBoundRelocalizer<GridMap> relocalizer;
+  relocalizer.setSearchWindow(5.0f, 0.3f);
+
+  Eigen::Vector3f pose (-1.0f, -1.0f, -1.0f);
+  float score = -1.0f;
+  EXPECT_FALSE(relocalizer.relocalize(map, scan, truePose + Eigen::Vector3f(25.0f, 0.0f, 1.5f), pose, score));
+
+  EXPECT_EQ(Eigen::Vector3f(-1.0f, -1.0f, -1.0f), pose);
+  EXPECT_EQ(-1.0f, score);
+}
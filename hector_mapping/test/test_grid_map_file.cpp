@@ -0,0 +1,190 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "map/GridMap.h"
+#include "map/GridMapFile.h"
+
+#include "grid_map_layouts.h"
+
+using namespace hectorslam;
+
+namespace {
+
+std::string getTempFileName()
+{
+  char fileName[] = "/tmp/test_grid_map_file_XXXXXX";
+  int fd = mkstemp(fileName);
+  if (fd >= 0) {
+    close(fd);
+  }
+  return fileName;
+}
+
+/**
+ * Three levels as used by the multi resolution map, the finest one with a moved window.
+ */
+template<typename ConcreteGridMap>
+void createLevels(std::vector<ConcreteGridMap*>& levels, int size)
+{
+  for (int i = 0; i < 3; ++i) {
+    int levelSize = size >> i;
+    float cellLength = 0.05f * static_cast<float>(1 << i);
+    levels.push_back(new ConcreteGridMap(cellLength, Eigen::Vector2i(levelSize, levelSize), Eigen::Vector2f(0.5f, 0.5f) * levelSize * cellLength));
+  }
+}
+
+template<typename ConcreteGridMap>
+void deleteLevels(std::vector<ConcreteGridMap*>& levels)
+{
+  for (size_t i = 0; i < levels.size(); ++i) {
+    delete levels[i];
+  }
+  levels.clear();
+}
+
+template<typename ConcreteGridMap>
+void checkRoundTrip()
+{
+  std::vector<ConcreteGridMap*> saved;
+  std::vector<ConcreteGridMap*> loaded;
+  createLevels(saved, 512);
+  createLevels(loaded, 512);
+
+  DataContainer scan;
+  for (int i = 0; i < 720; ++i) {
+    float angle = static_cast<float>(i) * 0.00872f;
+    scan.add(Eigen::Vector2f(cos(angle), sin(angle)) * (60.0f + 20.0f * sin(angle * 5.0f)));
+  }
+
+  for (int k = 0; k < 20; ++k) {
+    for (size_t i = 0; i < saved.size(); ++i) {
+      saved[i]->updateByScan(scan, Eigen::Vector3f(0.1f * k, 0.05f * k, 0.1f * k));
+    }
+  }
+
+  saved[0]->centerWindowOn(Eigen::Vector2f(2.0f, 2.0f), 0.1f);
+
+  //the loaded maps have to match the saved ones including the probability plane
+  for (size_t i = 0; i < loaded.size(); ++i) {
+    loaded[i]->setProbabilityPlaneEnabled(true);
+  }
+
+  std::string fileName (getTempFileName());
+
+  GridMapFile<ConcreteGridMap> mapFile;
+  ASSERT_TRUE(mapFile.save(fileName, std::vector<const ConcreteGridMap*>(saved.begin(), saved.end()))) << mapFile.getErrorMessage();
+  ASSERT_TRUE(mapFile.load(fileName, loaded)) << mapFile.getErrorMessage();
+
+  for (size_t i = 0; i < saved.size(); ++i) {
+    const ConcreteGridMap& a (*saved[i]);
+    const ConcreteGridMap& b (*loaded[i]);
+
+    ASSERT_EQ(a.getSizeX(), b.getSizeX());
+    ASSERT_EQ(a.getSizeY(), b.getSizeY());
+    EXPECT_FLOAT_EQ(a.getCellLength(), b.getCellLength());
+    EXPECT_TRUE(a.getWorldCoords(Eigen::Vector2f::Zero()).isApprox(b.getWorldCoords(Eigen::Vector2f::Zero())));
+
+    Eigen::Vector2i exploredMinA, exploredMaxA, exploredMinB, exploredMaxB;
+    EXPECT_EQ(a.getExploredArea(exploredMinA, exploredMaxA), b.getExploredArea(exploredMinB, exploredMaxB));
+    EXPECT_EQ(exploredMinA, exploredMinB);
+    EXPECT_EQ(exploredMaxA, exploredMaxB);
+
+    int numDifferent = 0;
+
+    for (int y = 0; y < a.getSizeY(); ++y) {
+      for (int x = 0; x < a.getSizeX(); ++x) {
+        if (!a.isCellAllocated(x, y) && !b.isCellAllocated(x, y)) {
+          continue;
+        }
+
+        int indexA = a.getCellIndex(x, y);
+        int indexB = b.getCellIndex(x, y);
+
+        if ((a.getCell(indexA).getValue() != b.getCell(indexB).getValue()) ||
+            (a.getGridProbabilityMap(indexA) != b.getProbabilityPlane()[indexB])) {
+          ++numDifferent;
+        }
+      }
+    }
+
+    EXPECT_EQ(0, numDifferent) << "level " << i;
+  }
+
+  //a file with a different number of levels must be rejected
+  std::vector<ConcreteGridMap*> tooFewLevels (loaded.begin(), loaded.begin() + 2);
+  EXPECT_FALSE(mapFile.load(fileName, tooFewLevels));
+  EXPECT_FALSE(mapFile.getErrorMessage().empty());
+
+  std::remove(fileName.c_str());
+
+  deleteLevels(saved);
+  deleteLevels(loaded);
+}
+
+}
+
+template<typename ConcreteGridMap>
+class GridMapFileTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(GridMapFileTest, GridMapLayoutTypes);
+
+TYPED_TEST(GridMapFileTest, RoundTrip)
+{
+  checkRoundTrip<TypeParam>();
+}
+
+TYPED_TEST(GridMapFileTest, RejectsInvalidFiles)
+{
+  std::vector<TypeParam*> levels;
+  createLevels(levels, 64);
+
+  GridMapFile<TypeParam> mapFile;
+  EXPECT_FALSE(mapFile.load("/nonexistent/map.hmap", levels));
+
+  std::string fileName (getTempFileName());
+  {
+    std::ofstream file (fileName.c_str());
+    file << "not a map file, but long enough to be mistaken for one if only the size was checked";
+  }
+
+  EXPECT_FALSE(mapFile.load(fileName, levels));
+  EXPECT_FALSE(mapFile.getErrorMessage().empty());
+
+  std::remove(fileName.c_str());
+  deleteLevels(levels);
+}
@@ -0,0 +1,140 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "map/GridMap.h"
+#include "map/GridMapOccupancyConversion.h"
+#include "map/GridMapSnapshot.h"
+
+#include "grid_map_layouts.h"
+
+using namespace hectorslam;
+
+namespace {
+
+DataContainer makeScan(float range)
+{
+  DataContainer scan;
+  for (int i = 0; i < 720; ++i) {
+    float angle = static_cast<float>(i) * 6.28f / 720.0f;
+    scan.add(Eigen::Vector2f(cos(angle), sin(angle)) * (range + 10.0f * sin(angle * 5.0f)));
+  }
+  return scan;
+}
+
+}
+
+template<typename ConcreteGridMap>
+class GridMapOccupancyConversionTest : public ::testing::Test
+{
+protected:
+  typedef GridMapOccupancyConversion<ConcreteGridMap> Conversion;
+};
+
+TYPED_TEST_CASE(GridMapOccupancyConversionTest, GridMapLayoutTypes);
+
+TYPED_TEST(GridMapOccupancyConversionTest, IncrementalConversionMatchesFullConversion)
+{
+  typedef typename TestFixture::Conversion Conversion;
+
+  TypeParam gridMap (0.05f, Eigen::Vector2i(512, 512), Eigen::Vector2f::Zero());
+  GridMapSnapshot<TypeParam> snapshot;
+
+  //the message covers only part of the map, as with map_crop_to_explored
+  Eigen::Vector2i messageAreaMin (100, 80);
+  Eigen::Vector2i messageAreaMax (400, 430);
+  int width = messageAreaMax.x() - messageAreaMin.x() + 1;
+  int height = messageAreaMax.y() - messageAreaMin.y() + 1;
+
+  std::vector<int8_t> incremental (width * height);
+  std::vector<int8_t> full (width * height);
+
+  DataContainer scan (makeScan(170.0f));
+
+  for (int k = 0; k < 10; ++k) {
+    gridMap.updateByScan(scan, Eigen::Vector3f(12.0f + 0.3f * k, 12.0f - 0.2f * k, 0.2f * k));
+
+    ASSERT_TRUE(snapshot.update(gridMap));
+
+    Eigen::Vector2i changedMin, changedMax;
+
+    if (k == 0) {
+      EXPECT_FALSE(snapshot.getLastChangedArea(changedMin, changedMax));
+      changedMin = messageAreaMin;
+      changedMax = messageAreaMax;
+    } else {
+      ASSERT_TRUE(snapshot.getLastChangedArea(changedMin, changedMax));
+      changedMin = changedMin.cwiseMax(messageAreaMin);
+      changedMax = changedMax.cwiseMin(messageAreaMax);
+    }
+
+    //the later scans reach beyond the message area, those cells must not be written
+    Conversion::convertArea(snapshot.getGridMap(), &incremental[0], width, messageAreaMin, changedMin, changedMax);
+  }
+
+  //the reference is converted from the source map, so it also covers the changed areas the snapshot copies
+  Conversion::convertArea(gridMap, &full[0], width, messageAreaMin, messageAreaMin, messageAreaMax);
+
+  int numDifferent = 0;
+  int numKnown = 0;
+
+  for (size_t i = 0; i < full.size(); ++i) {
+    if (incremental[i] != full[i]) {
+      ++numDifferent;
+    }
+    if (full[i] != Conversion::cellUnknown) {
+      ++numKnown;
+    }
+  }
+
+  EXPECT_EQ(0, numDifferent);
+  EXPECT_GT(numKnown, 0);
+}
+
+TYPED_TEST(GridMapOccupancyConversionTest, ConvertsCellStates)
+{
+  typedef typename TestFixture::Conversion Conversion;
+
+  TypeParam gridMap (0.05f, Eigen::Vector2i(64, 64), Eigen::Vector2f::Zero());
+
+  for (int i = 0; i < 5; ++i) {
+    gridMap.updateSetOccupied(gridMap.getCellIndexForUpdate(10, 20));
+    gridMap.updateSetFree(gridMap.getCellIndexForUpdate(11, 20));
+  }
+
+  int8_t data[3];
+  Conversion::convertArea(gridMap, data, 3, Eigen::Vector2i(10, 20), Eigen::Vector2i(10, 20), Eigen::Vector2i(12, 20));
+
+  EXPECT_EQ(Conversion::cellOccupied, data[0]);
+  EXPECT_EQ(Conversion::cellFree, data[1]);
+  EXPECT_EQ(Conversion::cellUnknown, data[2]);
+}
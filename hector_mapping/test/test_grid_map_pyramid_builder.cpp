@@ -0,0 +1,179 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "map/GridMapPyramidBuilder.h"
+
+#include "grid_map_layouts.h"
+
+using namespace hectorslam;
+
+namespace {
+
+/**
+ * Three levels with the window of all of them moved off the start, so the coarse cells are not aligned to the
+ * finest storage origin.
+ */
+template<typename ConcreteGridMap>
+void createLevels(std::vector<ConcreteGridMap*>& levels, int size)
+{
+  DataContainer scan;
+  for (int i = 0; i < 720; ++i) {
+    float angle = static_cast<float>(i) * 0.00872f;
+    scan.add(Eigen::Vector2f(cos(angle), sin(angle)) * (60.0f + 20.0f * sin(angle * 5.0f)));
+  }
+
+  for (int level = 0; level < 3; ++level) {
+    Eigen::Vector2f offset (Eigen::Vector2f::Constant(static_cast<float>(size) * 0.05f * 0.5f));
+    levels.push_back(new ConcreteGridMap(0.05f * static_cast<float>(1 << level), Eigen::Vector2i(size >> level, size >> level), offset));
+  }
+
+  for (int i = 0; i < 10; ++i) {
+    levels[0]->updateByScan(scan, Eigen::Vector3f(0.1f * i, 0.05f * i, 0.1f * i));
+  }
+
+  for (int level = 0; level < 3; ++level) {
+    levels[level]->centerWindowOn(Eigen::Vector2f(1.65f, 1.05f), 0.1f);
+  }
+
+  for (int i = 0; i < 5; ++i) {
+    levels[0]->updateByScan(scan, Eigen::Vector3f(1.5f + 0.1f * i, 1.0f, 0.1f * i));
+  }
+}
+
+template<typename ConcreteGridMap>
+void deleteLevels(std::vector<ConcreteGridMap*>& levels)
+{
+  for (size_t i = 0; i < levels.size(); ++i) {
+    delete levels[i];
+  }
+  levels.clear();
+}
+
+template<typename ConcreteGridMap>
+float getValue(const ConcreteGridMap& map, int x, int y)
+{
+  return map.isCellAllocated(x, y) ? map.getCell(map.getCellIndex(x, y)).getValue() : 0.0f;
+}
+
+/**
+ * Pools the finest cells covered by coarse cell (x,y) of level one at a time, in the order the builder sums them.
+ */
+template<typename ConcreteGridMap>
+float getNaivePooledValue(const std::vector<ConcreteGridMap*>& levels, int level, int x, int y, GridMapPyramidPooling pooling)
+{
+  const ConcreteGridMap& fineMap (*levels[0]);
+  const ConcreteGridMap& coarseMap (*levels[level]);
+
+  int ratio = 1 << level;
+
+  Eigen::Vector2f corner (fineMap.getMapCoords(coarseMap.getWorldCoords(Eigen::Vector2f(x - 0.5f, y - 0.5f))));
+  int fineX = static_cast<int>(std::floor(corner.x() + 0.5f));
+  int fineY = static_cast<int>(std::floor(corner.y() + 0.5f));
+
+  float maxValue = -std::numeric_limits<float>::max();
+  float sum = 0.0f;
+  int count = 0;
+
+  for (int j = fineY; j < fineY + ratio; ++j) {
+    for (int i = fineX; i < fineX + ratio; ++i) {
+      if ((i >= 0) && (j >= 0) && (i < fineMap.getSizeX()) && (j < fineMap.getSizeY())) {
+        float value = getValue(fineMap, i, j);
+        maxValue = std::max(maxValue, value);
+        sum += value;
+        ++count;
+      }
+    }
+  }
+
+  if (count == 0) {
+    return 0.0f;
+  }
+
+  return (pooling == PyramidPoolingMax) ? maxValue : sum / static_cast<float>(count);
+}
+
+template<typename ConcreteGridMap>
+void checkPooling(GridMapPyramidPooling pooling, WorkerPool* workerPool)
+{
+  std::vector<ConcreteGridMap*> levels;
+  createLevels(levels, 512);
+
+  GridMapPyramidBuilder<ConcreteGridMap> builder (workerPool);
+  builder.setPooling(pooling);
+  builder.build(levels);
+
+  for (int level = 1; level < 3; ++level) {
+    const ConcreteGridMap& coarseMap (*levels[level]);
+    int numKnown = 0;
+
+    for (int y = 0; y < coarseMap.getSizeY(); ++y) {
+      for (int x = 0; x < coarseMap.getSizeX(); ++x) {
+        float expected = getNaivePooledValue(levels, level, x, y, pooling);
+        ASSERT_EQ(expected, getValue(coarseMap, x, y)) << "level " << level << " cell " << x << " " << y;
+
+        if (expected != 0.0f) {
+          ++numKnown;
+        }
+      }
+    }
+
+    EXPECT_GT(numKnown, 1000) << "level " << level;
+  }
+
+  deleteLevels(levels);
+}
+
+}
+
+template<typename ConcreteGridMap>
+class GridMapPyramidBuilderTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(GridMapPyramidBuilderTest, GridMapLayoutTypes);
+
+TYPED_TEST(GridMapPyramidBuilderTest, MaxPoolingMatchesNaiveReduction)
+{
+  checkPooling<TypeParam>(PyramidPoolingMax, 0);
+
+  WorkerPool workerPool (3);
+  checkPooling<TypeParam>(PyramidPoolingMax, &workerPool);
+}
+
+TYPED_TEST(GridMapPyramidBuilderTest, MeanPoolingMatchesNaiveReduction)
+{
+  checkPooling<TypeParam>(PyramidPoolingMean, 0);
+
+  WorkerPool workerPool (3);
+  checkPooling<TypeParam>(PyramidPoolingMean, &workerPool);
+}
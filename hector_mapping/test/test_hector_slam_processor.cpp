@@ -0,0 +1,224 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "slam_main/HectorSlamProcessor.h"
+
+#include "grid_map_layouts.h"
+
+using namespace hectorslam;
+
+namespace {
+
+struct Wall
+{
+  Eigen::Vector2f begin;
+  Eigen::Vector2f end;
+};
+
+/**
+ * Rectangular room with a few obstacles, enough structure for the scan matcher to converge.
+ */
+std::vector<Wall> makeRoom()
+{
+  const float corners[][4] = {
+    {-10.0f, -7.0f, 10.0f, -7.0f}, {10.0f, -7.0f, 10.0f, 7.0f}, {10.0f, 7.0f, -10.0f, 7.0f}, {-10.0f, 7.0f, -10.0f, -7.0f},
+    {-3.0f, -2.0f, 1.0f, -2.0f}, {1.0f, -2.0f, 1.0f, 3.0f}, {4.0f, 4.0f, 7.0f, 1.0f}, {-8.0f, 3.0f, -5.0f, 3.0f},
+    {-6.0f, -6.0f, -6.0f, -3.0f}, {5.0f, -5.0f, 6.0f, -4.0f}};
+
+  std::vector<Wall> walls;
+
+  for (size_t i = 0; i < sizeof(corners) / sizeof(corners[0]); ++i) {
+    Wall wall;
+    wall.begin = Eigen::Vector2f(corners[i][0], corners[i][1]);
+    wall.end = Eigen::Vector2f(corners[i][2], corners[i][3]);
+    walls.push_back(wall);
+  }
+
+  return walls;
+}
+
+float castRay(const std::vector<Wall>& walls, const Eigen::Vector2f& origin, float angle)
+{
+  Eigen::Vector2f dir (cos(angle), sin(angle));
+  float closest = std::numeric_limits<float>::max();
+
+  for (size_t i = 0; i < walls.size(); ++i) {
+    Eigen::Vector2f edge (walls[i].end - walls[i].begin);
+    Eigen::Vector2f toBegin (walls[i].begin - origin);
+
+    float denominator = dir.x() * edge.y() - dir.y() * edge.x();
+
+    if (std::fabs(denominator) < 1e-9f) {
+      continue;
+    }
+
+    float dist = (toBegin.x() * edge.y() - toBegin.y() * edge.x()) / denominator;
+    float along = (toBegin.x() * dir.y() - toBegin.y() * dir.x()) / denominator;
+
+    if ((dist > 0.0f) && (along >= 0.0f) && (along <= 1.0f) && (dist < closest)) {
+      closest = dist;
+    }
+  }
+
+  return closest;
+}
+
+Eigen::Vector3f getTrajectoryPose(int step)
+{
+  float t = static_cast<float>(step) * 0.02f;
+  return Eigen::Vector3f(-2.0f + 3.0f * sin(t), -4.0f + 1.5f * sin(2.0f * t), 0.5f * sin(1.3f * t));
+}
+
+/**
+ * Simulated 720 beam scan at pose, scaled to map coordinates.
+ */
+hectorslam::DataContainer makeScan(const std::vector<Wall>& walls, const Eigen::Vector3f& pose, float scaleToMap)
+{
+  hectorslam::DataContainer scan;
+  scan.setOrigo(Eigen::Vector2f::Zero());
+
+  for (int i = 0; i < 720; ++i) {
+    float angle = -2.35f + 4.7f * static_cast<float>(i) / 720.0f;
+    float range = castRay(walls, pose.head<2>(), pose[2] + angle);
+
+    if (range < 29.9f) {
+      scan.add(Eigen::Vector2f(cos(angle), sin(angle)) * range * scaleToMap);
+    }
+  }
+
+  return scan;
+}
+
+/**
+ * Runs numScans simulated scans along the trajectory through a processor with pipelined map updates and parallel
+ * hypotheses and stores the largest position error. The processor lives on the running thread, so a deadlocked
+ * processor does not block the test thread when it gives up.
+ */
+struct PipelinedHypothesesRun
+{
+  PipelinedHypothesesRun(int numScans, float& maxError)
+    : numScans(numScans)
+    , maxError(maxError)
+  {}
+
+  void operator()()
+  {
+    HectorSlamProcessor processor (0.05f, 1024, 1024, Eigen::Vector2f(0.5f, 0.5f), 3);
+    processor.setUpdateFactorFree(0.4f);
+    processor.setUpdateFactorOccupied(0.9f);
+    processor.setMapUpdateMinDistDiff(0.4f);
+    processor.setMapUpdateMinAngleDiff(0.06f);
+
+    //the hypotheses are matched on the pool while the map update thread queues level updates on it
+    processor.setNumWorkerThreads(2);
+    processor.setPipelinedMapUpdate(true);
+    processor.setMultiHypothesisMatching(3, 0.1f, 0.1f);
+
+    std::vector<Wall> walls (makeRoom());
+
+    float scaleToMap = processor.getScaleToMap();
+    Eigen::Vector3f start (getTrajectoryPose(0));
+
+    for (int step = 0; step < numScans; ++step) {
+      Eigen::Vector3f pose (getTrajectoryPose(step));
+
+      processor.update(makeScan(walls, pose, scaleToMap), processor.getLastScanMatchPose());
+
+      //the processor starts at the origin, the trajectory does not
+      Eigen::Vector2f error (processor.getLastScanMatchPose().head<2>() - (pose - start).head<2>());
+      maxError = std::max(maxError, error.norm());
+    }
+  }
+
+  int numScans;
+  float& maxError;
+};
+
+}
+
+TEST(HectorSlamProcessor, PipelinedUpdateWithParallelHypothesesCompletes)
+{
+  float maxError = 0.0f;
+  boost::thread run (PipelinedHypothesesRun(400, maxError));
+
+  ASSERT_TRUE(run.timed_join(boost::posix_time::seconds(60))) << "scan processing deadlocked";
+
+  EXPECT_LT(maxError, 0.1f);
+}
+
+template<typename ConcreteGridMap>
+class MapRepMultiMapTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(MapRepMultiMapTest, GridMapLayoutTypes);
+
+TYPED_TEST(MapRepMultiMapTest, ParallelHypothesesTrackTrajectory)
+{
+  WorkerPool workerPool (2);
+
+  MapRepMultiMapT<0, TypeParam> mapRep (0.05f, 1024, 1024, 3, Eigen::Vector2f(0.5f, 0.5f), 0, 0);
+  mapRep.setUpdateFactorFree(0.4f);
+  mapRep.setUpdateFactorOccupied(0.9f);
+  mapRep.setWorkerPool(&workerPool);
+  mapRep.setMultiHypothesisMatching(3, 0.1f, 0.1f);
+
+  std::vector<Wall> walls (makeRoom());
+
+  float scaleToMap = mapRep.getScaleToMap();
+  Eigen::Vector3f start (getTrajectoryPose(0));
+  Eigen::Vector3f estimate (Eigen::Vector3f::Zero());
+
+  mapRep.updateByScan(makeScan(walls, start, scaleToMap), estimate);
+
+  float maxError = 0.0f;
+
+  for (int step = 1; step < 200; ++step) {
+    Eigen::Vector3f pose (getTrajectoryPose(step));
+    hectorslam::DataContainer scan (makeScan(walls, pose, scaleToMap));
+
+    Eigen::Matrix3f covariance;
+    estimate = mapRep.matchData(estimate, scan, covariance);
+
+    if (step % 5 == 0) {
+      mapRep.updateByScan(scan, estimate);
+    }
+
+    Eigen::Vector2f error (estimate.head<2>() - (pose - start).head<2>());
+    maxError = std::max(maxError, error.norm());
+  }
+
+  EXPECT_LT(maxError, 0.1f);
+}
@@ -0,0 +1,241 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "map/GridMap.h"
+
+#include "grid_map_layouts.h"
+
+using namespace hectorslam;
+
+namespace {
+
+/**
+ * Paints the same 20000 point scans into a map updated serially and one updated on a worker pool, the parallel update
+ * has to produce bit-identical cells and probability planes.
+ */
+template<typename ConcreteGridMap>
+void compareParallelToSerialUpdate()
+{
+  WorkerPool workerPool (3);
+
+  ConcreteGridMap serialMap (0.05f, Eigen::Vector2i(1024, 1024), Eigen::Vector2f::Zero());
+  ConcreteGridMap parallelMap (0.05f, Eigen::Vector2i(1024, 1024), Eigen::Vector2f::Zero());
+
+  serialMap.setProbabilityPlaneEnabled(true);
+  parallelMap.setProbabilityPlaneEnabled(true);
+  parallelMap.setWorkerPool(&workerPool);
+
+  DataContainer scan;
+  srand(1);
+
+  for (int k = 0; k < 20; ++k) {
+    scan.clear();
+    scan.setOrigo(Eigen::Vector2f::Zero());
+
+    for (int i = 0; i < 20000; ++i) {
+      float angle = static_cast<float>(rand()) / static_cast<float>(RAND_MAX) * 6.28f;
+      float range = static_cast<float>(rand()) / static_cast<float>(RAND_MAX) * 25.0f;
+      scan.add(Eigen::Vector2f(cos(angle), sin(angle)) * range * 20.0f);
+    }
+
+    Eigen::Vector3f pose (25.0f + 0.1f * k, 25.0f, 0.1f * k);
+    serialMap.updateByScan(scan, pose);
+    parallelMap.updateByScan(scan, pose);
+  }
+
+  ASSERT_EQ(serialMap.getStorageSize(), parallelMap.getStorageSize());
+
+  int numDifferent = 0;
+
+  for (int i = 0; i < serialMap.getStorageSize(); ++i) {
+    if (std::memcmp(&serialMap.getCell(i), &parallelMap.getCell(i), sizeof(typename ConcreteGridMap::CellType)) ||
+        (serialMap.getProbabilityPlane()[i] != parallelMap.getProbabilityPlane()[i])) {
+      ++numDifferent;
+    }
+  }
+
+  EXPECT_EQ(0, numDifferent);
+}
+
+typedef std::map<std::pair<int, int>, float> CellProbabilities;
+
+std::pair<int, int> getCellKey(const Eigen::Vector2f& worldCoords)
+{
+  return std::make_pair(static_cast<int>(std::floor(worldCoords.x() + 0.5f)), static_cast<int>(std::floor(worldCoords.y() + 0.5f)));
+}
+
+/**
+ * Records the spilled cells by their world position (the test maps have a cell length of 1).
+ */
+class SpillRecorder : public MapSpillInterface
+{
+public:
+
+  virtual void spillCell(int, const Eigen::Vector2f& worldCoords, float probability)
+  {
+    std::pair<int, int> key (getCellKey(worldCoords));
+    EXPECT_EQ(0u, cells.count(key)) << "cell " << key.first << " " << key.second << " spilled twice";
+    cells[key] = probability;
+  }
+
+  CellProbabilities cells;
+};
+
+/**
+ * Raw cell and probability plane entry of a map cell, by world position.
+ */
+struct CellState
+{
+  bool allocated;
+  bool known;
+  float value;
+  float probability;
+  float planeProbability;
+};
+
+template<typename ConcreteGridMap>
+std::map<std::pair<int, int>, CellState> getCellStates(const ConcreteGridMap& map)
+{
+  std::map<std::pair<int, int>, CellState> states;
+
+  for (int y = 0; y < map.getSizeY(); ++y) {
+    for (int x = 0; x < map.getSizeX(); ++x) {
+      CellState state;
+      state.allocated = map.isCellAllocated(x, y);
+      state.known = false;
+      state.value = 0.0f;
+      state.probability = 0.5f;
+      state.planeProbability = 0.0f;
+
+      if (state.allocated) {
+        int index = map.getCellIndex(x, y);
+        state.known = map.isFree(index) || map.isOccupied(index);
+        state.value = map.getCell(index).getValue();
+        state.probability = map.getGridProbabilityMap(index);
+        state.planeProbability = map.getProbabilityPlane()[index];
+      }
+
+      states[getCellKey(map.getWorldCoords(Eigen::Vector2f(x, y)))] = state;
+    }
+  }
+
+  return states;
+}
+
+/**
+ * Centers the window on target and checks that exactly the known cells leaving it are spilled, with their
+ * probabilities, and that the cells staying keep their raw values and plane entries bit for bit.
+ */
+template<typename ConcreteGridMap>
+void checkWindowMove(ConcreteGridMap& map, const Eigen::Vector2f& target)
+{
+  std::map<std::pair<int, int>, CellState> before (getCellStates(map));
+
+  SpillRecorder spillRecorder;
+  ASSERT_TRUE(map.centerWindowOn(target, 0.5f, &spillRecorder));
+
+  std::map<std::pair<int, int>, CellState> after (getCellStates(map));
+
+  int numStaying = 0;
+  int numSpilled = 0;
+
+  for (typename std::map<std::pair<int, int>, CellState>::const_iterator it = before.begin(); it != before.end(); ++it) {
+    typename std::map<std::pair<int, int>, CellState>::const_iterator afterIt (after.find(it->first));
+    CellProbabilities::const_iterator spillIt (spillRecorder.cells.find(it->first));
+
+    if (afterIt != after.end()) {
+      EXPECT_TRUE(spillIt == spillRecorder.cells.end()) << "staying cell " << it->first.first << " " << it->first.second << " spilled";
+      EXPECT_EQ(0, std::memcmp(&it->second.value, &afterIt->second.value, sizeof(float)));
+
+      //sparse layouts may allocate blocks of unknown cells
+      if (it->second.allocated && afterIt->second.allocated) {
+        EXPECT_EQ(it->second.planeProbability, afterIt->second.planeProbability);
+      }
+
+      if (it->second.known) {
+        ++numStaying;
+      }
+    } else if (it->second.known) {
+      ASSERT_TRUE(spillIt != spillRecorder.cells.end()) << "leaving cell " << it->first.first << " " << it->first.second << " not spilled";
+      EXPECT_EQ(it->second.probability, spillIt->second);
+      ++numSpilled;
+    }
+  }
+
+  //only known cells are spilled, and each of them has been matched to a leaving cell above
+  EXPECT_EQ(numSpilled, static_cast<int>(spillRecorder.cells.size()));
+  EXPECT_GT(numSpilled, 100);
+  EXPECT_GT(numStaying, 100);
+
+  //cells entering the window are unknown
+  for (typename std::map<std::pair<int, int>, CellState>::const_iterator it = after.begin(); it != after.end(); ++it) {
+    if (before.find(it->first) == before.end()) {
+      EXPECT_FALSE(it->second.known) << "entering cell " << it->first.first << " " << it->first.second << " known";
+    }
+  }
+}
+
+}
+
+template<typename ConcreteGridMap>
+class OccGridMapBaseTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(OccGridMapBaseTest, GridMapLayoutTypes);
+
+TYPED_TEST(OccGridMapBaseTest, ParallelUpdateMatchesSerial)
+{
+  compareParallelToSerialUpdate<TypeParam>();
+}
+
+TYPED_TEST(OccGridMapBaseTest, WindowMoveSpillsLeavingCellsOnly)
+{
+  TypeParam map (1.0f, Eigen::Vector2i(256, 256), Eigen::Vector2f::Zero());
+  map.setProbabilityPlaneEnabled(true);
+
+  DataContainer scan;
+  for (int i = 0; i < 720; ++i) {
+    float angle = static_cast<float>(i) * 6.2f / 720.0f;
+    scan.add(Eigen::Vector2f(cos(angle), sin(angle)) * (70.0f + 20.0f * sin(angle * 7.0f)));
+  }
+
+  for (int i = 0; i < 5; ++i) {
+    map.updateByScan(scan, Eigen::Vector3f(128.0f + i, 128.0f - i, 0.1f * i));
+  }
+
+  //both directions on both axes
+  checkWindowMove(map, Eigen::Vector2f(128.0f + 61.0f, 128.0f - 47.0f));
+  checkWindowMove(map, Eigen::Vector2f(128.0f - 40.0f, 128.0f + 51.0f));
+}
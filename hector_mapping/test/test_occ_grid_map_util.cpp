@@ -0,0 +1,162 @@
+//=================================================================================================
+// Copyright (c) 2011, Stefan Kohlbrecher, TU Darmstadt
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Simulation, Systems Optimization and Robotics
+//       group, TU Darmstadt nor the names of its contributors may be used to
+//       endorse or promote products derived from this software without
+//       specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//=================================================================================================
+
+
+#include <gtest/gtest.h>
+
+#include "map/GridMap.h"
+#include "map/GridMapCacheArray.h"
+#include "map/OccGridMapUtil.h"
+
+#include "grid_map_layouts.h"
+
+using namespace hectorslam;
+
+namespace {
+
+DataContainer makeScan(int numPoints, float range)
+{
+  DataContainer scan;
+  for (int i = 0; i < numPoints; ++i) {
+    float angle = static_cast<float>(i) * 6.2f / static_cast<float>(numPoints);
+    scan.add(Eigen::Vector2f(cos(angle), sin(angle)) * (range + 5.0f * sin(angle * 7.0f)));
+  }
+  return scan;
+}
+
+template<typename ConcreteGridMap>
+void buildMap(ConcreteGridMap& map)
+{
+  DataContainer scan (makeScan(720, 40.0f));
+  for (int i = 0; i < 10; ++i) {
+    map.updateByScan(scan, Eigen::Vector3f(100.0f + i, 100.0f - 0.5f * i, 0.05f * i));
+  }
+}
+
+/**
+ * Evaluates every point on its own, which always takes the scalar path, and sums the results.
+ */
+template<typename MapUtil>
+void getScalarHessianDerivs(MapUtil& util, const Eigen::Vector3f& pose, const DataContainer& points, Eigen::Matrix3f& H, Eigen::Vector3f& dTr, float& residual)
+{
+  H = Eigen::Matrix3f::Zero();
+  dTr = Eigen::Vector3f::Zero();
+  residual = 0.0f;
+
+  for (int i = 0; i < points.getSize(); ++i) {
+    DataContainer point;
+    point.add(points.getVecEntry(i));
+
+    Eigen::Matrix3f pointH;
+    Eigen::Vector3f pointDTr;
+    float pointResidual;
+    util.getCompleteHessianDerivs(pose, point.getView(), pointH, pointDTr, pointResidual);
+
+    H += pointH;
+    dTr += pointDTr;
+    residual += pointResidual;
+  }
+}
+
+void expectNear(const Eigen::MatrixXf& expected, const Eigen::MatrixXf& actual)
+{
+  float tolerance = 1e-4f * std::max(1.0f, expected.cwiseAbs().maxCoeff());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected(i), actual(i), tolerance) << "coefficient " << i;
+  }
+}
+
+template<typename ConcreteGridMap>
+void compareBatchedToScalar(bool probabilityPlane)
+{
+  ConcreteGridMap map (1.0f, Eigen::Vector2i(256, 256), Eigen::Vector2f::Zero());
+  buildMap(map);
+  map.setProbabilityPlaneEnabled(probabilityPlane);
+
+  OccGridMapUtil<ConcreteGridMap, GridMapCacheArray> util (&map);
+
+  //odd point count so the scalar remainder is exercised as well, every fifth point lies outside of the map and has
+  //to be masked out of its batch
+  DataContainer scan (makeScan(723, 40.0f));
+  DataContainer points;
+  for (int i = 0; i < scan.getSize(); ++i) {
+    points.add(scan.getVecEntry(i) * ((i % 5 == 0) ? 5.0f : 1.0f));
+  }
+
+  Eigen::Vector3f pose (105.5f, 97.2f, 0.23f);
+
+  Eigen::Matrix3f H, scalarH;
+  Eigen::Vector3f dTr, scalarDTr;
+  float residual, scalarResidual;
+
+  util.getCompleteHessianDerivs(pose, points.getView(), H, dTr, residual);
+  getScalarHessianDerivs(util, pose, points, scalarH, scalarDTr, scalarResidual);
+
+  EXPECT_GT(scalarH.cwiseAbs().maxCoeff(), 0.0f);
+  expectNear(scalarH, H);
+  expectNear(scalarDTr, dTr);
+  EXPECT_NEAR(scalarResidual, residual, 1e-4f * scalarResidual);
+}
+
+}
+
+template<typename ConcreteGridMap>
+class OccGridMapUtilTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(OccGridMapUtilTest, GridMapLayoutTypes);
+
+TYPED_TEST(OccGridMapUtilTest, BatchedHessianMatchesScalar)
+{
+  compareBatchedToScalar<TypeParam>(false);
+}
+
+TYPED_TEST(OccGridMapUtilTest, BatchedHessianMatchesScalarWithProbabilityPlane)
+{
+  compareBatchedToScalar<TypeParam>(true);
+}
+
+TYPED_TEST(OccGridMapUtilTest, OutOfBoundsPointsDoNotContribute)
+{
+  TypeParam map (1.0f, Eigen::Vector2i(256, 256), Eigen::Vector2f::Zero());
+  buildMap(map);
+
+  OccGridMapUtil<TypeParam, GridMapCacheArray> util (&map);
+
+  //all points are far outside of the map, each one adds the maximum residual of 1 and nothing else
+  DataContainer points (makeScan(64, 500.0f));
+
+  Eigen::Matrix3f H;
+  Eigen::Vector3f dTr;
+  float residual;
+
+  util.getCompleteHessianDerivs(Eigen::Vector3f(128.0f, 128.0f, 0.0f), points.getView(), H, dTr, residual);
+
+  EXPECT_TRUE(H.isZero());
+  EXPECT_TRUE(dTr.isZero());
+  EXPECT_FLOAT_EQ(static_cast<float>(points.getSize()), residual);
+}